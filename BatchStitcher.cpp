@@ -0,0 +1,301 @@
+#include "BatchStitcher.h"
+#include "PngStripEncoder.h"
+#include "StitchCorpus.h"
+#include "TaskExecutor.h"
+#include "Trace.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+
+// OpenCV 4 headers
+#include <opencv2/imgcodecs.hpp>
+
+namespace {
+    namespace fs = std::filesystem;
+
+    bool IsImageFile(const fs::path& path) {
+        std::string extension = path.extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)tolower(c); });
+        return extension == ".png" || extension == ".bmp" || extension == ".jpg" || extension == ".jpeg" ||
+               extension == ".tif" || extension == ".tiff";
+    }
+
+    uint32_t ReadBigEndian32(const uint8_t* p) {
+        return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+    }
+
+    int32_t ReadLittleEndian32(const uint8_t* p) {
+        return (int32_t)((uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+    }
+
+    // Read an image's size from its header without decoding it (PNG and BMP),
+    // falling back to a full decode for other formats
+    bool ImageSize(const std::string& path, int& width, int& height) {
+        uint8_t header[26] = {};
+        std::ifstream file(path, std::ios::binary);
+        if (file.read(reinterpret_cast<char*>(header), sizeof(header))) {
+            static const uint8_t pngSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+            if (memcmp(header, pngSignature, sizeof(pngSignature)) == 0 && memcmp(header + 12, "IHDR", 4) == 0) {
+                width = (int)ReadBigEndian32(header + 16);
+                height = (int)ReadBigEndian32(header + 20);
+                return width > 0 && height > 0;
+            }
+            if (header[0] == 'B' && header[1] == 'M') {
+                width = ReadLittleEndian32(header + 18);
+                height = std::abs(ReadLittleEndian32(header + 22));  // Negative for top-down
+                return width > 0 && height > 0;
+            }
+        }
+        cv::Mat image = cv::imread(path, cv::IMREAD_UNCHANGED);
+        width = image.cols;
+        height = image.rows;
+        return !image.empty();
+    }
+
+    // Decoded BGRA frames, plus a canvas at most as large as all of them,
+    // plus decode and encode scratch of about one frame
+    size_t EstimateJobBytes(const BatchJob& job) {
+        if (job.frameFiles.empty())
+            return 0;
+        int width = 0, height = 0;
+        if (!ImageSize((fs::path(job.inputDirectory) / job.frameFiles[0]).string(), width, height))
+            return 0;
+        size_t frameBytes = (size_t)width * height * 4;
+        return frameBytes * job.frameFiles.size() * 2 + frameBytes;
+    }
+
+    // Whole frames top to bottom with no overlap, as the GDI stacking methods lay them out
+    std::vector<FramePlacement> StackedPlacements(const std::vector<cv::Mat>& frames) {
+        std::vector<FramePlacement> placements(frames.size());
+        int y = 0;
+        for (size_t i = 0; i < frames.size(); i++) {
+            placements[i].y = y;
+            y += frames[i].rows;
+        }
+        return placements;
+    }
+
+    // Byte budget shared by the workers. Acquire blocks until the request fits,
+    // except that a request is always granted when nothing else is reserved.
+    class MemoryBudget {
+    public:
+        explicit MemoryBudget(size_t capacity) : _capacity(capacity) {}
+
+        void Acquire(size_t bytes) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _available.wait(lock, [&]() { return _capacity == 0 || _reserved == 0 || _reserved + bytes <= _capacity; });
+            _reserved += bytes;
+            _peak = std::max(_peak, _reserved);
+        }
+
+        void Release(size_t bytes) {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _reserved -= bytes;
+            }
+            _available.notify_all();
+        }
+
+        size_t Peak() {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _peak;
+        }
+
+    private:
+        size_t _capacity;
+        size_t _reserved = 0;
+        size_t _peak = 0;
+        std::mutex _mutex;
+        std::condition_variable _available;
+    };
+}
+
+const char* BatchStitcher::MethodName(StitchingMethod method) {
+    switch (method) {
+        case StitchingMethod::OpenCV: return "opencv";
+        case StitchingMethod::OpenCVVertical: return "opencv_vertical";
+        case StitchingMethod::Simple: return "simple";
+        case StitchingMethod::Auto: return "auto";
+    }
+    return "unknown";
+}
+
+bool BatchStitcher::ParseMethod(const std::string& name, StitchingMethod& method) {
+    for (StitchingMethod candidate : { StitchingMethod::OpenCV, StitchingMethod::OpenCVVertical, StitchingMethod::Simple,
+                                       StitchingMethod::Auto }) {
+        if (name == MethodName(candidate)) {
+            method = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<BatchJob> BatchStitcher::FindJobs(const std::string& inputRoot, const std::string& outputRoot) {
+    std::vector<fs::path> directories = { fs::path(inputRoot) };
+    std::error_code ec;
+    for (fs::recursive_directory_iterator it(inputRoot, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->is_directory(ec))
+            directories.push_back(it->path());
+    }
+
+    std::vector<BatchJob> jobs;
+    for (const fs::path& directory : directories) {
+        BatchJob job;
+        job.inputDirectory = directory.string();
+        job.name = directory.filename().string();
+        if (job.name.empty() || job.name == ".")
+            job.name = fs::absolute(directory, ec).filename().string();
+
+        CorpusSession session;
+        std::string error;
+        if (fs::exists(directory / "manifest.txt", ec) && StitchCorpus::LoadSession(job.inputDirectory, session, error)) {
+            job.name = session.name;
+            job.frameFiles = session.frameFiles;
+        } else {
+            for (fs::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec)) {
+                if (it->is_regular_file(ec) && IsImageFile(it->path()))
+                    job.frameFiles.push_back(it->path().filename().string());
+            }
+            std::sort(job.frameFiles.begin(), job.frameFiles.end());
+        }
+        if (job.frameFiles.empty())
+            continue;
+
+        job.outputPath = (fs::path(outputRoot) / (job.name + ".png")).string();
+        job.estimatedBytes = EstimateJobBytes(job);
+        jobs.push_back(job);
+    }
+
+    std::sort(jobs.begin(), jobs.end(), [](const BatchJob& a, const BatchJob& b) { return a.inputDirectory < b.inputDirectory; });
+    return jobs;
+}
+
+BatchJobResult BatchStitcher::RunJob(const BatchJob& job, const BatchOptions& options) {
+    TRACE_SPAN(TRACE_INFO, "BatchJob");
+    BatchJobResult result;
+    result.name = job.name;
+    result.outputPath = job.outputPath;
+    auto start = std::chrono::steady_clock::now();
+
+    // No callback: the reporter only carries the batch's token into each stage
+    ProgressReporter progress(nullptr, options.cancel);
+    try {
+        progress.ThrowIfCancelled();
+        CorpusSession session;
+        session.name = job.name;
+        session.directory = job.inputDirectory;
+        session.frameFiles = job.frameFiles;
+
+        std::vector<cv::Mat> frames;
+        if (!StitchCorpus::LoadFrames(session, frames, result.error))
+            return result;
+        result.frames = (int)frames.size();
+        for (const cv::Mat& frame : frames) {
+            result.megapixels += (double)frame.cols * frame.rows / 1e6;
+        }
+
+        // The GDI methods only stack frames, which plain placements reproduce headlessly
+        std::vector<FramePlacement> placements;
+        if (options.method == StitchingMethod::OpenCV)
+            placements = ImageStitcher::AlignFrames(frames, options.estimator, &progress);
+        else if (options.method == StitchingMethod::Auto)
+            placements = ImageStitcher::AlignFrames(frames, OverlapEstimator::Cascade, &progress);
+        else
+            placements = StackedPlacements(frames);
+        progress.ThrowIfCancelled();
+        cv::Mat canvas(ImageStitcher::CanvasSize(frames, placements), CV_8UC4, cv::Scalar(255, 255, 255, 255));
+        PruneStats pruneStats;
+        ImageStitcher::PruneFrames(frames, placements, &pruneStats);
+        auto composeStart = std::chrono::steady_clock::now();
+        ImageStitcher::ComposeFrames(frames, placements, canvas, &progress);
+        pruneStats.RecordComposeTime(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - composeStart).count());
+        result.framesPruned = pruneStats.framesPruned;
+        result.msSaved = pruneStats.msSaved;
+        frames.clear();
+        result.width = canvas.cols;
+        result.height = canvas.rows;
+
+        std::error_code ec;
+        fs::create_directories(fs::path(job.outputPath).parent_path(), ec);
+        PngEncodeOptions encodeOptions;
+        encodeOptions.threadCount = std::max(1, options.encodeThreads);
+        encodeOptions.progress = &progress;
+        if (!PngStripEncoder::EncodeToFile(canvas, job.outputPath, encodeOptions)) {
+            result.error = "failed to write " + job.outputPath;
+            return result;
+        }
+        result.succeeded = true;
+    } catch (const OperationCancelled&) {
+        result.cancelled = true;
+    } catch (const std::exception& e) {
+        result.error = std::string("stitching failed: ") + e.what();
+    }
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+BatchSummary BatchStitcher::Run(const std::vector<BatchJob>& jobs, const BatchOptions& options,
+                                const std::function<void(const BatchJobResult&)>& onJobDone) {
+    BatchSummary summary;
+    summary.jobs = (int)jobs.size();
+    summary.workers = options.workers > 0 ? options.workers : TaskExecutor::Shared().WorkerCount();
+    summary.workers = std::min({ summary.workers, TaskExecutor::Shared().WorkerCount(), std::max(1, summary.jobs) });
+
+    MemoryBudget budget(options.memoryCapBytes);
+    std::atomic<size_t> nextJob{ 0 };
+    std::mutex summaryMutex;
+    auto start = std::chrono::steady_clock::now();
+
+    // Each runner is a background task on the shared pool, so interactive work
+    // is dispatched ahead of the jobs. Jobs are taken in order; a runner waiting
+    // on the budget holds its job rather than skipping ahead, so large sessions
+    // are not starved.
+    auto runner = [&]() {
+        for (size_t index = nextJob.fetch_add(1); index < jobs.size(); index = nextJob.fetch_add(1)) {
+            const BatchJob& job = jobs[index];
+            BatchJobResult result;
+            if (options.cancel.IsCancelled()) {
+                // Skipped jobs never wait on the budget, so a cancelled batch drains at once
+                result.name = job.name;
+                result.outputPath = job.outputPath;
+                result.cancelled = true;
+            } else {
+                budget.Acquire(job.estimatedBytes);
+                result = RunJob(job, options);
+                budget.Release(job.estimatedBytes);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(summaryMutex);
+                if (result.succeeded) {
+                    summary.succeeded++;
+                    summary.frames += result.frames;
+                    summary.megapixels += result.megapixels;
+                }
+                if (result.cancelled)
+                    summary.cancelled++;
+                if (onJobDone)
+                    onJobDone(result);
+            }
+        }
+    };
+
+    std::vector<std::future<void>> runners;
+    for (int i = 0; i < summary.workers; i++) {
+        runners.push_back(TaskExecutor::Shared().Submit(TaskPriority::Background, runner));
+    }
+    for (std::future<void>& running : runners) {
+        running.get();
+    }
+
+    summary.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    summary.peakReservedBytes = budget.Peak();
+    return summary;
+}
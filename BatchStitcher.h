@@ -0,0 +1,79 @@
+#pragma once
+
+#include "ImageStitcher.h"
+#include "StitchingMethod.h"
+#include "StitchProgress.h"
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+// One session to re-stitch: a directory of frames and where to write the result
+struct BatchJob {
+	std::string name;
+	std::string inputDirectory;
+	std::vector<std::string> frameFiles;   // Relative to inputDirectory, in capture order
+	std::string outputPath;                // PNG
+	size_t estimatedBytes = 0;             // Peak memory the job is expected to need
+};
+
+struct BatchOptions {
+	StitchingMethod method = StitchingMethod::OpenCV;
+	OverlapEstimator estimator = OverlapEstimator::Auto;   // For StitchingMethod::OpenCV; Auto always cascades
+	int workers = 0;              // Jobs at once, at most the shared pool's size; 0 = the pool's size
+	size_t memoryCapBytes = 0;    // 0 = unlimited; otherwise jobs wait until their estimate fits
+	int encodeThreads = 1;        // PNG strip-encoder threads per job
+	CancellationToken cancel;     // Cancel() stops running jobs at their next check and skips the rest
+};
+
+struct BatchJobResult {
+	std::string name;
+	std::string outputPath;
+	bool succeeded = false;
+	bool cancelled = false;       // Stopped or skipped by options.cancel; error is empty
+	std::string error;
+	int frames = 0;
+	int width = 0;
+	int height = 0;
+	double megapixels = 0;        // Input frame pixels, in millions
+	double seconds = 0;           // Load + stitch + encode
+	int framesPruned = 0;         // Frames PruneFrames left out of composition
+	double msSaved = 0;           // Estimated composition time that saved
+};
+
+struct BatchSummary {
+	int jobs = 0;
+	int succeeded = 0;
+	int cancelled = 0;
+	int workers = 0;
+	long long frames = 0;
+	double megapixels = 0;
+	double wallSeconds = 0;
+	size_t peakReservedBytes = 0; // Highest sum of running jobs' estimates
+};
+
+// Re-stitches many captured sessions offline. Jobs run as background tasks on
+// the shared TaskExecutor, so interactive work goes first; each job reserves its estimated memory from a shared budget before
+// it starts, so a cap bounds the peak no matter how many workers there are.
+// A job larger than the whole cap still runs, but only when nothing else is.
+// Everything here is portable; on every platform the GDI stacking methods are
+// reproduced with plain stacked placements.
+class BatchStitcher {
+public:
+	// Sessions under inputRoot: every directory holding image files (or a
+	// corpus manifest.txt), including inputRoot itself. Frames are ordered by
+	// the manifest if there is one, otherwise by file name. Outputs go to
+	// outputRoot/<session name>.png.
+	static std::vector<BatchJob> FindJobs(const std::string& inputRoot, const std::string& outputRoot);
+
+	// Run every job; onJobDone is called from worker threads as jobs finish
+	static BatchSummary Run(const std::vector<BatchJob>& jobs, const BatchOptions& options,
+	                        const std::function<void(const BatchJobResult&)>& onJobDone = nullptr);
+
+	// Stitch one job synchronously
+	static BatchJobResult RunJob(const BatchJob& job, const BatchOptions& options);
+
+	// Lower-case method name used on the command line and in output
+	static const char* MethodName(StitchingMethod method);
+	static bool ParseMethod(const std::string& name, StitchingMethod& method);
+};
@@ -0,0 +1,335 @@
+#include "CaptureSession.h"
+#include "GlobalAlignment.h"
+#include "Trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+
+namespace {
+    // Consecutive unusable grabs after which continuous capture keeps what it
+    // has measured and searches every offset again. If the page jumped out of
+    // reach, capture starts over from the newest grab that is not smeared;
+    // the stitcher aligns that frame on its own.
+    const int kMaxUnusableGrabs = 4;
+}
+
+int64_t SteadyCaptureClock::NowMs() const {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+CaptureSession::CaptureSession(CaptureFrameSource& source, const CaptureClock& clock,
+                               const CaptureTiming& timing, CancellationToken cancel)
+    : _source(source), _clock(clock), _timing(timing), _cancel(std::move(cancel)) {}
+
+int64_t CaptureSession::Poll() {
+    int64_t now = _clock.NowMs();
+    if (!_started) {
+        _started = true;
+        _nextStepMs = now + _timing.settleMs;
+    }
+
+    // Zero-length waits run in the same call, so a caller never spins on Poll()
+    while (!Done() && now >= _nextStepMs) {
+        if (_cancel.IsCancelled())
+            break;
+        Step(now);
+    }
+    if (!Done() && _cancel.IsCancelled()) {
+        TRACE_MESSAGE(TRACE_INFO, "Capture session cancelled\n");
+        Finish(CaptureState::Cancelled);
+    }
+    return Done() ? -1 : _nextStepMs - now;
+}
+
+void CaptureSession::Step(int64_t now) {
+    switch (_state) {
+    case CaptureState::Settling: {
+        Frame frame = Capture(now);
+        bool captured = !frame.Empty();
+        if (captured) {
+            PerceptualHash hash = PerceptualHash::Compute(frame.Mat());
+            KeepFrame(std::move(frame), hash);
+        }
+
+        // The time limit counts from the first frame, not from when the overlay was hidden
+        _endMs = now + _timing.maxDurationMs;
+        if (captured && _timing.probeMs > 0) {
+            _state = CaptureState::Probing;
+            _nextStepMs = now + _timing.probeMs;
+            return;
+        }
+        StartScrolling(now);
+        break;
+    }
+
+    case CaptureState::Probing: {
+        // Nothing has scrolled yet, so whatever differs from the first frame changes on its own
+        Frame probe = Capture(now);
+        if (probe && !_frames.empty()) {
+            _mask = DynamicMask::FromProbe(_frames.front().Mat(), probe.Mat());
+            TRACE_MESSAGE(TRACE_VERBOSE, "Dynamic mask covers %.1f%% of the frame\n", _mask.DynamicFraction() * 100);
+            // Later frames are hashed without the dynamic regions; rehash the first one to match
+            _hashes.Clear();
+            _hashes.Add(PerceptualHash::Compute(_frames.front().Mat(), &_mask), 0);
+        }
+        StartScrolling(now);
+        break;
+    }
+
+    case CaptureState::SettlingCursor:
+        if (_timing.mode == CaptureMode::Continuous) {
+            StartStreaming(now);
+            break;
+        }
+        _source.InjectScroll();
+        _state = CaptureState::WaitingForScroll;
+        _nextStepMs = now + _timing.scrollAnimationMs;
+        break;
+
+    case CaptureState::WaitingForScroll: {
+        TRACE_SPAN(TRACE_DEBUG, "CaptureIteration");
+        Frame frame = Capture(now);
+        if (!frame) {
+            Finish(CaptureState::Finished);
+            return;
+        }
+
+        // Compare with the previous frame to see if scrolling is still happening
+        if (!_frames.empty() && AreFramesSimilar(_frames.back().Buffer(), frame.Buffer(), &_mask)) {
+            // The duplicate frame is released when frame goes out of scope
+            _similarFrames++;
+            TRACE_MESSAGE(TRACE_VERBOSE, "Similar frame detected\n");
+            BeginScroll(now);
+            break;
+        }
+
+        // Content seen earlier in the session (a bounce back, a re-render) is
+        // dropped too; the sampled comparison confirms the hash match. It is
+        // not a stopped scroll, so the similar-frame count is left alone.
+        PerceptualHash hash = PerceptualHash::Compute(frame.Mat(), &_mask);
+        int earlier = hash.Informative() ? _hashes.FindNear(hash) : -1;
+        if (earlier >= 0 && AreFramesSimilar(_frames[earlier].Buffer(), frame.Buffer(), &_mask)) {
+            _duplicateFrames++;
+            TRACE_MESSAGE(TRACE_VERBOSE, "Frame repeats captured frame %d - skipped\n", earlier);
+            TRACE_COUNTER(TRACE_DEBUG, "duplicate_frames", _duplicateFrames);
+        } else {
+            KeepFrame(std::move(frame), hash);
+            _similarFrames = 0;
+            TRACE_MESSAGE(TRACE_VERBOSE, "New content detected - continuing to scroll\n");
+            TRACE_COUNTER(TRACE_DEBUG, "captured_frames", _frames.size());
+        }
+        BeginScroll(now);
+        break;
+    }
+
+    case CaptureState::Streaming:
+        Stream(now);
+        break;
+
+    case CaptureState::Finished:
+    case CaptureState::Cancelled:
+        break;
+    }
+}
+
+void CaptureSession::StartScrolling(int64_t now) {
+    _scrollTargetFound = _source.FindScrollTarget();
+    if (!_scrollTargetFound) {
+        TRACE_MESSAGE(TRACE_INFO, "Could not find window to scroll\n");
+        Finish(CaptureState::Finished);
+        return;
+    }
+    BeginScroll(now);
+}
+
+void CaptureSession::StartStreaming(int64_t now) {
+    _state = CaptureState::Streaming;
+    _nextScrollMs = now;
+    _nextGrabMs = now;
+    _stillSinceMs = now;
+    if (!_frames.empty())
+        _lastSignatures = GlobalAlignment::RowSignatures(_frames.back().Mat(), &_mask);
+    Stream(now);
+}
+
+void CaptureSession::Stream(int64_t now) {
+    if (now >= _nextScrollMs) {
+        _source.InjectScroll();
+        _nextScrollMs = now + std::max(1, _timing.streamScrollIntervalMs);
+    }
+    if (now >= _nextGrabMs) {
+        _nextGrabMs = now + std::max(1, _timing.streamFrameIntervalMs);
+        if (!Grab(now))
+            return;
+    }
+
+    // The last grab is the bottom of the page, or as far as time allowed
+    if (now - _stillSinceMs >= _timing.streamStillMs || now >= _endMs) {
+        KeepPending();
+        Finish(CaptureState::Finished);
+        return;
+    }
+    _nextStepMs = std::min(_nextScrollMs, _nextGrabMs);
+}
+
+bool CaptureSession::Grab(int64_t now) {
+    TRACE_SPAN(TRACE_DEBUG, "StreamGrab");
+    Frame frame = Capture(now);
+    if (!frame) {
+        KeepPending();
+        Finish(CaptureState::Finished);
+        return false;
+    }
+    cv::Mat signatures = GlobalAlignment::RowSignatures(frame.Mat(), &_mask);
+    if (_lastSignatures.empty()) {
+        KeepStreamed(std::move(frame), signatures);
+        return true;
+    }
+
+    ScrollMotion motion = ScrollMotion::Measure(_lastSignatures, signatures, _lastStep);
+    if (motion.smeared || !motion.Measured()) {
+        // A still page matches its last grab, so an unusable grab means it is moving
+        _stillSinceMs = now;
+        if (motion.smeared) {
+            _smearedFrames++;
+            TRACE_COUNTER(TRACE_DEBUG, "smeared_frames", _smearedFrames);
+        }
+        if (++_unusableGrabs >= kMaxUnusableGrabs) {
+            // The reference stays the last usable grab, which is never smeared
+            KeepPending();
+            _lastStep = 0;
+            _displacement = 0;
+            _unusableGrabs = 0;
+            if (!motion.smeared) {
+                TRACE_MESSAGE(TRACE_INFO, "Continuous capture lost track of the page; starting over\n");
+                KeepStreamed(std::move(frame), signatures);
+            }
+        }
+        return true;
+    }
+    _unusableGrabs = 0;
+    if (motion.displacement != 0)
+        _stillSinceMs = now;
+    _lastStep = motion.displacement;
+    _lastSignatures = signatures;
+
+    // Kept frames share at least a quarter of their rows; past that, keep the grab before this one first
+    int height = frame.Height();
+    int target = _timing.streamStepRows > 0 ? _timing.streamStepRows : height / 2;
+    target = std::max(1, std::min(target, height * 3 / 4));
+    if (_displacement + motion.displacement > height * 3 / 4)
+        KeepPending();
+    _displacement += motion.displacement;
+    if (_displacement >= target) {
+        KeepStreamed(std::move(frame), signatures);
+    } else {
+        _pending = std::move(frame);
+    }
+    return true;
+}
+
+void CaptureSession::KeepStreamed(Frame frame, const cv::Mat& signatures) {
+    PerceptualHash hash = PerceptualHash::Compute(frame.Mat(), &_mask);
+    KeepFrame(std::move(frame), hash);
+    _pending = Frame();
+    _lastSignatures = signatures;
+    _displacement = 0;
+    _unusableGrabs = 0;
+    TRACE_COUNTER(TRACE_DEBUG, "captured_frames", _frames.size());
+}
+
+void CaptureSession::KeepPending() {
+    // A pending grab that has not moved from the last kept frame shows nothing new
+    if (!_pending || _displacement <= 0)
+        return;
+    Frame pending = std::move(_pending);
+    KeepStreamed(std::move(pending), _lastSignatures);
+}
+
+void CaptureSession::BeginScroll(int64_t now) {
+    if (now >= _endMs || _similarFrames >= _timing.maxSimilarFrames) {
+        Finish(CaptureState::Finished);
+        return;
+    }
+    _source.BeginScroll();
+    _state = CaptureState::SettlingCursor;
+    _nextStepMs = now + _timing.cursorSettleMs;
+}
+
+Frame CaptureSession::Capture(int64_t now) {
+    Frame frame = _source.CaptureFrame();
+    int sequence = _captures++;
+    if (frame) {
+        frame.Info().captureMs = now;
+        frame.Info().sequence = sequence;
+    }
+    return frame;
+}
+
+void CaptureSession::KeepFrame(Frame frame, const PerceptualHash& hash) {
+    _hashes.Add(hash, (int)_frames.size());
+    _frames.push_back(std::move(frame));
+}
+
+void CaptureSession::Finish(CaptureState state) {
+    _state = state;
+    _pending = Frame();
+    if (state == CaptureState::Cancelled) {
+        _frames.clear();
+        _hashes.Clear();
+    }
+}
+
+bool CaptureSession::AreFramesSimilar(const FrameBuffer& frame1, const FrameBuffer& frame2, const DynamicMask* mask) {
+    TRACE_SPAN(TRACE_DEBUG, "CompareFrames");
+    // If sizes differ significantly, they're not similar
+    if (frame1.Width() != frame2.Width() || std::abs(frame1.Height() - frame2.Height()) > 5)
+        return false;
+
+    // We'll sample a few rows of pixels for comparison, reading the
+    // frame memory directly
+    const int sampleRows = 5;
+    const int rowHeight = std::min(frame1.Height(), frame2.Height()) / (sampleRows + 1);
+    const int channels = frame1.Channels();
+
+    int matchingPixels = 0;
+    int totalPixels = 0;
+
+    // Sample pixels at specific rows
+    for (int row = 1; row <= sampleRows; row++) {
+        int y = row * rowHeight;
+        const uint8_t* row1 = frame1.Data() + y * frame1.Stride();
+        const uint8_t* row2 = frame2.Data() + y * frame2.Stride();
+
+        // Sample pixels across this row
+        for (int x = 0; x < frame1.Width(); x += 10) { // Sample every 10th pixel
+            // Carets, spinners and video change without scrolling; leave them out
+            if (mask && mask->IsDynamic(x, y))
+                continue;
+            
+            const uint8_t* p1 = row1 + x * channels;
+            const uint8_t* p2 = row2 + x * channels;
+
+            // Count as matching if colors are close enough
+            if (std::abs(p1[0] - p2[0]) < 10 &&
+                std::abs(p1[1] - p2[1]) < 10 &&
+                std::abs(p1[2] - p2[2]) < 10) {
+                matchingPixels++;
+            }
+
+            totalPixels++;
+        }
+    }
+
+    if (totalPixels == 0)
+        return false;
+
+    // Calculate similarity percentage
+    float similarityPercent = (float)matchingPixels / totalPixels * 100;
+
+    TRACE_COUNTER(TRACE_DEBUG, "frame_similarity_percent", similarityPercent);
+
+    // Consider similar if more than 95% of pixels match
+    return similarityPercent > 95;
+}
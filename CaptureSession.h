@@ -0,0 +1,162 @@
+#pragma once
+
+#include "DynamicMask.h"
+#include "Frame.h"
+#include "FrameHashIndex.h"
+#include "ScrollMotion.h"
+#include "StitchProgress.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Millisecond clock the capture session schedules against. Tests substitute a
+// virtual clock so a five-second session runs instantly.
+class CaptureClock {
+public:
+	virtual ~CaptureClock() = default;
+	virtual int64_t NowMs() const = 0;
+};
+
+// std::chrono::steady_clock in milliseconds
+class SteadyCaptureClock : public CaptureClock {
+public:
+	int64_t NowMs() const override;
+};
+
+// Where the session gets frames from and how it scrolls. The app captures the
+// screen and sends wheel input; tests hand out synthetic frames.
+class CaptureFrameSource {
+public:
+	virtual ~CaptureFrameSource() = default;
+
+	// Grab the capture area; an empty frame ends the session. The session
+	// stamps the frame's capture time and sequence number.
+	virtual Frame CaptureFrame() = 0;
+
+	// Find the window under the capture area; false if there is nothing to scroll
+	virtual bool FindScrollTarget() = 0;
+
+	// Send wheel messages to the target and move the cursor over it
+	virtual void BeginScroll() = 0;
+
+	// Inject the wheel input once the cursor has settled. In continuous
+	// capture this is called every streamScrollIntervalMs while frames are grabbed.
+	virtual void InjectScroll() = 0;
+};
+
+// How a capture session scrolls the page
+enum class CaptureMode {
+	StepAndWait,    // Scroll one notch, wait for the animation to finish, grab a frame
+	Continuous      // Scroll at a steady rate and grab as fast as possible, keeping a frame per target step
+};
+
+struct CaptureTiming {
+	int settleMs = 200;             // Overlay hidden -> first frame
+	int probeMs = 100;              // First frame -> unscrolled probe frame for the dynamic mask; 0 skips the probe
+	int cursorSettleMs = 50;        // Cursor moved -> wheel input injected
+	int scrollAnimationMs = 500;    // Wheel input -> next frame
+	int maxDurationMs = 5000;       // No new scroll starts after this long
+	int maxSimilarFrames = 3;       // Consecutive unchanged frames that end the session
+
+	CaptureMode mode = CaptureMode::StepAndWait;
+	int streamScrollIntervalMs = 100;   // Continuous: wheel input is injected this often
+	int streamFrameIntervalMs = 16;     // Continuous: shortest time between grabs
+	int streamStepRows = 0;             // Continuous: a grab this far below the last kept frame is kept; 0 = half a frame
+	int streamStillMs = 400;            // Continuous: the page has stopped once no grab has moved for this long
+};
+
+enum class CaptureState {
+	Settling,           // Waiting to take the first frame
+	Probing,            // Waiting to capture the unscrolled screen again and mask what changed
+	SettlingCursor,     // Scroll begun; waiting to inject the wheel input
+	WaitingForScroll,   // Waiting for the scroll animation before the next frame
+	Streaming,          // Scrolling continuously and grabbing frames as they come
+	Finished,
+	Cancelled
+};
+
+// The scroll-capture loop as a state machine. It never sleeps: Poll() runs
+// whatever is due and says how long until the next step, and the owner
+// arranges to call it again then (a thread-pool timer in the app, a virtual
+// clock in tests). Cancelling the token ends the session at the next Poll()
+// and releases the frames.
+// In continuous mode the page scrolls at a steady rate while frames are
+// grabbed every streamFrameIntervalMs. Each grab's displacement from the
+// previous usable grab is measured (ScrollMotion.h); smeared grabs are
+// dropped, and a grab is kept once the displacements since the last kept
+// frame add up to the target step. The session ends when the page stops
+// moving or at the time limit.
+class CaptureSession {
+public:
+	CaptureSession(CaptureFrameSource& source, const CaptureClock& clock,
+	               const CaptureTiming& timing = CaptureTiming(), CancellationToken cancel = CancellationToken());
+
+	// Run every step that is due. Returns milliseconds until the next step,
+	// or -1 once the session is finished or cancelled.
+	int64_t Poll();
+
+	CaptureState State() const { return _state; }
+	bool Done() const { return _state == CaptureState::Finished || _state == CaptureState::Cancelled; }
+
+	// Whether a window to scroll was found; without one only the first frame is taken
+	bool ScrollTargetFound() const { return _scrollTargetFound; }
+
+	// Distinct frames in capture order. Frames that matched their predecessor
+	// are dropped, and so are near-duplicates of any earlier frame (the page
+	// bounced back or re-rendered), found by perceptual hash.
+	const std::vector<Frame>& Frames() const { return _frames; }
+
+	// Frames dropped as near-duplicates of a frame before their predecessor
+	int DuplicateFrames() const { return _duplicateFrames; }
+
+	// Continuous capture: grabs dropped because parts of them moved by different amounts
+	int SmearedFrames() const { return _smearedFrames; }
+
+	// Regions that changed between the first frame and the probe; empty until the probe is taken
+	const DynamicMask& Mask() const { return _mask; }
+
+	// Sampled comparison used to tell when scrolling has stopped. Pixels in
+	// the mask's dynamic regions are not sampled.
+	static bool AreFramesSimilar(const FrameBuffer& frame1, const FrameBuffer& frame2, const DynamicMask* mask = nullptr);
+
+private:
+	void Step(int64_t now);
+	void StartScrolling(int64_t now);
+	void BeginScroll(int64_t now);
+	void StartStreaming(int64_t now);
+	void Stream(int64_t now);
+	bool Grab(int64_t now);
+	void KeepStreamed(Frame frame, const cv::Mat& signatures);
+	void KeepPending();
+	void Finish(CaptureState state);
+	Frame Capture(int64_t now);
+	void KeepFrame(Frame frame, const PerceptualHash& hash);
+
+	CaptureFrameSource& _source;
+	const CaptureClock& _clock;
+	CaptureTiming _timing;
+	CancellationToken _cancel;
+
+	CaptureState _state = CaptureState::Settling;
+	bool _started = false;
+	bool _scrollTargetFound = false;
+	int64_t _nextStepMs = 0;
+	int64_t _endMs = 0;
+	int _similarFrames = 0;
+	int _captures = 0;
+	std::vector<Frame> _frames;
+	DynamicMask _mask;
+	FrameHashIndex _hashes;
+	int _duplicateFrames = 0;
+
+	// Continuous capture
+	Frame _pending;                 // Newest usable grab not kept yet
+	cv::Mat _lastSignatures;        // Row signatures of the newest usable grab, kept or pending
+	int _displacement = 0;          // Rows from the last kept frame to the newest usable grab
+	int _lastStep = 0;              // Rows between the two newest usable grabs
+	int _unusableGrabs = 0;         // Consecutive grabs that were smeared or matched nothing
+	int64_t _nextScrollMs = 0;
+	int64_t _nextGrabMs = 0;
+	int64_t _stillSinceMs = 0;
+	int _smearedFrames = 0;
+};
@@ -0,0 +1,108 @@
+#include "ColumnDrift.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+    // Narrower frames have too few columns for a projection to mean anything
+    const int kMinWidth = 16;
+
+    // Shifts this close to the best are part of its dip, not rivals
+    const int kDipWidth = 2;
+}
+
+std::vector<float> ColumnDrift::Projection(const cv::Mat& image, const cv::Range& rows, int rowStep, const DynamicMask* mask) {
+    std::vector<float> projection(image.cols, std::numeric_limits<float>::quiet_NaN());
+    int start = std::max(0, rows.start);
+    int end = std::min(image.rows, rows.end);
+    rowStep = std::max(1, rowStep);
+    if (image.empty() || end <= start)
+        return projection;
+
+    std::vector<cv::Range> columns(1, cv::Range(0, image.cols));
+    if (mask && !mask->Empty() && mask->Width() == image.cols && !mask->StaticColumns().empty())
+        columns = mask->StaticColumns();
+
+    // Sum of B, G and R per column, one pass over each sampled row
+    std::vector<long long> sums(image.cols, 0);
+    int channels = image.channels();
+    int sampled = 0;
+    for (int y = start; y < end; y += rowStep) {
+        const uint8_t* row = image.ptr<uint8_t>(y);
+        for (const cv::Range& run : columns) {
+            for (int x = run.start; x < run.end; x++) {
+                const uint8_t* pixel = row + x * channels;
+                sums[x] += channels >= 3 ? pixel[0] + pixel[1] + pixel[2] : pixel[0] * 3;
+            }
+        }
+        sampled++;
+    }
+    for (const cv::Range& run : columns) {
+        for (int x = run.start; x < run.end; x++) {
+            projection[x] = (float)sums[x] / (3.0f * sampled);
+        }
+    }
+    return projection;
+}
+
+double ColumnDrift::MatchCost(const std::vector<float>& previousProjection, const std::vector<float>& currentProjection,
+                              int drift) {
+    // Compare how each projection changes from column to column, so neither
+    // the bands' brightness nor slow trends across the page count
+    int width = (int)std::min(previousProjection.size(), currentProjection.size());
+    int start = std::max(0, drift);
+    int end = std::min(width, width + drift) - 1;
+    double cost = 0;
+    int count = 0;
+    for (int x = start; x < end; x++) {
+        float previous = previousProjection[x - drift + 1] - previousProjection[x - drift];
+        float current = currentProjection[x + 1] - currentProjection[x];
+        if (std::isnan(previous) || std::isnan(current))
+            continue;
+        cost += std::abs(current - previous);
+        count++;
+    }
+    if (2 * count < width)
+        return -1;
+    return cost / count;
+}
+
+int ColumnDrift::Estimate(const cv::Mat& previousFrame, const cv::Mat& currentFrame, const DynamicMask* mask,
+                          const ColumnDriftOptions& options) {
+    if (previousFrame.cols != currentFrame.cols || previousFrame.type() != currentFrame.type() ||
+        previousFrame.cols < kMinWidth || previousFrame.rows < 2 || currentFrame.rows < 2)
+        return 0;
+
+    // Any overlap of at least half a frame contains these bands, and any smaller one lies within them
+    std::vector<float> previousProjection = Projection(previousFrame, cv::Range(previousFrame.rows / 2, previousFrame.rows),
+                                                       options.rowStep, mask);
+    std::vector<float> currentProjection = Projection(currentFrame, cv::Range(0, currentFrame.rows / 2),
+                                                      options.rowStep, mask);
+
+    double unshifted = MatchCost(previousProjection, currentProjection, 0);
+    if (unshifted < options.minCost)
+        return 0;
+
+    int maxDrift = std::min(options.maxDrift, currentFrame.cols / 4);
+    std::vector<double> costs(2 * maxDrift + 1);
+    int best = 0;
+    for (int drift = -maxDrift; drift <= maxDrift; drift++) {
+        double cost = drift == 0 ? unshifted : MatchCost(previousProjection, currentProjection, drift);
+        costs[drift + maxDrift] = cost;
+        if (cost >= 0 && cost < (best == 0 ? unshifted : costs[best + maxDrift]))
+            best = drift;
+    }
+    if (best == 0)
+        return 0;
+
+    // The true shift is a single sharp dip. Repeating columns (indented code,
+    // grids) can dip at a second shift too; then neither is trusted.
+    double bestCost = costs[best + maxDrift];
+    double runnerUp = unshifted;
+    for (int drift = -maxDrift; drift <= maxDrift; drift++) {
+        double cost = costs[drift + maxDrift];
+        if (std::abs(drift - best) > kDipWidth && cost >= 0)
+            runnerUp = std::min(runnerUp, cost);
+    }
+    return bestCost <= options.maxRelativeCost * unshifted && bestCost <= options.maxRelativeCost * runnerUp ? best : 0;
+}
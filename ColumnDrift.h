@@ -0,0 +1,43 @@
+#pragma once
+
+#include "DynamicMask.h"
+#include <vector>
+// OpenCV 4 headers
+#include <opencv2/core.hpp>
+
+struct ColumnDriftOptions {
+	int maxDrift = 32;              // Largest shift searched, in columns; at most a quarter of the frame width
+	int rowStep = 2;                // Every rowStep-th row of the band feeds the projection
+	double maxRelativeCost = 0.8;   // The best shift must cost at most this fraction of no shift and of any rival shift
+	double minCost = 0.5;           // Frames whose unshifted projections differ by less than this are aligned
+};
+
+// Estimates how far a frame's content moved sideways between two captures:
+// a scrollbar appearing, a page re-centering, a layout reflow. Each frame is
+// reduced to a column intensity projection (the mean gray level of every
+// column) over the band of rows the two frames most likely share: the bottom
+// half of the previous frame and the top half of the current one. The
+// projections' column-to-column changes are compared at every shift in
+// [-maxDrift, maxDrift]; each comparison reads each column once, so a pair
+// costs O(W) per shift on top of one pass over the band. Only a single,
+// clear best shift is reported; blank, smooth or repeating content gives 0.
+class ColumnDrift {
+public:
+	// Mean gray level of each column over every rowStep-th row in [rows.start, rows.end).
+	// Columns outside the mask's static columns are NaN.
+	static std::vector<float> Projection(const cv::Mat& image, const cv::Range& rows, int rowStep,
+	                                     const DynamicMask* mask = nullptr);
+
+	// Columns the content moved right from the previous frame to the current
+	// one (negative: left), so current column x shows what previous column
+	// x - drift showed. Returns 0 for frames of different widths, and unless
+	// a shift fits clearly better than none.
+	static int Estimate(const cv::Mat& previousFrame, const cv::Mat& currentFrame,
+	                    const DynamicMask* mask = nullptr, const ColumnDriftOptions& options = ColumnDriftOptions());
+
+	// Mean absolute difference between the projections' column-to-column
+	// changes where they overlap with the current one shifted by drift, or -1
+	// if they share fewer than half their columns
+	static double MatchCost(const std::vector<float>& previousProjection, const std::vector<float>& currentProjection,
+	                        int drift);
+};
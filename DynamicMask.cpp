@@ -0,0 +1,127 @@
+#include "DynamicMask.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+
+namespace {
+    // Whether any pixel of the cell differs by more than threshold in a colour channel.
+    // Stops at the first changed pixel.
+    bool CellChanged(const cv::Mat& first, const cv::Mat& second, cv::Rect cell, int threshold) {
+        int channels = std::min(first.channels(), 3);  // Alpha is ignored
+        int pixelBytes = first.channels();
+        for (int y = cell.y; y < cell.y + cell.height; y++) {
+            const uint8_t* a = first.ptr<uint8_t>(y) + cell.x * pixelBytes;
+            const uint8_t* b = second.ptr<uint8_t>(y) + cell.x * pixelBytes;
+            for (int x = 0; x < cell.width; x++, a += pixelBytes, b += pixelBytes) {
+                for (int c = 0; c < channels; c++) {
+                    if (std::abs((int)a[c] - (int)b[c]) > threshold)
+                        return true;
+                }
+            }
+        }
+        return false;
+    }
+}
+
+DynamicMask DynamicMask::FromProbe(const cv::Mat& first, const cv::Mat& second, const DynamicMaskOptions& options) {
+    TRACE_SPAN(TRACE_DEBUG, "DynamicMaskProbe");
+    DynamicMask mask;
+    if (first.empty() || first.rows != second.rows || first.cols != second.cols || first.type() != second.type() || first.depth() != CV_8U)
+        return mask;
+
+    int cellSize = std::max(1, options.cellSize);
+    mask._width = first.cols;
+    mask._height = first.rows;
+    mask._cellSize = cellSize;
+    mask._cellColumns = (first.cols + cellSize - 1) / cellSize;
+    mask._cellRows = (first.rows + cellSize - 1) / cellSize;
+
+    std::vector<uint8_t> changed(mask._cellColumns * mask._cellRows, 0);
+    for (int row = 0; row < mask._cellRows; row++) {
+        for (int column = 0; column < mask._cellColumns; column++) {
+            cv::Rect cell(column * cellSize, row * cellSize,
+                          std::min(cellSize, first.cols - column * cellSize), std::min(cellSize, first.rows - row * cellSize));
+            changed[row * mask._cellColumns + column] = CellChanged(first, second, cell, options.threshold) ? 1 : 0;
+        }
+    }
+
+    // Grow every changed cell by dilateCells in each direction
+    int grow = std::max(0, options.dilateCells);
+    mask._cells.assign(changed.size(), 0);
+    for (int row = 0; row < mask._cellRows; row++) {
+        for (int column = 0; column < mask._cellColumns; column++) {
+            if (!changed[row * mask._cellColumns + column])
+                continue;
+            for (int r = std::max(0, row - grow); r <= std::min(mask._cellRows - 1, row + grow); r++) {
+                for (int c = std::max(0, column - grow); c <= std::min(mask._cellColumns - 1, column + grow); c++) {
+                    mask._cells[r * mask._cellColumns + c] = 1;
+                }
+            }
+        }
+    }
+    mask._dynamicCells = (int)std::count(mask._cells.begin(), mask._cells.end(), 1);
+
+    if (mask.DynamicFraction() > options.maxDynamicFraction) {
+        TRACE_MESSAGE(TRACE_INFO, "DynamicMask: %.0f%% of the frame changed between probes; not masking\n",
+                      mask.DynamicFraction() * 100);
+        return DynamicMask();
+    }
+
+    // Columns whose every cell is static, as runs
+    int runStart = -1;
+    for (int column = 0; column <= mask._cellColumns; column++) {
+        bool isStatic = column < mask._cellColumns;
+        for (int row = 0; isStatic && row < mask._cellRows; row++) {
+            isStatic = !mask._cells[row * mask._cellColumns + column];
+        }
+        if (isStatic && runStart < 0) {
+            runStart = column;
+        } else if (!isStatic && runStart >= 0) {
+            mask._staticColumns.push_back(cv::Range(runStart * cellSize, std::min(first.cols, column * cellSize)));
+            runStart = -1;
+        }
+    }
+    TRACE_COUNTER(TRACE_DEBUG, "dynamic_cells", mask._dynamicCells);
+    return mask;
+}
+
+cv::Range DynamicMask::WidestStaticSpan() const {
+    cv::Range widest(0, 0);
+    for (const cv::Range& run : _staticColumns) {
+        if (run.size() > widest.size())
+            widest = run;
+    }
+    return widest;
+}
+
+DynamicMask DynamicMask::Columns(const cv::Range& columns) const {
+    int start = std::max(0, columns.start);
+    int end = std::min(_width, columns.end);
+    if (_dynamicCells == 0 || end <= start)
+        return DynamicMask();
+
+    DynamicMask mask = *this;
+    mask._originX = _originX + start;
+    mask._width = end - start;
+    int firstColumn = mask._originX / _cellSize;
+    int lastColumn = (mask._originX + mask._width - 1) / _cellSize;
+    mask._dynamicCells = 0;
+    for (int row = 0; row < _cellRows; row++) {
+        for (int column = firstColumn; column <= lastColumn; column++) {
+            mask._dynamicCells += _cells[row * _cellColumns + column];
+        }
+    }
+    mask._staticColumns.clear();
+    for (const cv::Range& run : _staticColumns) {
+        int runStart = std::max(run.start, start);
+        int runEnd = std::min(run.end, end);
+        if (runEnd > runStart)
+            mask._staticColumns.push_back(cv::Range(runStart - start, runEnd - start));
+    }
+    return mask;
+}
+
+double DynamicMask::DynamicFraction() const {
+    return _cells.empty() ? 0.0 : (double)_dynamicCells / (double)_cells.size();
+}
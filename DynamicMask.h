@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+// OpenCV 4 headers
+#include <opencv2/core.hpp>
+
+struct DynamicMaskOptions {
+	int cellSize = 16;                  // Pixels are masked in square cells of this size
+	int threshold = 24;                 // A channel difference above this marks a pixel as changed
+	int dilateCells = 1;                // Cells around a changed cell are masked too, for motion the probe missed
+	double maxDynamicFraction = 0.5;    // More of the frame changing than this means the page itself moved; no mask
+};
+
+// Screen regions whose content changes on its own: carets, spinners, ads,
+// video. Built once per session from two captures taken without scrolling,
+// and then left out of the end-of-scroll check and of alignment scoring.
+// The mask is in frame coordinates, so it covers content that stays put on
+// screen (players, toolbars, overlays) rather than content that scrolls.
+class DynamicMask {
+public:
+	// An empty mask; nothing is dynamic
+	DynamicMask() = default;
+
+	// Compare two captures of the same, unscrolled screen
+	static DynamicMask FromProbe(const cv::Mat& first, const cv::Mat& second,
+	                             const DynamicMaskOptions& options = DynamicMaskOptions());
+
+	bool Empty() const { return _dynamicCells == 0; }
+	int Width() const { return _width; }
+	int Height() const { return _height; }
+
+	// Whether the pixel lies in a dynamic cell; false outside the mask
+	bool IsDynamic(int x, int y) const {
+		if (_dynamicCells == 0 || x < 0 || y < 0 || x >= _width || y >= _height)
+			return false;
+		return _cells[(y / _cellSize) * _cellColumns + (x + _originX) / _cellSize] != 0;
+	}
+
+	// The mask of a run of columns, for frames narrowed to it. Column 0 of
+	// the result is columns.start of this mask.
+	DynamicMask Columns(const cv::Range& columns) const;
+
+	// Runs of columns that no dynamic cell touches, left to right
+	const std::vector<cv::Range>& StaticColumns() const { return _staticColumns; }
+
+	// The widest of StaticColumns(), or an empty range if there is none
+	cv::Range WidestStaticSpan() const;
+
+	// Fraction of the frame's cells that are dynamic
+	double DynamicFraction() const;
+
+private:
+	int _originX = 0;     // Column of the cell grid the mask starts at
+	int _width = 0;
+	int _height = 0;
+	int _cellSize = 1;
+	int _cellColumns = 0;
+	int _cellRows = 0;
+	int _dynamicCells = 0;
+	std::vector<uint8_t> _cells;
+	std::vector<cv::Range> _staticColumns;
+};
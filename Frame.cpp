@@ -0,0 +1,24 @@
+#include "Frame.h"
+#include "FramePool.h"
+#include <cstring>
+
+std::atomic<long long> Frame::s_deepCopies{ 0 };
+
+Frame Frame::Acquire(int width, int height, int channels, FramePool* pool) {
+    return Frame((pool ? *pool : FramePool::Shared()).Acquire(width, height, channels));
+}
+
+Frame Frame::Clone(FramePool* pool) const {
+    if (!_buffer)
+        return Frame();
+    Frame copy = Acquire(Width(), Height(), Channels(), pool);
+    if (!copy)
+        return copy;
+    // Same size and channels means the same padded stride
+    memcpy(copy._buffer->Data(), _buffer->Data(), _buffer->Stride() * Height());
+    copy._info = _info;
+    FrameBuffer::RecordFullCopy();
+    if (kCountsDeepCopies)
+        s_deepCopies.fetch_add(1, std::memory_order_relaxed);
+    return copy;
+}
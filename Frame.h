@@ -0,0 +1,85 @@
+#pragma once
+
+#include "FrameBuffer.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+// OpenCV 4 headers
+#include <opencv2/core.hpp>
+
+class FramePool;
+
+// Where and when a frame's pixels came from
+struct FrameInfo {
+	int64_t captureMs = -1;   // Capture clock time of the grab; -1 for frames that were not captured
+	int sequence = -1;        // Grab number within the session, counting frames that were dropped
+	int screenLeft = 0;       // Virtual-screen position of the frame's top-left pixel
+	int screenTop = 0;
+};
+
+// A captured frame or stitched canvas: a pixel buffer and its FrameInfo,
+// with a single owner. Frames move from the capture source into the session,
+// into stitching and out to the clipboard, and cannot be copied by
+// accident; Clone() is the only way to duplicate the pixels. A pooled
+// buffer goes back to its FramePool when the owning Frame is destroyed and
+// any other buffer is freed, so the DIB section behind it is never deleted
+// by hand.
+class Frame {
+public:
+	Frame() = default;
+
+	// Take sole ownership of a buffer, typically one just acquired from a pool
+	explicit Frame(std::shared_ptr<FrameBuffer> buffer, const FrameInfo& info = FrameInfo())
+		: _buffer(std::move(buffer)), _info(info) {}
+
+	Frame(Frame&&) noexcept = default;
+	Frame& operator=(Frame&&) noexcept = default;
+	Frame(const Frame&) = delete;
+	Frame& operator=(const Frame&) = delete;
+
+	// A frame from the pool (FramePool::Shared() by default). Contents are
+	// undefined. Empty if the allocation fails.
+	static Frame Acquire(int width, int height, int channels = 4, FramePool* pool = nullptr);
+
+	// A new frame from the pool with the same pixels and info. Empty if the
+	// allocation fails.
+	Frame Clone(FramePool* pool = nullptr) const;
+
+	bool Empty() const { return !_buffer; }
+	explicit operator bool() const { return _buffer != nullptr; }
+
+	int Width() const { return _buffer ? _buffer->Width() : 0; }
+	int Height() const { return _buffer ? _buffer->Height() : 0; }
+	int Channels() const { return _buffer ? _buffer->Channels() : 0; }
+
+	// The pixels. A frame must not be empty to be read.
+	const FrameBuffer& Buffer() const { return *_buffer; }
+
+	// cv::Mat header over the pixels, valid while this frame owns them; empty for an empty frame
+	cv::Mat Mat() const { return _buffer ? _buffer->Mat() : cv::Mat(); }
+
+#ifdef _WIN32
+	// The DIB section holding the pixels, owned by the frame
+	HBITMAP Bitmap() const { return _buffer ? _buffer->Bitmap() : NULL; }
+#endif
+
+	const FrameInfo& Info() const { return _info; }
+	FrameInfo& Info() { return _info; }
+
+	// Clone() calls since the process started. Counted in debug builds, and in
+	// release builds that define STITCH_COUNT_COPIES (the CMake test build);
+	// other builds report 0, and kCountsDeepCopies says which.
+#if defined(NDEBUG) && !defined(STITCH_COUNT_COPIES)
+	static constexpr bool kCountsDeepCopies = false;
+#else
+	static constexpr bool kCountsDeepCopies = true;
+#endif
+	static long long DeepCopyCount() { return s_deepCopies.load(std::memory_order_relaxed); }
+
+private:
+	std::shared_ptr<FrameBuffer> _buffer;   // The pool holds the only other reference
+	FrameInfo _info;
+
+	static std::atomic<long long> s_deepCopies;
+};
@@ -0,0 +1,66 @@
+#include "FrameBuffer.h"
+#include <cstdlib>
+
+std::atomic<long long> FrameBuffer::s_fullCopies{ 0 };
+std::atomic<long long> FrameBuffer::s_allocations{ 0 };
+
+std::shared_ptr<FrameBuffer> FrameBuffer::Create(int width, int height, int channels) {
+    if (width <= 0 || height <= 0 || (channels != 1 && channels != 3 && channels != 4))
+        return nullptr;
+
+    RecordAllocation();
+    std::shared_ptr<FrameBuffer> frame(new FrameBuffer());
+    frame->_width = width;
+    frame->_height = height;
+    frame->_channels = channels;
+    // DIB rows are aligned to 4 bytes; keep the same layout on every platform
+    frame->_stride = (((size_t)width * channels + 3) / 4) * 4;
+
+#ifdef _WIN32
+    // 8-bit gray DIBs need a palette; gray buffers are only used internally so
+    // they live on the heap like the non-Windows path
+    if (channels != 1) {
+        BITMAPINFO bi = { 0 };
+        bi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+        bi.bmiHeader.biWidth = width;
+        bi.bmiHeader.biHeight = -height;  // Negative for top-down
+        bi.bmiHeader.biPlanes = 1;
+        bi.bmiHeader.biBitCount = (WORD)(channels * 8);
+        bi.bmiHeader.biCompression = BI_RGB;
+
+        void* pBits = nullptr;
+        HDC hdcScreen = GetDC(NULL);
+        frame->_bitmap = CreateDIBSection(hdcScreen, &bi, DIB_RGB_COLORS, &pBits, NULL, 0);
+        ReleaseDC(NULL, hdcScreen);
+
+        if (!frame->_bitmap || !pBits)
+            return nullptr;
+        frame->_data = static_cast<uint8_t*>(pBits);
+        return frame;
+    }
+    frame->_data = static_cast<uint8_t*>(_aligned_malloc(frame->_stride * height, 64));
+#else
+    frame->_data = static_cast<uint8_t*>(std::aligned_alloc(64, ((frame->_stride * height + 63) / 64) * 64));
+#endif
+
+    if (!frame->_data)
+        return nullptr;
+    return frame;
+}
+
+FrameBuffer::~FrameBuffer() {
+#ifdef _WIN32
+    if (_bitmap) {
+        // The DIB section owns _data
+        DeleteObject(_bitmap);
+        return;
+    }
+    _aligned_free(_data);
+#else
+    std::free(_data);
+#endif
+}
+
+cv::Mat FrameBuffer::Mat() const {
+    return cv::Mat(_height, _width, CV_8UC(_channels), _data, _stride);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+#include <atomic>
+#include <cstdint>
+#include <memory>
+// OpenCV 4 headers
+#include <opencv2/core.hpp>
+
+// Pixel storage shared by capture, stitching and output.
+// On Windows the memory is a top-down DIB section, so GDI can BitBlt straight
+// into it and cv::Mat headers can wrap it without copying. Elsewhere it is a
+// plain aligned heap block with the same layout.
+class FrameBuffer {
+public:
+	// Allocate a width x height buffer with 8-bit channels (1, 3 or 4).
+	// Rows are padded to 4 bytes like a DIB. Returns nullptr on failure.
+	static std::shared_ptr<FrameBuffer> Create(int width, int height, int channels = 4);
+
+	~FrameBuffer();
+
+	FrameBuffer(const FrameBuffer&) = delete;
+	FrameBuffer& operator=(const FrameBuffer&) = delete;
+
+	int Width() const { return _width; }
+	int Height() const { return _height; }
+	int Channels() const { return _channels; }
+	size_t Stride() const { return _stride; }
+	uint8_t* Data() const { return _data; }
+
+	// cv::Mat header over the buffer's memory; no pixels are copied.
+	// The Mat is only valid while this FrameBuffer is alive.
+	cv::Mat Mat() const;
+
+#ifdef _WIN32
+	// The DIB section backing the buffer. Owned by the FrameBuffer.
+	HBITMAP Bitmap() const { return _bitmap; }
+#endif
+
+	// Full-image copy instrumentation. Every code path that copies a whole
+	// frame or canvas calls RecordFullCopy() so tests can assert a per-frame budget.
+	static void RecordFullCopy() { s_fullCopies.fetch_add(1, std::memory_order_relaxed); }
+	static long long FullCopyCount() { return s_fullCopies.load(std::memory_order_relaxed); }
+	static void ResetFullCopyCount() { s_fullCopies.store(0, std::memory_order_relaxed); }
+
+	// Buffer allocation instrumentation. Create() and ScratchArena growth call
+	// RecordAllocation(), so a benchmark can assert that a warmed-up FramePool
+	// and arena serve every frame without allocating.
+	static void RecordAllocation() { s_allocations.fetch_add(1, std::memory_order_relaxed); }
+	static long long AllocationCount() { return s_allocations.load(std::memory_order_relaxed); }
+
+private:
+	FrameBuffer() = default;
+
+	int _width = 0;
+	int _height = 0;
+	int _channels = 0;
+	size_t _stride = 0;
+	uint8_t* _data = nullptr;
+#ifdef _WIN32
+	HBITMAP _bitmap = NULL;
+#endif
+
+	static std::atomic<long long> s_fullCopies;
+	static std::atomic<long long> s_allocations;
+};
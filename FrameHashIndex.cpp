@@ -0,0 +1,106 @@
+#include "FrameHashIndex.h"
+#include <algorithm>
+#include <bit>
+
+namespace {
+    // Pixels and rows sampled per cell step; a 1080p frame reads about 130k pixels
+    const int kSampleStep = 4;
+
+    // Set bits an informative hash needs
+    const int kMinInformativeBits = 16;
+
+    // A cell must be this much brighter (sum of B, G and R) than the one below
+    // to set its bit, so rendering noise between equal cells flips nothing
+    const int kMinCellDifference = 6;
+}
+
+int PerceptualHash::Distance(const PerceptualHash& other) const {
+    int bits = 0;
+    for (int word = 0; word < kWords; word++) {
+        bits += std::popcount(words[word] ^ other.words[word]);
+    }
+    return bits;
+}
+
+bool PerceptualHash::Informative() const {
+    return Distance(PerceptualHash()) >= kMinInformativeBits;
+}
+
+PerceptualHash PerceptualHash::Compute(const cv::Mat& frame, const DynamicMask* mask) {
+    PerceptualHash hash;
+    if (frame.empty())
+        return hash;
+    if (mask && (mask->Empty() || mask->Width() != frame.cols || mask->Height() != frame.rows))
+        mask = nullptr;
+
+    long long sums[kRows][kColumns] = {};
+    int counts[kRows][kColumns] = {};
+    int channels = frame.channels();
+    for (int y = kSampleStep / 2; y < frame.rows; y += kSampleStep) {
+        int cellRow = std::min(kRows - 1, y * kRows / frame.rows);
+        const uint8_t* row = frame.ptr<uint8_t>(y);
+        for (int x = kSampleStep / 2; x < frame.cols; x += kSampleStep) {
+            if (mask && mask->IsDynamic(x, y))
+                continue;
+            const uint8_t* pixel = row + x * channels;
+            int cellColumn = std::min(kColumns - 1, x * kColumns / frame.cols);
+            sums[cellRow][cellColumn] += channels >= 3 ? pixel[0] + pixel[1] + pixel[2] : pixel[0] * 3;
+            counts[cellRow][cellColumn]++;
+        }
+    }
+
+    // A fully masked cell reads as 0 in every frame, so its bits stay stable
+    for (int r = 0; r + 1 < kRows; r++) {
+        for (int c = 0; c < kColumns; c++) {
+            long long upper = counts[r][c] ? sums[r][c] / counts[r][c] : 0;
+            long long lower = counts[r + 1][c] ? sums[r + 1][c] / counts[r + 1][c] : 0;
+            if (upper > lower + kMinCellDifference) {
+                int bit = r * kColumns + c;
+                hash.words[bit / 64] |= 1ULL << (bit % 64);
+            }
+        }
+    }
+    return hash;
+}
+
+FrameHashIndex::FrameHashIndex(int maxDistance)
+    : _maxDistance(std::max(0, std::min(maxDistance, PerceptualHash::kWords - 1))) {}
+
+void FrameHashIndex::Add(const PerceptualHash& hash, int id) {
+    int entry = (int)_hashes.size();
+    _hashes.push_back(hash);
+    _ids.push_back(id);
+    for (int word = 0; word < PerceptualHash::kWords; word++) {
+        _buckets[word][hash.words[word]].push_back(entry);
+    }
+}
+
+int FrameHashIndex::FindNear(const PerceptualHash& hash, int* distance) const {
+    int best = -1;
+    int bestDistance = _maxDistance + 1;
+    for (int word = 0; word < PerceptualHash::kWords; word++) {
+        auto found = _buckets[word].find(hash.words[word]);
+        if (found == _buckets[word].end())
+            continue;
+        for (int entry : found->second) {
+            int d = _hashes[entry].Distance(hash);
+            if (d < bestDistance) {
+                bestDistance = d;
+                best = entry;
+            }
+        }
+    }
+    if (best < 0)
+        return -1;
+    if (distance)
+        *distance = bestDistance;
+    return _ids[best];
+}
+
+void FrameHashIndex::Clear() {
+    _hashes.clear();
+    _ids.clear();
+    for (auto& buckets : _buckets) {
+        buckets.clear();
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "DynamicMask.h"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+// OpenCV 4 headers
+#include <opencv2/core.hpp>
+
+// 256-bit difference hash of a frame: the frame is reduced to a 16 x 17 grid
+// of mean gray levels, and each bit says whether a cell is clearly brighter
+// than the cell below it. Frames showing the same content hash within a few bits;
+// a scroll of even a few text lines moves most cells and flips many bits.
+struct PerceptualHash {
+	static const int kWords = 4;
+	static const int kColumns = 16;
+	static const int kRows = 17;    // Rows of cells; one bit per vertically adjacent pair
+
+	uint64_t words[kWords] = {};
+
+	// Bits that differ
+	int Distance(const PerceptualHash& other) const;
+
+	// Whether enough cells differ from their neighbours for a match to mean
+	// anything. Blank or flat frames all hash alike and are not deduplicated.
+	bool Informative() const;
+
+	// Hash a BGRA, BGR or gray frame from every fourth pixel of every fourth
+	// row. Pixels in the mask's dynamic cells are left out of the cell means.
+	static PerceptualHash Compute(const cv::Mat& frame, const DynamicMask* mask = nullptr);
+};
+
+// Perceptual hashes of every frame a session has kept, so a new frame can be
+// checked against the whole history rather than only its predecessor. Each
+// of a hash's four 64-bit words is a bucket key: two hashes within 3 bits of
+// each other share at least one word, so a lookup reads four buckets instead
+// of every stored hash.
+class FrameHashIndex {
+public:
+	// Hashes at most maxDistance bits apart are near-duplicates; at most 3
+	explicit FrameHashIndex(int maxDistance = 3);
+
+	void Add(const PerceptualHash& hash, int id);
+
+	// The id of the closest stored hash within maxDistance bits, or -1.
+	// Sets distance to its Hamming distance when one is found.
+	int FindNear(const PerceptualHash& hash, int* distance = nullptr) const;
+
+	void Clear();
+	size_t Size() const { return _hashes.size(); }
+
+private:
+	int _maxDistance;
+	std::vector<PerceptualHash> _hashes;
+	std::vector<int> _ids;
+	std::unordered_map<uint64_t, std::vector<int>> _buckets[PerceptualHash::kWords];   // Entry indices by word value
+};
@@ -0,0 +1,155 @@
+#include "FramePool.h"
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+namespace {
+    size_t BufferBytes(const FrameBuffer& buffer) {
+        return buffer.Stride() * (size_t)buffer.Height();
+    }
+
+    uint8_t* AllocateBlock(size_t size) {
+#ifdef _WIN32
+        return static_cast<uint8_t*>(_aligned_malloc(size, 64));
+#else
+        return static_cast<uint8_t*>(std::aligned_alloc(64, size));
+#endif
+    }
+
+    void FreeBlock(uint8_t* data) {
+#ifdef _WIN32
+        _aligned_free(data);
+#else
+        std::free(data);
+#endif
+    }
+}
+
+FramePool& FramePool::Shared() {
+    static FramePool pool;
+    return pool;
+}
+
+std::shared_ptr<FrameBuffer> FramePool::Acquire(int width, int height, int channels) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    SizeClass sizeClass(width, height, channels);
+    auto found = _classes.find(sizeClass);
+    if (found != _classes.end()) {
+        // Only the pool references an idle buffer, and only the pool hands out
+        // new references, so an idle buffer cannot become busy under the lock
+        for (const std::shared_ptr<FrameBuffer>& buffer : found->second) {
+            if (buffer.use_count() == 1) {
+                _acquired++;
+                _reused++;
+                return buffer;
+            }
+        }
+    }
+
+    std::shared_ptr<FrameBuffer> buffer = FrameBuffer::Create(width, height, channels);
+    if (!buffer)
+        return nullptr;
+    TrimLocked(_maxIdleBytes);
+    _classes[sizeClass].push_back(buffer);
+    _acquired++;
+    return buffer;
+}
+
+void FramePool::Trim(size_t maxIdleBytes) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    TrimLocked(maxIdleBytes);
+}
+
+FramePoolStats FramePool::Stats() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    FramePoolStats stats;
+    stats.acquired = _acquired;
+    stats.reused = _reused;
+    for (const auto& entry : _classes) {
+        for (const std::shared_ptr<FrameBuffer>& buffer : entry.second) {
+            stats.heldBytes += BufferBytes(*buffer);
+        }
+    }
+    stats.idleBytes = IdleBytesLocked();
+    return stats;
+}
+
+size_t FramePool::IdleBytesLocked() const {
+    size_t idle = 0;
+    for (const auto& entry : _classes) {
+        for (const std::shared_ptr<FrameBuffer>& buffer : entry.second) {
+            if (buffer.use_count() == 1)
+                idle += BufferBytes(*buffer);
+        }
+    }
+    return idle;
+}
+
+void FramePool::TrimLocked(size_t maxIdleBytes) {
+    size_t idle = IdleBytesLocked();
+    if (idle <= maxIdleBytes)
+        return;
+
+    // Large classes first: one canvas frees more than many frames
+    std::vector<SizeClass> order;
+    for (const auto& entry : _classes) {
+        order.push_back(entry.first);
+    }
+    std::sort(order.begin(), order.end(), [](const SizeClass& a, const SizeClass& b) {
+        return (long long)std::get<0>(a) * std::get<1>(a) * std::get<2>(a) > (long long)std::get<0>(b) * std::get<1>(b) * std::get<2>(b);
+    });
+    for (const SizeClass& sizeClass : order) {
+        std::vector<std::shared_ptr<FrameBuffer>>& buffers = _classes[sizeClass];
+        for (size_t i = buffers.size(); i-- > 0 && idle > maxIdleBytes;) {
+            if (buffers[i].use_count() == 1) {
+                idle -= BufferBytes(*buffers[i]);
+                buffers.erase(buffers.begin() + i);
+            }
+        }
+        if (buffers.empty())
+            _classes.erase(sizeClass);
+        if (idle <= maxIdleBytes)
+            break;
+    }
+}
+
+ScratchArena::~ScratchArena() {
+    for (const Block& block : _blocks) {
+        FreeBlock(block.data);
+    }
+}
+
+ScratchArena& ScratchArena::ForThread() {
+    thread_local ScratchArena arena;
+    return arena;
+}
+
+void* ScratchArena::Allocate(size_t bytes) {
+    // Whole cache lines keep every allocation 64-byte aligned
+    bytes = std::max<size_t>(64, ((bytes + 63) / 64) * 64);
+    for (; _block < _blocks.size(); _block++, _offset = 0) {
+        if (_offset + bytes <= _blocks[_block].size) {
+            void* memory = _blocks[_block].data + _offset;
+            _offset += bytes;
+            return memory;
+        }
+    }
+
+    size_t size = std::max(kBlockBytes, bytes);
+    uint8_t* data = AllocateBlock(size);
+    if (!data)
+        throw std::bad_alloc();
+    FrameBuffer::RecordAllocation();
+    _blocks.push_back(Block{ data, size });
+    _block = _blocks.size() - 1;
+    _offset = bytes;
+    return data;
+}
+
+size_t ScratchArena::Capacity() const {
+    size_t capacity = 0;
+    for (const Block& block : _blocks) {
+        capacity += block.size;
+    }
+    return capacity;
+}
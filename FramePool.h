@@ -0,0 +1,117 @@
+#pragma once
+
+#include "FrameBuffer.h"
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
+// OpenCV 4 headers
+#include <opencv2/core.hpp>
+
+struct FramePoolStats {
+	long long acquired = 0;    // Acquire() calls that returned a buffer
+	long long reused = 0;      // ... served by an idle buffer
+	size_t heldBytes = 0;      // Pixel bytes of every buffer the pool holds, idle or in use
+	size_t idleBytes = 0;      // ... of the idle ones
+};
+
+// Recycles FrameBuffers across captures, stitches and sessions.
+// Buffers are grouped in size classes by width, height and channels. A
+// buffer becomes idle when every reference outside the pool is dropped, and
+// the next Acquire of its class hands it out again without allocating, so a
+// capture loop that keeps its frame size allocates nothing after the first
+// session. Idle buffers beyond the cap are freed on the next allocation or Trim().
+class FramePool {
+public:
+	static constexpr size_t kDefaultMaxIdleBytes = (size_t)512 * 1024 * 1024;
+
+	explicit FramePool(size_t maxIdleBytes = kDefaultMaxIdleBytes) : _maxIdleBytes(maxIdleBytes) {}
+
+	FramePool(const FramePool&) = delete;
+	FramePool& operator=(const FramePool&) = delete;
+
+	// The pool capture and the tools share
+	static FramePool& Shared();
+
+	// An idle buffer of the class, or a new one from FrameBuffer::Create.
+	// Contents are undefined. Returns nullptr if the allocation fails.
+	std::shared_ptr<FrameBuffer> Acquire(int width, int height, int channels = 4);
+
+	// Free idle buffers, largest classes first, until at most maxIdleBytes are idle
+	void Trim(size_t maxIdleBytes);
+	void Trim() { Trim(_maxIdleBytes); }
+
+	FramePoolStats Stats() const;
+
+private:
+	typedef std::tuple<int, int, int> SizeClass;   // width, height, channels
+
+	size_t IdleBytesLocked() const;
+	void TrimLocked(size_t maxIdleBytes);
+
+	mutable std::mutex _mutex;
+	std::map<SizeClass, std::vector<std::shared_ptr<FrameBuffer>>> _classes;
+	size_t _maxIdleBytes;
+	long long _acquired = 0;
+	long long _reused = 0;
+};
+
+// Bump allocator for per-pair temporaries: gray copies, row hashes, match
+// results. Blocks are kept once allocated, so after the first few pairs a
+// thread's arena serves every request from memory it already has. A Scope
+// hands everything allocated inside it back when it ends.
+class ScratchArena {
+public:
+	static constexpr size_t kBlockBytes = (size_t)4 * 1024 * 1024;
+
+	ScratchArena() = default;
+	~ScratchArena();
+
+	ScratchArena(const ScratchArena&) = delete;
+	ScratchArena& operator=(const ScratchArena&) = delete;
+
+	// The calling thread's arena
+	static ScratchArena& ForThread();
+
+	// Rewinds the arena to where it stood when the scope began
+	class Scope {
+	public:
+		explicit Scope(ScratchArena& arena) : _arena(arena), _block(arena._block), _offset(arena._offset) {}
+		~Scope() { _arena._block = _block; _arena._offset = _offset; }
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+	private:
+		ScratchArena& _arena;
+		size_t _block;
+		size_t _offset;
+	};
+
+	// 64-byte aligned memory, valid until the enclosing Scope ends
+	void* Allocate(size_t bytes);
+
+	template <class T>
+	T* AllocateArray(size_t count) { return static_cast<T*>(Allocate(count * sizeof(T))); }
+
+	// A continuous cv::Mat over arena memory. OpenCV does not own or free it.
+	cv::Mat Mat(int rows, int cols, int type) {
+		return cv::Mat(rows, cols, type, Allocate((size_t)rows * cols * CV_ELEM_SIZE(type)));
+	}
+
+	// Bytes of every block the arena holds
+	size_t Capacity() const;
+
+private:
+	struct Block {
+		uint8_t* data;
+		size_t size;
+	};
+
+	std::vector<Block> _blocks;
+	size_t _block = 0;    // Block allocations come from
+	size_t _offset = 0;   // First free byte in that block
+};
@@ -0,0 +1,209 @@
+#include "GlobalAlignment.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+
+namespace {
+    const int kSignatureBins = 32;
+}
+
+cv::Mat GlobalAlignment::RowSignatures(const cv::Mat& image, const DynamicMask* mask) {
+    // Each bin covers an equal share of the columns used, as one or more runs
+    std::vector<cv::Range> columns(1, cv::Range(0, image.cols));
+    if (mask && !mask->Empty() && mask->Width() == image.cols && !mask->StaticColumns().empty())
+        columns = mask->StaticColumns();
+    int used = 0;
+    for (const cv::Range& run : columns) {
+        used += run.size();
+    }
+
+    int bins = std::max(1, std::min(kSignatureBins, used));
+    std::vector<std::vector<cv::Range>> binRuns(bins);
+    size_t run = 0;
+    int runOrdinal = 0;  // Columns used before columns[run]
+    for (int bin = 0; bin < bins; bin++) {
+        int end = (bin + 1) * used / bins;
+        for (int ordinal = bin * used / bins; ordinal < end;) {
+            while (ordinal >= runOrdinal + columns[run].size()) {
+                runOrdinal += columns[run].size();
+                run++;
+            }
+            int x = columns[run].start + (ordinal - runOrdinal);
+            int take = std::min(end - ordinal, columns[run].end - x);
+            binRuns[bin].push_back(cv::Range(x, x + take));
+            ordinal += take;
+        }
+    }
+
+    cv::Mat signatures(image.rows, bins, CV_8UC1);
+    int channels = image.channels();
+    for (int y = 0; y < image.rows; y++) {
+        const uint8_t* row = image.ptr<uint8_t>(y);
+        uint8_t* out = signatures.ptr<uint8_t>(y);
+        for (int bin = 0; bin < bins; bin++) {
+            long long sum = 0;
+            int count = 0;
+            for (const cv::Range& run : binRuns[bin]) {
+                for (int x = run.start; x < run.end; x++) {
+                    const uint8_t* pixel = row + x * channels;
+                    // Alpha, if any, is ignored
+                    sum += channels >= 3 ? (pixel[0] + pixel[1] + pixel[2]) / 3 : pixel[0];
+                }
+                count += run.size();
+            }
+            out[bin] = (uint8_t)(sum / std::max(1, count));
+        }
+    }
+    return signatures;
+}
+
+double GlobalAlignment::MatchCost(const cv::Mat& previousSignatures, const cv::Mat& currentSignatures, int overlap) {
+    int bins = std::min(previousSignatures.cols, currentSignatures.cols);
+    if (overlap <= 0 || bins <= 0 || overlap > previousSignatures.rows || overlap > currentSignatures.rows)
+        return 255.0;
+
+    long long sum = 0;
+    int previousStart = previousSignatures.rows - overlap;
+    for (int r = 0; r < overlap; r++) {
+        const uint8_t* a = previousSignatures.ptr<uint8_t>(previousStart + r);
+        const uint8_t* b = currentSignatures.ptr<uint8_t>(r);
+        for (int x = 0; x < bins; x++) {
+            sum += std::abs((int)a[x] - (int)b[x]);
+        }
+    }
+    return (double)sum / ((double)overlap * bins);
+}
+
+std::vector<OverlapCandidate> GlobalAlignment::FindCandidates(const cv::Mat& previousSignatures, const cv::Mat& currentSignatures,
+                                                              const GlobalAlignmentOptions& options,
+                                                              const SearchWindow& window, int* searched) {
+    TRACE_SPAN(TRACE_DEBUG, "FindCandidates");
+    std::vector<OverlapCandidate> candidates;
+    int bins = std::min(previousSignatures.cols, currentSignatures.cols);
+    int maxOverlap = std::min(previousSignatures.rows, currentSignatures.rows) - 1;
+    int minOverlap = std::max(1, options.minOverlap);
+    if (bins <= 0 || maxOverlap < minOverlap)
+        return candidates;
+
+    int low = minOverlap;
+    int high = maxOverlap;
+    if (window.Active()) {
+        low = std::max(minOverlap, window.Low());
+        high = std::min(maxOverlap, window.High());
+        if (low > high)
+            return FindCandidates(previousSignatures, currentSignatures, options, SearchWindow(), searched);
+    }
+
+    std::vector<double> costs(maxOverlap + 1, 0.0);
+    for (int overlap = low; overlap <= high; overlap++) {
+        costs[overlap] = MatchCost(previousSignatures, currentSignatures, overlap);
+    }
+    if (searched)
+        *searched += high - low + 1;
+
+    // Greedy non-maximum suppression: take the cheapest overlap, rule out its
+    // neighbourhood, repeat. Ties go to the larger overlap, the smaller step.
+    std::vector<bool> taken(maxOverlap + 1, false);
+    int spacing = std::max(1, options.candidateSpacing);
+    while ((int)candidates.size() < std::max(1, options.candidatesPerPair)) {
+        int best = -1;
+        for (int overlap = high; overlap >= low; overlap--) {
+            if (!taken[overlap] && (best < 0 || costs[overlap] < costs[best]))
+                best = overlap;
+        }
+        if (best < 0)
+            break;
+
+        OverlapCandidate candidate;
+        candidate.overlap = best;
+        candidate.cost = costs[best];
+        candidates.push_back(candidate);
+        for (int overlap = std::max(low, best - spacing + 1); overlap <= std::min(high, best + spacing - 1); overlap++) {
+            taken[overlap] = true;
+        }
+    }
+
+    // A poor best match, or one pressed against the window's edge, means the
+    // scroll step changed; widen to the full range
+    if (window.Active() && !candidates.empty()) {
+        int best = candidates[0].overlap;
+        bool onEdge = (best == low && low > minOverlap) || (best == high && high < maxOverlap);
+        if (candidates[0].cost > options.maxWindowCost || onEdge) {
+            TRACE_MESSAGE(TRACE_VERBOSE, "GlobalAlignment: window around %d missed (cost %.2f), searching every overlap\n",
+                          window.center, candidates[0].cost);
+            return FindCandidates(previousSignatures, currentSignatures, options, SearchWindow(), searched);
+        }
+    }
+    return candidates;
+}
+
+int GlobalAlignment::TypicalStep(const std::vector<std::vector<OverlapCandidate>>& candidates,
+                                 const std::vector<int>& previousHeights,
+                                 const GlobalAlignmentOptions& options) {
+    std::vector<int> steps;
+    for (size_t pair = 0; pair < candidates.size(); pair++) {
+        const std::vector<OverlapCandidate>& list = candidates[pair];
+        if (list.empty())
+            continue;
+        // Lists are ordered best first
+        if (list.size() == 1 || list[1].cost - list[0].cost >= options.ambiguityMargin)
+            steps.push_back(previousHeights[pair] - list[0].overlap);
+    }
+    if (steps.empty())
+        return -1;
+    std::nth_element(steps.begin(), steps.begin() + steps.size() / 2, steps.end());
+    return steps[steps.size() / 2];
+}
+
+std::vector<int> GlobalAlignment::ChooseCandidates(const std::vector<std::vector<OverlapCandidate>>& candidates,
+                                                   const std::vector<int>& previousHeights,
+                                                   const GlobalAlignmentOptions& options) {
+    TRACE_SPAN(TRACE_DEBUG, "ChooseCandidates");
+    size_t pairs = candidates.size();
+    std::vector<int> chosen(pairs, 0);
+    if (pairs == 0)
+        return chosen;
+
+    auto step = [&](size_t pair, int index) {
+        return previousHeights[pair] - candidates[pair][index].overlap;
+    };
+
+    // total[i][c]: cheapest cost of pairs 0..i with pair i on candidate c;
+    // from[i][c]: the candidate of pair i - 1 on that cheapest path
+    std::vector<std::vector<double>> total(pairs);
+    std::vector<std::vector<int>> from(pairs);
+    total[0].resize(candidates[0].size());
+    from[0].assign(candidates[0].size(), -1);
+    for (size_t c = 0; c < candidates[0].size(); c++) {
+        total[0][c] = candidates[0][c].cost;
+    }
+
+    for (size_t i = 1; i < pairs; i++) {
+        total[i].assign(candidates[i].size(), 0.0);
+        from[i].assign(candidates[i].size(), 0);
+        for (size_t c = 0; c < candidates[i].size(); c++) {
+            double best = 0;
+            int bestFrom = -1;
+            for (size_t p = 0; p < candidates[i - 1].size(); p++) {
+                double change = std::abs(step(i, (int)c) - step(i - 1, (int)p));
+                double cost = total[i - 1][p] + std::min(options.maxStepPenalty, options.stepWeight * change);
+                if (bestFrom < 0 || cost < best) {
+                    best = cost;
+                    bestFrom = (int)p;
+                }
+            }
+            total[i][c] = best + candidates[i][c].cost;
+            from[i][c] = bestFrom;
+        }
+    }
+
+    // Walk the cheapest path back from the last pair
+    int last = (int)(std::min_element(total[pairs - 1].begin(), total[pairs - 1].end()) - total[pairs - 1].begin());
+    chosen[pairs - 1] = last;
+    for (size_t i = pairs - 1; i > 0; i--) {
+        chosen[i - 1] = from[i][chosen[i]];
+    }
+    return chosen;
+}
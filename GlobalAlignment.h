@@ -0,0 +1,66 @@
+#pragma once
+
+#include "DynamicMask.h"
+#include "MotionPredictor.h"
+#include <vector>
+// OpenCV 4 headers
+#include <opencv2/core.hpp>
+
+// One possible overlap for a frame pair
+struct OverlapCandidate {
+	int overlap = 0;    // Rows shared with the previous frame
+	double cost = 0;    // Mean absolute row-signature difference over the overlap (0-255); lower is better
+};
+
+struct GlobalAlignmentOptions {
+	int candidatesPerPair = 5;      // K: best-scoring overlaps kept per pair
+	int candidateSpacing = 4;       // Rows between kept candidates, so they are distinct alternatives
+	int minOverlap = 8;             // Fewer shared rows than this are too easy to match by accident
+	double ambiguityMargin = 1.0;   // A pair whose best two candidates are closer than this is ambiguous
+	double stepWeight = 0.05;       // Cost per row the scroll step differs from the previous pair's
+	double maxStepPenalty = 2.0;    // Cap on that cost, so a real change of scroll speed can still win
+	double maxWindowCost = 2.0;     // A windowed search whose best candidate costs more is redone over every overlap
+};
+
+// Resolves frame offsets jointly instead of pair by pair. Each pair gets a
+// short list of candidate overlaps scored by comparing row signatures, plus
+// the overlap the session's typical scroll step predicts; a Viterbi pass then
+// picks one candidate per pair, minimizing the match costs plus a penalty for
+// every change in scroll step. Repetitive or blank seams, which score several
+// overlaps almost equally, take the overlap that keeps the step closest to
+// their neighbours'.
+// Everything here is portable and touches each frame's pixels once.
+class GlobalAlignment {
+public:
+	// Per-row signature: mean gray level of each of up to 32 equal column bins.
+	// Returns a CV_8UC1 matrix with one row per image row. With a mask the
+	// bins cover only its static columns; dynamic columns are never read.
+	static cv::Mat RowSignatures(const cv::Mat& image, const DynamicMask* mask = nullptr);
+
+	// Mean absolute difference between the previous frame's bottom `overlap`
+	// rows and the current frame's top `overlap` rows
+	static double MatchCost(const cv::Mat& previousSignatures, const cv::Mat& currentSignatures, int overlap);
+
+	// The best candidatesPerPair overlaps between two frames' signatures,
+	// lowest cost first, at least candidateSpacing rows apart. An active window
+	// limits the search to its overlaps unless the best of them costs more than
+	// maxWindowCost or sits on the window's edge; then every overlap is searched.
+	// `searched`, if given, is increased by the number of overlaps scored.
+	static std::vector<OverlapCandidate> FindCandidates(const cv::Mat& previousSignatures, const cv::Mat& currentSignatures,
+	                                                    const GlobalAlignmentOptions& options = GlobalAlignmentOptions(),
+	                                                    const SearchWindow& window = SearchWindow(), int* searched = nullptr);
+
+	// The median scroll step of pairs with an unambiguous best candidate, or -1
+	// if there are none. Arguments are as for ChooseCandidates.
+	static int TypicalStep(const std::vector<std::vector<OverlapCandidate>>& candidates,
+	                       const std::vector<int>& previousHeights,
+	                       const GlobalAlignmentOptions& options = GlobalAlignmentOptions());
+
+	// Pick one candidate per pair. candidates[i] lists the options for pair i
+	// (every list must be non-empty) and previousHeights[i] is the height of
+	// that pair's first frame, so the scroll step is previousHeights[i] - overlap.
+	// Returns the chosen index into each list.
+	static std::vector<int> ChooseCandidates(const std::vector<std::vector<OverlapCandidate>>& candidates,
+	                                         const std::vector<int>& previousHeights,
+	                                         const GlobalAlignmentOptions& options = GlobalAlignmentOptions());
+};
@@ -1,14 +1,391 @@
 #include "ImageStitcher.h"
+#include "ColumnDrift.h"
+#include "FrameBuffer.h"
+#include "FramePool.h"
+#include "GlobalAlignment.h"
+#include "PixelKernels.h"
+#include "RowHashIndex.h"
+#include "RowTiles.h"
+#include "SideColumns.h"
+#include "StitchProgress.h"
+#include "TaskExecutor.h"
+#include "Trace.h"
+#ifdef _WIN32
 #include <Windows.h>
+#endif
 #include <algorithm> // For std::min
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstring>
 
 // OpenCV 4 headers
 #include <opencv2/core.hpp>
 #include <opencv2/imgproc.hpp>
 #include <opencv2/features2d.hpp>
 #include <opencv2/calib3d.hpp>
-#include <opencv2/xfeatures2d.hpp>
 
+namespace {
+    // Canvas height that never limits EstimateOverlap
+    const int kUnboundedRows = INT_MAX / 4;
+    
+    // How much better than the pairwise placement (mean signature difference)
+    // an index match must fit the canvas to replace it
+    const double kIndexCostMargin = 1.0;
+    
+    // The cascade's exact tier needs at least this many matching rows, and
+    // its signature tier a best overlap this close (mean signature
+    // difference) with the runner-up at least ambiguityMargin behind or
+    // failing pixel verification
+    const int kMinExactOverlap = 16;
+    const double kMaxSignatureCost = 1.0;
+    
+    // Pixel verification accepts an overlap whose bytes differ by at most
+    // this much on average. Every kVerifySampleStep-th row is compared
+    // first; the full overlap only when the sample lands near the tolerance.
+    const double kMaxOverlapDifference = 3.0;
+    const int kVerifySampleStep = 4;
+    
+    // Rows kept around a predicted feature band; ORB ignores keypoints within 31 pixels of an edge
+    const int kFeatureBandMargin = 32;
+    
+    // Narrower static spans leave feature and template matching too little to go on; they use the whole frame
+    const int kMinStaticSpan = 64;
+
+    // EstimateOverlap uses the composed height only to cap its comparison section
+    // (composedRows / 3) and the overlap it reports (composedRows / 2). Returns
+    // whether either cap is tighter than the one the frame itself imposes.
+    bool CanvasHeightLimitsEstimate(int composedRows, const cv::Mat& currentImage) {
+        int section = std::min(100, currentImage.rows / 3);
+        return composedRows / 3 < section || composedRows / 2 < currentImage.rows - 10;
+    }
+
+    // Compose frames PruneFrames has filtered and log what pruning saved
+    void ComposePruned(const std::vector<cv::Mat>& images, const std::vector<FramePlacement>& placements, cv::Mat& canvas,
+                       ProgressReporter* progress, PruneStats& pruneStats) {
+        auto start = std::chrono::steady_clock::now();
+        ImageStitcher::ComposeFrames(images, placements, canvas, progress);
+        pruneStats.RecordComposeTime(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        TRACE_MESSAGE(TRACE_INFO, "ImageStitcher: pruned %d redundant frames, saving about %.1f ms of composition\n",
+                      pruneStats.framesPruned, pruneStats.msSaved);
+    }
+
+    // The columns both frames show when the current frame's content moved
+    // `drift` columns right of the previous frame's. Views, not copies.
+    void SharedColumns(const cv::Mat& previousImage, const cv::Mat& currentImage, int drift,
+                       cv::Mat& previousShared, cv::Mat& currentShared) {
+        int start = std::max(0, drift);
+        int end = std::min(currentImage.cols, previousImage.cols + drift);
+        if (drift == 0 || end <= start) {
+            previousShared = previousImage;
+            currentShared = currentImage;
+            return;
+        }
+        previousShared = previousImage(cv::Rect(start - drift, 0, end - start, previousImage.rows));
+        currentShared = currentImage(cv::Rect(start, 0, end - start, currentImage.rows));
+    }
+
+    // Copy the frame's side columns to the canvas edges, its top row at y
+    void ComposeSideColumns(const cv::Mat& frame, const SideColumns& sides, int y, cv::Mat& canvas) {
+        int rows = std::min(frame.rows, canvas.rows - y);
+        if (rows <= 0)
+            return;
+        if (sides.left > 0) {
+            cv::Mat left = canvas(cv::Rect(0, y, sides.left, rows));
+            frame(cv::Rect(0, 0, sides.left, rows)).copyTo(left);
+        }
+        if (sides.right > 0) {
+            cv::Mat right = canvas(cv::Rect(canvas.cols - sides.right, y, sides.right, rows));
+            frame(cv::Rect(frame.cols - sides.right, 0, sides.right, rows)).copyTo(right);
+        }
+    }
+
+    // Gray copy of a BGRA frame or ROI for feature detection, in the thread's scratch arena
+    cv::Mat ToGray(const cv::Mat& image) {
+        cv::Mat gray = ScratchArena::ForThread().Mat(image.rows, image.cols, CV_8UC1);
+        RowTiles::ConvertRows<PixelFormat::BGRA, PixelFormat::Gray>(image.data, image.step, gray.data, gray.step,
+                                                                    image.cols, image.rows);
+        return gray;
+    }
+    
+    // CRC-32C of each row's pixels, in the thread's scratch arena
+    uint32_t* RowHashes(const cv::Mat& image) {
+        uint32_t* hashes = ScratchArena::ForThread().AllocateArray<uint32_t>(image.rows);
+        size_t rowBytes = (size_t)image.cols * image.elemSize();
+        for (int y = 0; y < image.rows; y++) {
+            hashes[y] = PixelKernels::RowHash(image.ptr<uint8_t>(y), rowBytes);
+        }
+        return hashes;
+    }
+    
+    // The overlap at which the previous frame's bottom rows equal the current
+    // frame's top rows byte for byte, or 0 if no overlap or more than one does.
+    // An overlap of identical rows (blank space) proves nothing and is skipped.
+    int FindExactOverlap(const cv::Mat& previousImage, const cv::Mat& currentImage, int& searched) {
+        if (previousImage.cols != currentImage.cols || previousImage.type() != currentImage.type())
+            return 0;
+        const uint32_t* previousHashes = RowHashes(previousImage);
+        const uint32_t* currentHashes = RowHashes(currentImage);
+        
+        int maxOverlap = std::min(previousImage.rows, currentImage.rows) - 1;
+        int found = 0;
+        for (int overlap = kMinExactOverlap; overlap <= maxOverlap; overlap++) {
+            searched++;
+            const uint32_t* previousRows = &previousHashes[previousImage.rows - overlap];
+            if (currentHashes[overlap - 1] != previousRows[overlap - 1] ||
+                !std::equal(currentHashes, currentHashes + overlap, previousRows))
+                continue;
+            bool varied = std::any_of(currentHashes, currentHashes + overlap,
+                                      [&](uint32_t hash) { return hash != currentHashes[0]; });
+            if (!varied)
+                continue;
+            if (found)
+                return 0;
+            found = overlap;
+        }
+        
+        // Rule out a hash collision before trusting the match
+        size_t rowBytes = (size_t)currentImage.cols * currentImage.elemSize();
+        for (int y = 0; y < found; y++) {
+            if (memcmp(currentImage.ptr(y), previousImage.ptr(previousImage.rows - found + y), rowBytes) != 0)
+                return 0;
+        }
+        return found;
+    }
+    
+    // Mean absolute byte difference between the previous frame's bottom
+    // `overlap` rows and the current frame's top `overlap` rows, over every
+    // rowStep-th row and the given column runs
+    double OverlapDifference(const cv::Mat& previousImage, const cv::Mat& currentImage, int overlap,
+                             const std::vector<cv::Range>& columns, int rowStep) {
+        size_t channels = currentImage.elemSize();
+        long long sum = 0;
+        long long count = 0;
+        for (int y = (overlap - 1) % rowStep; y < overlap; y += rowStep) {
+            const uint8_t* previousRow = previousImage.ptr<uint8_t>(previousImage.rows - overlap + y);
+            const uint8_t* currentRow = currentImage.ptr<uint8_t>(y);
+            for (const cv::Range& run : columns) {
+                size_t first = run.start * channels;
+                size_t last = run.end * channels;
+                sum += (long long)PixelKernels::AbsDiffSum(previousRow + first, currentRow + first, last - first);
+                count += (long long)(last - first);
+            }
+        }
+        return count > 0 ? (double)sum / (double)count : 0.0;
+    }
+    
+    // Whether the frames agree pixel for pixel, within kMaxOverlapDifference,
+    // at the proposed overlap
+    bool VerifyOverlap(const cv::Mat& previousImage, const cv::Mat& currentImage, int overlap,
+                       const std::vector<cv::Range>& columns) {
+        TRACE_SPAN(TRACE_DEBUG, "VerifyOverlap");
+        if (overlap <= 0 || overlap > std::min(previousImage.rows, currentImage.rows) ||
+            previousImage.cols != currentImage.cols || previousImage.type() != currentImage.type())
+            return false;
+        double sampled = OverlapDifference(previousImage, currentImage, overlap, columns, kVerifySampleStep);
+        if (sampled < kMaxOverlapDifference / 2)
+            return true;
+        if (sampled > kMaxOverlapDifference * 2)
+            return false;
+        return OverlapDifference(previousImage, currentImage, overlap, columns, 1) <= kMaxOverlapDifference;
+    }
+    
+    // ORB + RANSAC displacement of the previous frame's bottom section within
+    // rows `band` of the current frame. Sets the overlap and its source and
+    // returns whether one was found; a Conservative source means the matches
+    // looked like repetitive content.
+    bool MatchFeatures(const cv::Mat& previousSection, const cv::Mat& currentImage, cv::Range band,
+                       int sectionHeight, int composedRows, int& bestOverlap, OverlapSource& source) {
+        bool foundGoodAlignment = false;
+        bestOverlap = 0;
+        source = OverlapSource::None;
+        
+        try {
+            // Convert to grayscale for feature detection
+            cv::Mat prevGray = ToGray(previousSection);
+            cv::Mat currGray = ToGray(currentImage(cv::Range(band.start, band.end), cv::Range::all()));
+            
+            // Use ORB detector (SURF is not available in this OpenCV build)
+            cv::Ptr<cv::Feature2D> detector = cv::ORB::create(1500);
+            TRACE_MESSAGE(TRACE_VERBOSE, "ImageStitcher: Using ORB detector\n");
+            
+            std::vector<cv::KeyPoint> keypointsPrev, keypointsCurr;
+            cv::Mat descriptorsPrev, descriptorsCurr;
+            
+            detector->detectAndCompute(prevGray, cv::noArray(), keypointsPrev, descriptorsPrev);
+            detector->detectAndCompute(currGray, cv::noArray(), keypointsCurr, descriptorsCurr);
+            for (cv::KeyPoint& keypoint : keypointsCurr) {
+                keypoint.pt.y += (float)band.start;
+            }
+            
+            TRACE_MESSAGE(TRACE_VERBOSE, "ImageStitcher: Found %d keypoints in prev section, %d in current image\n", 
+                     (int)keypointsPrev.size(), (int)keypointsCurr.size());
+            
+            if (keypointsPrev.size() > 4 && keypointsCurr.size() > 4 && 
+                !descriptorsPrev.empty() && !descriptorsCurr.empty()) {
+                
+                // Match features using Hamming distance for ORB
+                std::vector<cv::DMatch> matches;
+                cv::Ptr<cv::DescriptorMatcher> matcher = cv::DescriptorMatcher::create(cv::DescriptorMatcher::BRUTEFORCE_HAMMING);
+                
+                try {
+                    matcher->match(descriptorsCurr, descriptorsPrev, matches);
+                    
+                    if (!matches.empty()) {
+                        // Filter good matches for ORB
+                        double maxDist = 0, minDist = 100;
+                        for (const auto& match : matches) {
+                            double dist = match.distance;
+                            if (dist < minDist) minDist = dist;
+                            if (dist > maxDist) maxDist = dist;
+                        }
+                        
+                        std::vector<cv::DMatch> goodMatches;
+                        double threshold = std::max(minDist * 2.5, 40.0); // More lenient threshold for ORB
+                        
+                        for (const auto& match : matches) {
+                            if (match.distance <= threshold) {
+                                goodMatches.push_back(match);
+                            }
+                        }
+                        
+                        TRACE_MESSAGE(TRACE_VERBOSE, "ImageStitcher: Found %d good matches out of %d total\n", 
+                                 (int)goodMatches.size(), (int)matches.size());
+                        
+                        if (goodMatches.size() >= 4) {
+                            // First, perform geometric consistency check using RANSAC
+                            std::vector<cv::Point2f> pointsCurr, pointsPrev;
+                            for (const auto& match : goodMatches) {
+                                pointsCurr.push_back(keypointsCurr[match.queryIdx].pt);
+                                pointsPrev.push_back(keypointsPrev[match.trainIdx].pt);
+                            }
+                            
+                            // Use RANSAC to find geometrically consistent matches
+                            std::vector<uchar> inlierMask;
+                            cv::Mat homography;
+                            try {
+                                homography = cv::findHomography(pointsCurr, pointsPrev, cv::RANSAC, 3.0, inlierMask);
+                                
+                                // Count inliers
+                                int inlierCount = 0;
+                                for (int i = 0; i < inlierMask.size(); i++) {
+                                    if (inlierMask[i]) inlierCount++;
+                                }
+                                
+                                TRACE_MESSAGE(TRACE_VERBOSE, "ImageStitcher: RANSAC found %d inliers out of %d matches\n", 
+                                         inlierCount, (int)goodMatches.size());
+                                
+                                // Only proceed if we have enough geometrically consistent matches
+                                if (inlierCount >= 6) {
+                                    // Calculate displacement using only inliers
+                                    std::vector<double> yDisplacements;
+                                    
+                                    for (int i = 0; i < goodMatches.size(); i++) {
+                                        if (inlierMask[i]) {
+                                            cv::Point2f ptCurr = keypointsCurr[goodMatches[i].queryIdx].pt;
+                                            cv::Point2f ptPrev = keypointsPrev[goodMatches[i].trainIdx].pt;
+                                            
+                                            double yDisplacement = ptPrev.y - ptCurr.y;
+                                            
+                                            // For vertical scrolling, we expect mainly vertical displacement
+                                            if (yDisplacement > -sectionHeight * 2 && yDisplacement < sectionHeight * 2) {
+                                                yDisplacements.push_back(yDisplacement);
+                                            }
+                                        }
+                                    }
+                                    
+                                    if (yDisplacements.size() >= 3) {
+                                        // Use median displacement for robustness
+                                        std::sort(yDisplacements.begin(), yDisplacements.end());
+                                        double medianYDisplacement = yDisplacements[yDisplacements.size() / 2];
+                                        
+                                        // Check for suspiciously consistent displacements that might indicate repetitive content
+                                        // Count how many displacements are very close to the median
+                                        int consistentCount = 0;
+                                        for (double disp : yDisplacements) {
+                                            if (std::abs(disp - medianYDisplacement) < 5.0) {
+                                                consistentCount++;
+                                            }
+                                        }
+                                        
+                                        // If too many matches have identical displacement, it's likely repetitive content
+                                        bool likelyRepetitiveContent = (consistentCount > yDisplacements.size() * 0.7);
+                                        
+                                        // Convert displacement to overlap amount
+                                        // The displacement tells us how much the images have shifted
+                                        // A negative displacement means the new image shows content further down
+                                        bestOverlap = (int)(sectionHeight + medianYDisplacement);
+                                        
+                                        // Allow more flexible overlap range - don't limit to sectionHeight
+                                        int maxPossibleOverlap = std::min(currentImage.rows - 10, composedRows / 2);
+                                        bestOverlap = std::max(5, std::min(bestOverlap, maxPossibleOverlap));
+                                        
+                                        // If we suspect repetitive content or get suspicious results, be more conservative
+                                        if (likelyRepetitiveContent || std::abs(medianYDisplacement) > sectionHeight * 1.5) {
+                                            TRACE_MESSAGE(TRACE_VERBOSE, "ImageStitcher: Detected likely repetitive content or suspicious displacement (%.2f), using conservative overlap\n", medianYDisplacement);
+                                            
+                                            bestOverlap = std::min(sectionHeight / 3, 40); // Much smaller conservative overlap
+                                            foundGoodAlignment = true; // Still use blending but with conservative overlap
+                                            source = OverlapSource::Conservative;
+                                        } else {
+                                            foundGoodAlignment = true;
+                                            source = OverlapSource::Features;
+                                        }
+                                        
+                                        TRACE_MESSAGE(TRACE_VERBOSE, "ImageStitcher: Calculated optimal overlap: %d pixels (from median displacement: %.2f, section height: %d, max possible: %d)\n", 
+                                                 bestOverlap, medianYDisplacement, sectionHeight, maxPossibleOverlap);
+                                    } else {
+                                        TRACE_MESSAGE(TRACE_VERBOSE, "ImageStitcher: Not enough valid inlier displacements\n");
+                                    }
+                                } else {
+                                    TRACE_MESSAGE(TRACE_VERBOSE, "ImageStitcher: Not enough geometrically consistent matches for reliable alignment\n");
+                                }
+                            } catch (const std::exception& e) {
+                                TRACE_MESSAGE(TRACE_INFO, "ImageStitcher: RANSAC error: %s\n", e.what());
+                                
+                                // Fall back to the old method without geometric verification
+                                std::vector<double> yDisplacements;
+                                
+                                for (const auto& match : goodMatches) {
+                                    cv::Point2f ptCurr = keypointsCurr[match.queryIdx].pt;
+                                    cv::Point2f ptPrev = keypointsPrev[match.trainIdx].pt;
+                                    
+                                    double yDisplacement = ptPrev.y - ptCurr.y;
+                                    
+                                    if (yDisplacement > -sectionHeight * 2 && yDisplacement < sectionHeight * 2) {
+                                        yDisplacements.push_back(yDisplacement);
+                                    }
+                                }
+                                
+                                if (yDisplacements.size() >= 3) {
+                                    std::sort(yDisplacements.begin(), yDisplacements.end());
+                                    double medianYDisplacement = yDisplacements[yDisplacements.size() / 2];
+                                    
+                                    bestOverlap = (int)(sectionHeight + medianYDisplacement);
+                                    int maxPossibleOverlap = std::min(currentImage.rows - 10, composedRows / 2);
+                                    bestOverlap = std::max(5, std::min(bestOverlap, maxPossibleOverlap));
+                                    
+                                    foundGoodAlignment = true;
+                                    source = OverlapSource::Features;
+                                    
+                                    TRACE_MESSAGE(TRACE_VERBOSE, "ImageStitcher: Fallback overlap calculation: %d pixels (from median displacement: %.2f)\n", 
+                                             bestOverlap, medianYDisplacement);
+                                }
+                            }
+                        }
+                    }
+                } catch (const std::exception& e) {
+                    TRACE_MESSAGE(TRACE_INFO, "ImageStitcher: Feature matching error: %s\n", e.what());
+                }
+            }
+        } catch (const std::exception& e) {
+            TRACE_MESSAGE(TRACE_INFO, "ImageStitcher: Exception in feature matching: %s\n", e.what());
+        }
+        return foundGoodAlignment;
+    }
+}
+
+#ifdef _WIN32
 HBITMAP ImageStitcher::StitchImagesWithFeatureMatching(const std::vector<HBITMAP>& bitmaps) {
     if (bitmaps.empty())
         return NULL;
@@ -48,406 +425,731 @@ HBITMAP ImageStitcher::StitchImagesWithFeatureMatching(const std::vector<HBITMAP
             cv::Mat img = HBitmapToMat(bitmap);
             if (!img.empty()) {
                 images.push_back(img);
-                OutputDebugStringA("ImageStitcher: Successfully converted bitmap to Mat\n");
+                TRACE_MESSAGE(TRACE_VERBOSE, "ImageStitcher: Successfully converted bitmap to Mat\n");
             } else {
-                OutputDebugStringA("ImageStitcher: Failed to convert bitmap to Mat\n");
+                TRACE_MESSAGE(TRACE_VERBOSE, "ImageStitcher: Failed to convert bitmap to Mat\n");
             }
         }
         
         if (images.empty()) {
-            OutputDebugStringA("ImageStitcher: No images to stitch\n");
+            TRACE_MESSAGE(TRACE_VERBOSE, "ImageStitcher: No images to stitch\n");
             return NULL;
         }
         
-        char debugBuf[256];
-        sprintf_s(debugBuf, "ImageStitcher: Processing %d images for feature matching\n", (int)images.size());
-        OutputDebugStringA(debugBuf);
+        cv::Mat result = StitchMatsWithFeatureMatching(images);
         
-        // Instead of pre-allocating a huge result image, we'll build it dynamically
-        // Start with the first image
-        cv::Mat result = images[0].clone();
+        // Convert result back to HBITMAP
+        TRACE_MESSAGE(TRACE_VERBOSE, "ImageStitcher: Converting result back to HBITMAP\n");
+        return MatToHBitmap(result);
         
-        OutputDebugStringA("ImageStitcher: Starting with first image as base\n");
+    } catch (const std::exception& e) {
+        TRACE_MESSAGE(TRACE_INFO, "ImageStitcher: Exception in StitchImagesWithFeatureMatching: %s\n", e.what());
+        // Fall back to simple vertical stacking in case of any exception
+        return StitchImagesVertically(bitmaps);
+    } catch (...) {
+        TRACE_MESSAGE(TRACE_INFO, "ImageStitcher: Unknown exception in StitchImagesWithFeatureMatching, falling back to simple stacking\n");
+        // Fall back to simple vertical stacking in case of any exception
+        return StitchImagesVertically(bitmaps);
+    }
+}
+
+#endif
+
+cv::Mat ImageStitcher::StitchMatsWithFeatureMatching(const std::vector<cv::Mat>& images) {
+    TRACE_SPAN(TRACE_INFO, "StitchMats");
+    if (images.empty())
+        return cv::Mat();
+    
+    TRACE_MESSAGE(TRACE_VERBOSE, "ImageStitcher: Processing %d images for feature matching\n", (int)images.size());
+    
+    std::vector<cv::Mat> composed = images;
+    std::vector<FramePlacement> placements = AlignFrames(images);
+    
+    // Allocate the canvas once at its final size instead of growing it per frame
+    cv::Size canvasSize = CanvasSize(images, placements);
+    cv::Mat result(canvasSize, CV_8UC4, cv::Scalar(255, 255, 255, 255));
+    PruneStats pruneStats;
+    PruneFrames(composed, placements, &pruneStats);
+    ComposePruned(composed, placements, result, nullptr, pruneStats);
+    
+    return result;
+}
+
+Frame ImageStitcher::StitchFrames(const std::vector<Frame>& frames, ProgressReporter* progress, const DynamicMask* mask,
+                                  OverlapEstimator estimator, SideColumnMode sideColumns) {
+    TRACE_SPAN(TRACE_INFO, "StitchFrames");
+    // Wrap the captured pixels without copying them
+    std::vector<cv::Mat> images;
+    images.reserve(frames.size());
+    const FrameInfo* firstInfo = nullptr;
+    for (const Frame& frame : frames) {
+        if (frame && frame.Channels() == 4) {
+            images.push_back(frame.Mat());
+            if (!firstInfo)
+                firstInfo = &frame.Info();
+        }
+    }
+    if (images.empty())
+        return Frame();
+    
+    TRACE_MESSAGE(TRACE_VERBOSE, "ImageStitcher: Stitching %d frames in place\n", (int)images.size());
+    
+    SideColumns sides;
+    std::vector<FramePlacement> placements = AlignFrames(images, estimator, progress, mask, &sides);
+    
+    // Only the columns between the sides are composed from every frame;
+    // the sides are cropped or come from the first frame alone
+    cv::Mat firstFrame = images[0];
+    SideColumns kept;
+    if (!sides.Empty()) {
+        cv::Range columns = sides.Content(firstFrame.cols);
+        for (cv::Mat& image : images) {
+            image = image(cv::Rect(columns.start, 0, columns.size(), image.rows));
+        }
+        if (sideColumns == SideColumnMode::FirstFrame)
+            kept = sides;
+        for (FramePlacement& placement : placements) {
+            placement.x += kept.left;
+        }
+    }
+    
+    cv::Size canvasSize = CanvasSize(images, placements);
+    canvasSize.width += kept.right;
+    // The canvas size changes with every session, so a pooled canvas would
+    // only sit idle; it is allocated for this stitch and freed with it
+    Frame canvas(FrameBuffer::Create(canvasSize.width, canvasSize.height, 4));
+    if (!canvas)
+        return canvas;
+    canvas.Info() = *firstInfo;
+    
+    cv::Mat canvasMat = canvas.Mat();
+    canvasMat.setTo(cv::Scalar(255, 255, 255, 255));
+    ComposeSideColumns(firstFrame, kept, placements[0].y, canvasMat);
+    PruneStats pruneStats;
+    PruneFrames(images, placements, &pruneStats);
+    ComposePruned(images, placements, canvasMat, progress, pruneStats);
+    
+    return canvas;
+}
+
+// Static side columns are found first, and sideways drift is measured per
+// pair, so every estimator works on the columns both frames show. Pairs
+// are estimated in parallel at the caller's priority, a wave at a time;
+// once steps have been measured, each wave searches first in the window a
+// MotionPredictor expects. Frames are then placed in order against a
+// RowHashIndex of the canvas so far: content found elsewhere (a scroll
+// back, a re-render) is placed there, and a frame adding no rows below the
+// canvas is marked duplicate. Each frame's x follows from its predecessor's,
+// with the leftmost at x = 0. With a mask, row signatures skip its dynamic
+// columns and feature and template matching use its widest static span.
+// Per-pair temporaries come from the worker's ScratchArena.
+std::vector<FramePlacement> ImageStitcher::AlignFrames(const std::vector<cv::Mat>& frames, OverlapEstimator estimator,
+                                                       ProgressReporter* progress, const DynamicMask* mask, SideColumns* sides) {
+    TRACE_SPAN(TRACE_INFO, "AlignFrames");
+    std::vector<FramePlacement> placements(frames.size());
+    if (frames.empty())
+        return placements;
+    
+    // Scrollbars, side panels and borders only dilute the scores; every
+    // estimator works on the columns between them. Views, not copies.
+    SideColumns found = SideColumns::Detect(frames);
+    if (sides)
+        *sides = found;
+    std::vector<cv::Mat> content;
+    DynamicMask contentMask;
+    if (!found.Empty()) {
+        cv::Range columns = found.Content(frames[0].cols);
+        for (const cv::Mat& frame : frames) {
+            content.push_back(frame(cv::Rect(columns.start, 0, columns.size(), frame.rows)));
+        }
+        if (mask) {
+            contentMask = mask->Columns(columns);
+            mask = &contentMask;
+        }
+        TRACE_MESSAGE(TRACE_INFO, "ImageStitcher: Aligning columns %d-%d; %d left and %d right are static\n",
+                      columns.start, columns.end, found.left, found.right);
+    }
+    const std::vector<cv::Mat>& images = found.Empty() ? frames : content;
+    if (progress) {
+        progress->BeginStage(StitchStage::Aligning, (long long)images.size());
+        progress->Advance(1);  // The first frame is where the canvas starts
+    }
+    
+    // Estimate the pairs in parallel as if the canvas were already tall. Pairs
+    // whose real canvas height turns out to cap the estimate are redone below,
+    // so the result matches estimating the pairs one after another.
+    // Seams no estimator trusts get row-signature candidates for the global
+    // pass; trusted estimates enter it as their pair's only candidate.
+    size_t pairCount = images.size() - 1;
+    std::vector<FramePlacement> estimates(images.size());
+    std::vector<std::vector<OverlapCandidate>> candidates(pairCount);
+    std::vector<cv::Mat> previousSignatures(pairCount), currentSignatures(pairCount);
+    std::vector<SearchWindow> windows(pairCount);
+    
+    // Pairs run in waves about as wide as the pool, so every wave after the
+    // first is predicted from the steps measured before it
+    MotionPredictor predictor;
+    int waveSize = TaskExecutor::Current().WorkerCount() + 1;
+    for (int waveStart = 0; waveStart < (int)pairCount; waveStart += waveSize) {
+        int waveCount = std::min(waveSize, (int)pairCount - waveStart);
+        for (int pair = waveStart; pair < waveStart + waveCount; pair++) {
+            windows[pair] = predictor.Predict(images[pair].rows);
+        }
         
-        // Process each subsequent image
-        for (size_t i = 1; i < images.size(); i++) {
-            cv::Mat currentImage = images[i];
-            cv::Mat previousSection;
+        TaskExecutor::Current().ParallelFor(waveCount, [&](int index) {
+            if (progress)
+                progress->ThrowIfCancelled();
+            int pair = waveStart + index;
+            // Content that moved sideways is compared on the columns both frames
+            // show. The mask is in screen columns, which those no longer line up with.
+            int drift = ColumnDrift::Estimate(images[pair], images[pair + 1], mask);
+            cv::Mat previous, current;
+            SharedColumns(images[pair], images[pair + 1], drift, previous, current);
+            const DynamicMask* pairMask = drift == 0 ? mask : nullptr;
+            if (drift != 0)
+                TRACE_MESSAGE(TRACE_VERBOSE, "ImageStitcher: Image %d drifted %d columns\n", pair + 2, drift);
+            FramePlacement estimate;
+            if (estimator != OverlapEstimator::Global)
+                estimate = EstimateOverlap(previous, current, kUnboundedRows, estimator, windows[pair], pairMask);
+            estimate.drift = drift;
             
-            // Extract the bottom portion of the current result for comparison
-            int sectionHeight = std::min(100, std::min(result.rows / 3, currentImage.rows / 3));
-            if (sectionHeight > 20) {
-                cv::Rect bottomRect(0, result.rows - sectionHeight, 
-                                  std::min(result.cols, currentImage.cols), sectionHeight);
-                previousSection = result(bottomRect);
+            bool ambiguous = estimator == OverlapEstimator::Global ||
+                ((estimator == OverlapEstimator::Auto || estimator == OverlapEstimator::Cascade) &&
+                 estimate.source == OverlapSource::Conservative);
+            if (ambiguous) {
+                previousSignatures[pair] = GlobalAlignment::RowSignatures(previous, pairMask);
+                currentSignatures[pair] = GlobalAlignment::RowSignatures(current, pairMask);
+                candidates[pair] = GlobalAlignment::FindCandidates(previousSignatures[pair], currentSignatures[pair],
+                                                                   GlobalAlignmentOptions(), windows[pair], &estimate.searched);
             }
-            
-            char debugBuf[256];
-            sprintf_s(debugBuf, "ImageStitcher: Processing image %d/%d\n", (int)i+1, (int)images.size());
-            OutputDebugStringA(debugBuf);
-              
-            int bestOverlap = 0;
-            bool foundGoodAlignment = false;
-            
-            // Try feature matching if both images have sufficient size and we have a previous section
-            if (!previousSection.empty() && currentImage.rows > 20 && currentImage.cols > 20) {
-                
-                OutputDebugStringA("ImageStitcher: Attempting feature matching for optimal alignment\n");
-                
-                try {
-                    // Convert to grayscale for feature detection
-                    cv::Mat prevGray, currGray;
-                    cv::cvtColor(previousSection, prevGray, cv::COLOR_BGRA2GRAY);
-                    cv::cvtColor(currentImage, currGray, cv::COLOR_BGRA2GRAY);
-                    
-                    // Use ORB detector (SURF is not available in this OpenCV build)
-                    cv::Ptr<cv::Feature2D> detector = cv::ORB::create(1500);
-                    OutputDebugStringA("ImageStitcher: Using ORB detector\n");
-                    
-                    std::vector<cv::KeyPoint> keypointsPrev, keypointsCurr;
-                    cv::Mat descriptorsPrev, descriptorsCurr;
-                    
-                    detector->detectAndCompute(prevGray, cv::noArray(), keypointsPrev, descriptorsPrev);
-                    detector->detectAndCompute(currGray, cv::noArray(), keypointsCurr, descriptorsCurr);
-                    
-                    char kpBuf[256];
-                    sprintf_s(kpBuf, "ImageStitcher: Found %d keypoints in prev section, %d in current image\n", 
-                             (int)keypointsPrev.size(), (int)keypointsCurr.size());
-                    OutputDebugStringA(kpBuf);
-                    
-                    if (keypointsPrev.size() > 4 && keypointsCurr.size() > 4 && 
-                        !descriptorsPrev.empty() && !descriptorsCurr.empty()) {
-                        
-                        // Match features using Hamming distance for ORB
-                        std::vector<cv::DMatch> matches;
-                        cv::Ptr<cv::DescriptorMatcher> matcher = cv::DescriptorMatcher::create(cv::DescriptorMatcher::BRUTEFORCE_HAMMING);
-                        
-                        try {
-                            matcher->match(descriptorsCurr, descriptorsPrev, matches);
-                            
-                            if (!matches.empty()) {
-                                // Filter good matches for ORB
-                                double maxDist = 0, minDist = 100;
-                                for (const auto& match : matches) {
-                                    double dist = match.distance;
-                                    if (dist < minDist) minDist = dist;
-                                    if (dist > maxDist) maxDist = dist;
-                                }
-                                
-                                std::vector<cv::DMatch> goodMatches;
-                                double threshold = std::max(minDist * 2.5, 40.0); // More lenient threshold for ORB
-                                
-                                for (const auto& match : matches) {
-                                    if (match.distance <= threshold) {
-                                        goodMatches.push_back(match);
-                                    }
-                                }
-                                
-                                char matchBuf[256];
-                                sprintf_s(matchBuf, "ImageStitcher: Found %d good matches out of %d total\n", 
-                                         (int)goodMatches.size(), (int)matches.size());
-                                OutputDebugStringA(matchBuf);
-                                
-                                if (goodMatches.size() >= 4) {
-                                    // First, perform geometric consistency check using RANSAC
-                                    std::vector<cv::Point2f> pointsCurr, pointsPrev;
-                                    for (const auto& match : goodMatches) {
-                                        pointsCurr.push_back(keypointsCurr[match.queryIdx].pt);
-                                        pointsPrev.push_back(keypointsPrev[match.trainIdx].pt);
-                                    }
-                                    
-                                    // Use RANSAC to find geometrically consistent matches
-                                    std::vector<uchar> inlierMask;
-                                    cv::Mat homography;
-                                    try {
-                                        homography = cv::findHomography(pointsCurr, pointsPrev, cv::RANSAC, 3.0, inlierMask);
-                                        
-                                        // Count inliers
-                                        int inlierCount = 0;
-                                        for (int i = 0; i < inlierMask.size(); i++) {
-                                            if (inlierMask[i]) inlierCount++;
-                                        }
-                                        
-                                        char ransacBuf[256];
-                                        sprintf_s(ransacBuf, "ImageStitcher: RANSAC found %d inliers out of %d matches\n", 
-                                                 inlierCount, (int)goodMatches.size());
-                                        OutputDebugStringA(ransacBuf);
-                                        
-                                        // Only proceed if we have enough geometrically consistent matches
-                                        if (inlierCount >= 6) {
-                                            // Calculate displacement using only inliers
-                                            std::vector<double> yDisplacements;
-                                            
-                                            for (int i = 0; i < goodMatches.size(); i++) {
-                                                if (inlierMask[i]) {
-                                                    cv::Point2f ptCurr = keypointsCurr[goodMatches[i].queryIdx].pt;
-                                                    cv::Point2f ptPrev = keypointsPrev[goodMatches[i].trainIdx].pt;
-                                                    
-                                                    double yDisplacement = ptPrev.y - ptCurr.y;
-                                                    
-                                                    // For vertical scrolling, we expect mainly vertical displacement
-                                                    if (yDisplacement > -sectionHeight * 2 && yDisplacement < sectionHeight * 2) {
-                                                        yDisplacements.push_back(yDisplacement);
-                                                    }
-                                                }
-                                            }
-                                            
-                                            if (yDisplacements.size() >= 3) {
-                                                // Use median displacement for robustness
-                                                std::sort(yDisplacements.begin(), yDisplacements.end());
-                                                double medianYDisplacement = yDisplacements[yDisplacements.size() / 2];
-                                                
-                                                // Check for suspiciously consistent displacements that might indicate repetitive content
-                                                // Count how many displacements are very close to the median
-                                                int consistentCount = 0;
-                                                for (double disp : yDisplacements) {
-                                                    if (abs(disp - medianYDisplacement) < 5.0) {
-                                                        consistentCount++;
-                                                    }
-                                                }
-                                                
-                                                // If too many matches have identical displacement, it's likely repetitive content
-                                                bool likelyRepetitiveContent = (consistentCount > yDisplacements.size() * 0.7);
-                                                
-                                                // Convert displacement to overlap amount
-                                                // The displacement tells us how much the images have shifted
-                                                // A negative displacement means the new image shows content further down
-                                                bestOverlap = (int)(sectionHeight + medianYDisplacement);
-                                                
-                                                // Allow more flexible overlap range - don't limit to sectionHeight
-                                                int maxPossibleOverlap = std::min(currentImage.rows - 10, result.rows / 2);
-                                                bestOverlap = std::max(5, std::min(bestOverlap, maxPossibleOverlap));
-                                                
-                                                // If we suspect repetitive content or get suspicious results, be more conservative
-                                                if (likelyRepetitiveContent || abs(medianYDisplacement) > sectionHeight * 1.5) {
-                                                    char repetitiveBuf[256];
-                                                    sprintf_s(repetitiveBuf, "ImageStitcher: Detected likely repetitive content or suspicious displacement (%.2f), using conservative overlap\n", medianYDisplacement);
-                                                    OutputDebugStringA(repetitiveBuf);
-                                                    
-                                                    bestOverlap = std::min(sectionHeight / 3, 40); // Much smaller conservative overlap
-                                                    foundGoodAlignment = true; // Still use blending but with conservative overlap
-                                                } else {
-                                                    foundGoodAlignment = true;
-                                                }
-                                                
-                                                char dispBuf[256];
-                                                sprintf_s(dispBuf, "ImageStitcher: Calculated optimal overlap: %d pixels (from median displacement: %.2f, section height: %d, max possible: %d)\n", 
-                                                         bestOverlap, medianYDisplacement, sectionHeight, maxPossibleOverlap);
-                                                OutputDebugStringA(dispBuf);
-                                            } else {
-                                                OutputDebugStringA("ImageStitcher: Not enough valid inlier displacements\n");
-                                            }
-                                        } else {
-                                            OutputDebugStringA("ImageStitcher: Not enough geometrically consistent matches for reliable alignment\n");
-                                        }
-                                    } catch (const std::exception& e) {
-                                        char ransacErrBuf[256];
-                                        sprintf_s(ransacErrBuf, "ImageStitcher: RANSAC error: %s\n", e.what());
-                                        OutputDebugStringA(ransacErrBuf);
-                                        
-                                        // Fall back to the old method without geometric verification
-                                        std::vector<double> yDisplacements;
-                                        
-                                        for (const auto& match : goodMatches) {
-                                            cv::Point2f ptCurr = keypointsCurr[match.queryIdx].pt;
-                                            cv::Point2f ptPrev = keypointsPrev[match.trainIdx].pt;
-                                            
-                                            double yDisplacement = ptPrev.y - ptCurr.y;
-                                            
-                                            if (yDisplacement > -sectionHeight * 2 && yDisplacement < sectionHeight * 2) {
-                                                yDisplacements.push_back(yDisplacement);
-                                            }
-                                        }
-                                        
-                                        if (yDisplacements.size() >= 3) {
-                                            std::sort(yDisplacements.begin(), yDisplacements.end());
-                                            double medianYDisplacement = yDisplacements[yDisplacements.size() / 2];
-                                            
-                                            bestOverlap = (int)(sectionHeight + medianYDisplacement);
-                                            int maxPossibleOverlap = std::min(currentImage.rows - 10, result.rows / 2);
-                                            bestOverlap = std::max(5, std::min(bestOverlap, maxPossibleOverlap));
-                                            
-                                            foundGoodAlignment = true;
-                                            
-                                            char dispBuf[256];
-                                            sprintf_s(dispBuf, "ImageStitcher: Fallback overlap calculation: %d pixels (from median displacement: %.2f)\n", 
-                                                     bestOverlap, medianYDisplacement);
-                                            OutputDebugStringA(dispBuf);
-                                        }
-                                    }
-                                }
-                            }
-                        } catch (const std::exception& e) {
-                            char errBuf[256];
-                            sprintf_s(errBuf, "ImageStitcher: Feature matching error: %s\n", e.what());
-                            OutputDebugStringA(errBuf);
-                        }
-                    }
-                } catch (const std::exception& e) {
-                    char exBuf[256];
-                    sprintf_s(exBuf, "ImageStitcher: Exception in feature matching: %s\n", e.what());
-                    OutputDebugStringA(exBuf);
-                }
+            if (!candidates[pair].empty()) {
+                estimate.source = OverlapSource::Global;
+            } else {
+                OverlapCandidate only;
+                only.overlap = estimate.overlap;
+                candidates[pair].push_back(only);
+            }
+            estimates[pair + 1] = estimate;
+            if (progress)
+                progress->Advance(1);
+        });
+        
+        // Only steps an estimator trusted feed the prediction: exact rows,
+        // matched features or templates, or a row-signature best that stood out
+        for (int pair = waveStart; pair < waveStart + waveCount; pair++) {
+            const FramePlacement& estimate = estimates[pair + 1];
+            const std::vector<OverlapCandidate>& list = candidates[pair];
+            bool trusted = estimate.source == OverlapSource::Exact || estimate.source == OverlapSource::Signature ||
+                estimate.source == OverlapSource::Features || estimate.source == OverlapSource::Template ||
+                (estimate.source == OverlapSource::Global &&
+                 (list.size() == 1 || list[1].cost - list[0].cost >= GlobalAlignmentOptions().ambiguityMargin));
+            if (trusted)
+                predictor.Record(images[pair].rows - (estimate.source == OverlapSource::Global ? list[0].overlap : estimate.overlap));
+        }
+    }
+    
+    // Choose every ambiguous seam's overlap at once, so each follows the
+    // scroll step of its neighbours
+    bool anyGlobal = std::any_of(estimates.begin(), estimates.end(),
+                                 [](const FramePlacement& estimate) { return estimate.source == OverlapSource::Global; });
+    if (anyGlobal) {
+        std::vector<int> previousHeights(pairCount);
+        for (size_t pair = 0; pair < pairCount; pair++) {
+            previousHeights[pair] = images[pair].rows;
+        }
+        
+        // A seam with many equally good overlaps may not list the right one
+        // among its best few, so also offer the one the typical step predicts
+        int typicalStep = GlobalAlignment::TypicalStep(candidates, previousHeights);
+        for (size_t pair = 0; pair < pairCount && typicalStep >= 0; pair++) {
+            int predicted = previousHeights[pair] - typicalStep;
+            std::vector<OverlapCandidate>& list = candidates[pair];
+            bool listed = std::any_of(list.begin(), list.end(),
+                                      [&](const OverlapCandidate& candidate) { return candidate.overlap == predicted; });
+            if (estimates[pair + 1].source == OverlapSource::Global && !listed &&
+                predicted > 0 && predicted < std::min(images[pair].rows, images[pair + 1].rows)) {
+                OverlapCandidate prior;
+                prior.overlap = predicted;
+                prior.cost = GlobalAlignment::MatchCost(previousSignatures[pair], currentSignatures[pair], predicted);
+                list.push_back(prior);
+            }
+        }
+        std::vector<int> chosen = GlobalAlignment::ChooseCandidates(candidates, previousHeights);
+        for (size_t pair = 0; pair < pairCount; pair++) {
+            FramePlacement& estimate = estimates[pair + 1];
+            if (estimate.source == OverlapSource::Global) {
+                estimate.overlap = candidates[pair][chosen[pair]].overlap;
+                estimate.blend = estimate.overlap > 0;
+            }
+        }
+    }
+    
+    // Row signatures of every frame feed the session index. Frames of
+    // different widths or columns have incomparable signatures, so such
+    // sessions go unindexed.
+    bool indexed = std::all_of(images.begin(), images.end(), [&](const cv::Mat& image) { return image.cols == images[0].cols; }) &&
+        std::all_of(estimates.begin(), estimates.end(), [](const FramePlacement& estimate) { return estimate.drift == 0; });
+    std::vector<cv::Mat> signatures(images.size());
+    if (indexed) {
+        TaskExecutor::Current().ParallelFor((int)images.size(), [&](int i) {
+            signatures[i] = GlobalAlignment::RowSignatures(images[i], mask);
+        });
+    }
+    RowHashIndex index;
+    if (indexed)
+        index.Append(signatures[0], 0);
+    
+    // The first frame starts the canvas; every later frame is aligned against
+    // its predecessor unless the index finds its content clearly elsewhere
+    int composedRows = images[0].rows;
+    int previousBottom = images[0].rows;
+    for (size_t i = 1; i < images.size(); i++) {
+        TRACE_MESSAGE(TRACE_VERBOSE, "ImageStitcher: Processing image %d/%d\n", (int)i+1, (int)images.size());
+        
+        // Global choices and the cascade's cheap tiers do not depend on the canvas height
+        OverlapSource estimated = estimates[i].source;
+        bool redo = estimator != OverlapEstimator::Global && estimated != OverlapSource::Global &&
+            estimated != OverlapSource::Exact && estimated != OverlapSource::Signature &&
+            CanvasHeightLimitsEstimate(composedRows, images[i]);
+        if (redo && progress)
+            progress->ThrowIfCancelled();
+        FramePlacement placement = estimates[i];
+        if (redo) {
+            int drift = estimates[i].drift;
+            cv::Mat previous, current;
+            SharedColumns(images[i - 1], images[i], drift, previous, current);
+            placement = EstimateOverlap(previous, current, composedRows, estimator, windows[i - 1], drift == 0 ? mask : nullptr);
+            placement.drift = drift;
+        }
+        placement.x = placements[i - 1].x - placement.drift;
+        placement.y = previousBottom - placement.overlap;
+        
+        if (indexed) {
+            IndexMatch match = index.Locate(signatures[i]);
+            if (match.found && match.y >= 0 && match.y != placement.y &&
+                match.cost + kIndexCostMargin < index.Cost(signatures[i], placement.y)) {
+                TRACE_MESSAGE(TRACE_VERBOSE, "ImageStitcher: Index places image %d at row %d instead of %d (%d votes)\n",
+                              (int)i + 1, match.y, placement.y, match.votes);
+                placement.y = match.y;
+                placement.overlap = std::max(0, std::min(images[i].rows, composedRows - match.y));
+                placement.blend = placement.overlap > 0;
+                placement.source = OverlapSource::Index;
+            }
+            index.Append(signatures[i], placement.y);
+        }
+        placement.duplicate = placement.y + images[i].rows <= composedRows;
+        placements[i] = placement;
+        TRACE_COUNTER(TRACE_DEBUG, "overlap_rows", placement.overlap);
+        TRACE_COUNTER(TRACE_DEBUG, "drift_columns", placement.drift);
+        
+        previousBottom = placement.y + images[i].rows;
+        composedRows = std::max(composedRows, previousBottom);
+    }
+    
+    // Drift to the right leaves earlier frames left of x = 0; move everything back onto the canvas
+    int left = std::min_element(placements.begin(), placements.end(),
+                                [](const FramePlacement& a, const FramePlacement& b) { return a.x < b.x; })->x;
+    for (FramePlacement& placement : placements) {
+        placement.x -= left;
+    }
+    
+    if (estimator == OverlapEstimator::Cascade) {
+        OverlapSourceStats stats;
+        stats.Add(placements);
+        TRACE_MESSAGE(TRACE_INFO, "ImageStitcher: cascade decided %d exact, %d signature, %d features, %d template, %d global, %d conservative\n",
+                      stats.pairs[(int)OverlapSource::Exact], stats.pairs[(int)OverlapSource::Signature],
+                      stats.pairs[(int)OverlapSource::Features], stats.pairs[(int)OverlapSource::Template],
+                      stats.pairs[(int)OverlapSource::Global], stats.pairs[(int)OverlapSource::Conservative]);
+    }
+    
+    return placements;
+}
+
+void OverlapSourceStats::Add(const std::vector<FramePlacement>& placements) {
+    for (size_t i = 1; i < placements.size(); i++) {
+        int source = (int)placements[i].source;
+        pairs[source]++;
+        ms[source] += placements[i].ms;
+    }
+}
+
+std::vector<size_t> ImageStitcher::PruneFrames(std::vector<cv::Mat>& images, std::vector<FramePlacement>& placements,
+                                               PruneStats* stats, int margin) {
+    TRACE_SPAN(TRACE_DEBUG, "PruneFrames");
+    size_t frameCount = std::min(images.size(), placements.size());
+    std::vector<size_t> kept;
+    if (frameCount == 0)
+        return kept;
+    
+    auto top = [&](size_t i) { return placements[i].y; };
+    auto bottom = [&](size_t i) { return placements[i].y + images[i].rows; };
+    
+    // Duplicates add nothing to the canvas
+    std::vector<size_t> order;
+    for (size_t i = 0; i < frameCount; i++) {
+        if (i == 0 || !placements[i].duplicate)
+            order.push_back(i);
+    }
+    
+    // Greedy cover: from each kept frame, jump to the furthest later frame
+    // that still overlaps it by the margin, as long as every frame skipped
+    // lies within the two
+    size_t current = 0;
+    kept.push_back(order[0]);
+    while (current + 1 < order.size()) {
+        size_t next = current + 1;
+        size_t from = order[current];
+        for (size_t candidate = current + 2; candidate < order.size(); candidate++) {
+            size_t to = order[candidate];
+            if (images[to].cols != images[from].cols || placements[to].x != placements[from].x || top(to) < top(from) ||
+                bottom(from) - top(to) < margin || bottom(to) < bottom(from))
+                break;
+            bool covered = true;
+            for (size_t skipped = current + 1; skipped < candidate && covered; skipped++) {
+                size_t between = order[skipped];
+                covered = images[between].cols == images[from].cols && placements[between].x == placements[from].x &&
+                    top(between) >= top(from) && bottom(between) <= bottom(to);
             }
+            if (!covered)
+                break;
+            next = candidate;
+        }
+        kept.push_back(order[next]);
+        current = next;
+    }
+    
+    PruneStats result;
+    result.framesPruned = (int)(frameCount - kept.size());
+    std::vector<cv::Mat> keptImages;
+    std::vector<FramePlacement> keptPlacements;
+    for (size_t k = 0; k < kept.size(); k++) {
+        size_t index = kept[k];
+        FramePlacement placement = placements[index];
+        if (k > 0 && kept[k] != kept[k - 1] + 1) {
+            // Overlap the frame now composed before this one
+            placement.overlap = std::max(0, std::min(images[index].rows, bottom(kept[k - 1]) - placement.y));
+            placement.blend = placement.blend && placement.overlap > 0;
+        }
+        keptImages.push_back(images[index]);
+        keptPlacements.push_back(placement);
+        result.rowsComposed += images[index].rows;
+    }
+    for (size_t i = 0; i < frameCount; i++) {
+        result.rowsSkipped += images[i].rows;
+    }
+    result.rowsSkipped -= result.rowsComposed;
+    
+    images.swap(keptImages);
+    placements.swap(keptPlacements);
+    TRACE_COUNTER(TRACE_DEBUG, "pruned_frames", result.framesPruned);
+    if (stats)
+        *stats = result;
+    return kept;
+}
+
+cv::Size ImageStitcher::CanvasSize(const std::vector<cv::Mat>& images, const std::vector<FramePlacement>& placements) {
+    int width = 0;
+    int height = 0;
+    for (size_t i = 0; i < images.size() && i < placements.size(); i++) {
+        width = std::max(width, placements[i].x + images[i].cols);
+        height = std::max(height, placements[i].y + images[i].rows);
+    }
+    return cv::Size(width, height);
+}
+
+FramePlacement ImageStitcher::EstimateOverlap(const cv::Mat& previousFrame, const cv::Mat& currentFrame, int composedRows,
+                                              OverlapEstimator estimator, const SearchWindow& window, const DynamicMask* mask) {
+    TRACE_SPAN(TRACE_DEBUG, "EstimateOverlap");
+    auto start = std::chrono::steady_clock::now();
+    // Gray copies, row hashes and match results of this pair go back to the arena on return
+    ScratchArena::Scope scratch(ScratchArena::ForThread());
+    cv::Mat previousImage = previousFrame;
+    cv::Mat currentImage = currentFrame;
+    cv::Mat previousSection;
+    
+    // Compare only the widest run of columns without dynamic content. Views, not copies.
+    if (mask && !mask->Empty() && mask->Width() == currentFrame.cols && previousFrame.cols == currentFrame.cols) {
+        cv::Range span = mask->WidestStaticSpan();
+        if (span.size() >= kMinStaticSpan && span.size() < currentFrame.cols) {
+            previousImage = previousFrame(cv::Rect(span.start, 0, span.size(), previousFrame.rows));
+            currentImage = currentFrame(cv::Rect(span.start, 0, span.size(), currentFrame.rows));
+        }
+    }
+    
+    // Columns pixel verification compares: the static ones, unless a static span was cut out above
+    std::vector<cv::Range> columns;
+    if (mask && !mask->Empty() && mask->Width() == currentImage.cols && previousImage.cols == currentImage.cols)
+        columns = mask->StaticColumns();
+    else
+        columns.push_back(cv::Range(0, currentImage.cols));
+    int rejected = 0;
+    auto verify = [&](int overlap) {
+        bool accepted = VerifyOverlap(previousImage, currentImage, overlap, columns);
+        if (!accepted) {
+            rejected++;
+            TRACE_MESSAGE(TRACE_VERBOSE, "ImageStitcher: Overlap %d pixels failed pixel verification\n", overlap);
+        }
+        return accepted;
+    };
+    
+    // Extract the bottom portion of the previous frame for comparison
+    int sectionHeight = std::min(100, std::min(composedRows / 3, currentImage.rows / 3));
+    sectionHeight = std::min(sectionHeight, previousImage.rows);
+    if (sectionHeight > 20) {
+        cv::Rect bottomRect(0, previousImage.rows - sectionHeight, 
+                          std::min(previousImage.cols, currentImage.cols), sectionHeight);
+        previousSection = previousImage(bottomRect);
+    }
+    
+    int bestOverlap = 0;
+    bool foundGoodAlignment = false;
+    OverlapSource source = OverlapSource::None;
+    int searched = 0;
+    
+    // The cascade's cheap tiers: a unique byte-exact overlap, then a row-signature best that stands out
+    if (estimator == OverlapEstimator::Cascade) {
+        {
+            TRACE_SPAN(TRACE_DEBUG, "ExactMatch");
+            bestOverlap = FindExactOverlap(previousImage, currentImage, searched);
+        }
+        if (bestOverlap > 0) {
+            foundGoodAlignment = true;
+            source = OverlapSource::Exact;
+        } else {
+            TRACE_SPAN(TRACE_DEBUG, "SignatureMatch");
+            // The mask only applies to full-width frames; a static span is already cut out
+            const DynamicMask* signatureMask = previousImage.cols == previousFrame.cols ? mask : nullptr;
+            GlobalAlignmentOptions options;
+            std::vector<OverlapCandidate> candidates = GlobalAlignment::FindCandidates(
+                GlobalAlignment::RowSignatures(previousImage, signatureMask),
+                GlobalAlignment::RowSignatures(currentImage, signatureMask), options, window, &searched);
+            // A close runner-up is no doubt if its pixels do not match
+            if (!candidates.empty() && candidates[0].cost <= kMaxSignatureCost && verify(candidates[0].overlap) &&
+                (candidates.size() == 1 || candidates[1].cost - candidates[0].cost >= options.ambiguityMargin ||
+                 !VerifyOverlap(previousImage, currentImage, candidates[1].overlap, columns))) {
+                bestOverlap = candidates[0].overlap;
+                foundGoodAlignment = true;
+                source = OverlapSource::Signature;
+            }
+        }
+        if (foundGoodAlignment)
+            TRACE_MESSAGE(TRACE_VERBOSE, "ImageStitcher: Cascade decided overlap %d pixels without feature matching\n", bestOverlap);
+    }
+    
+    // Try feature matching if both images have sufficient size and we have a previous section
+    if (!foundGoodAlignment && estimator != OverlapEstimator::Template &&
+        !previousSection.empty() && currentImage.rows > 20 && currentImage.cols > 20) {
+        
+        TRACE_SPAN(TRACE_DEBUG, "FeatureMatch");
+        TRACE_MESSAGE(TRACE_VERBOSE, "ImageStitcher: Attempting feature matching for optimal alignment\n");
+        
+        // Look in the band the predicted overlap puts the section in first; a
+        // band without a trusted displacement falls back to the whole frame
+        if (window.Active()) {
+            int bandStart = std::max(0, window.Low() - sectionHeight - kFeatureBandMargin);
+            int bandEnd = std::min(currentImage.rows, window.High() + kFeatureBandMargin);
+            if (bandEnd - bandStart >= sectionHeight + kFeatureBandMargin && bandEnd - bandStart < currentImage.rows) {
+                foundGoodAlignment = MatchFeatures(previousSection, currentImage, cv::Range(bandStart, bandEnd),
+                                                   sectionHeight, composedRows, bestOverlap, source) &&
+                    source == OverlapSource::Features && verify(bestOverlap);
+                searched += bandEnd - bandStart;
+            }
+        }
+        if (!foundGoodAlignment) {
+            foundGoodAlignment = MatchFeatures(previousSection, currentImage, cv::Range(0, currentImage.rows),
+                                               sectionHeight, composedRows, bestOverlap, source);
+            searched += currentImage.rows;
+            // Conservative guesses for repetitive matches are not offsets to verify
+            if (foundGoodAlignment && source == OverlapSource::Features && !verify(bestOverlap)) {
+                foundGoodAlignment = false;
+                source = OverlapSource::None;
+            }
+        }
+    }
+    
+    // If feature matching didn't work, try simple template matching
+    if (!foundGoodAlignment && !previousSection.empty()) {
+        int maxTestOverlap = std::min(sectionHeight, currentImage.rows - 10);
+        double bestScore = -1;
+        bool verified = false;
+        
+        // A features-only run skips the search and goes straight to the conservative guess
+        if (estimator != OverlapEstimator::Features) {
+            TRACE_SPAN(TRACE_DEBUG, "TemplateMatch");
+            TRACE_MESSAGE(TRACE_VERBOSE, "ImageStitcher: Trying template matching for overlap detection\n");
             
-            // If feature matching didn't work, try simple template matching
-            if (!foundGoodAlignment && !previousSection.empty()) {
-                OutputDebugStringA("ImageStitcher: Trying template matching for overlap detection\n");
+            // Every comparison is of equal-sized sections, so the result is one value
+            cv::Mat result_match = ScratchArena::ForThread().Mat(1, 1, CV_32F);
+            auto testOverlap = [&](int overlap) {
+                // Get top section of current image
+                cv::Rect currentTopRect(0, 0, 
+                                      std::min(previousSection.cols, currentImage.cols), 
+                                      overlap);
+                cv::Mat currentTop = currentImage(currentTopRect);
                 
-                int maxTestOverlap = std::min(sectionHeight, currentImage.rows - 10);
-                double bestScore = -1;
+                // Get bottom section of previous frame
+                cv::Rect prevBottomRect(0, previousSection.rows - overlap, 
+                                      currentTopRect.width, overlap);
+                cv::Mat prevBottom = previousSection(prevBottomRect);
                 
-                for (int testOverlap = 5; testOverlap <= maxTestOverlap; testOverlap += 3) {
-                    if (testOverlap >= currentImage.rows) continue;
-                    
-                    // Get top section of current image
-                    cv::Rect currentTopRect(0, 0, 
-                                          std::min(previousSection.cols, currentImage.cols), 
-                                          testOverlap);
-                    cv::Mat currentTop = currentImage(currentTopRect);
-                    
-                    // Get bottom section of previous result
-                    cv::Rect prevBottomRect(0, previousSection.rows - testOverlap, 
-                                          currentTopRect.width, testOverlap);
-                    cv::Mat prevBottom = previousSection(prevBottomRect);
-                    
-                    // Calculate similarity using template matching
-                    cv::Mat result_match;
-                    cv::matchTemplate(currentTop, prevBottom, result_match, cv::TM_CCOEFF_NORMED);
-                    
-                    double minVal, maxVal;
-                    cv::minMaxLoc(result_match, &minVal, &maxVal);
-                    
-                    if (maxVal > bestScore) {
-                        bestScore = maxVal;
-                        bestOverlap = testOverlap;
-                    }
-                }
-                
-                if (bestScore > 0.5) {  // More lenient template match threshold
-                    foundGoodAlignment = true;
-                    char tmplBuf[256];
-                    sprintf_s(tmplBuf, "ImageStitcher: Template matching found overlap: %d pixels (score: %.3f)\n", 
-                             bestOverlap, bestScore);
-                    OutputDebugStringA(tmplBuf);
-                } else {
-                    // If template matching fails, use a conservative overlap based on typical scroll distance
-                    // For most content, a scroll typically moves 1/3 to 1/2 of the visible area
-                    bestOverlap = std::min(std::max(sectionHeight / 3, 30), currentImage.rows / 5);
-                    foundGoodAlignment = true; // Enable blending for conservative overlap
-                    char conservativeBuf[256];
-                    sprintf_s(conservativeBuf, "ImageStitcher: Using conservative scroll-based overlap with blending: %d pixels\n", bestOverlap);
-                    OutputDebugStringA(conservativeBuf);
-                }
-            }
-            
-            // Apply the calculated overlap and extend the result image
-            // But first, validate that the overlap makes sense
-            if (foundGoodAlignment && bestOverlap < 15 && bestOverlap > 0) {
-                // Small overlaps often indicate false matches, especially for repetitive content like code
-                char warningBuf[256];
-                sprintf_s(warningBuf, "ImageStitcher: Very small overlap (%d pixels) detected - likely false match on repetitive content\n", bestOverlap);
-                OutputDebugStringA(warningBuf);
+                // Calculate similarity using template matching
+                cv::matchTemplate(currentTop, prevBottom, result_match, cv::TM_CCOEFF_NORMED);
                 
-                // For small overlaps, use a more conservative approach
-                bestOverlap = std::min(std::max(sectionHeight / 4, 25), currentImage.rows / 6);
-                // Keep foundGoodAlignment = true so we still blend with the conservative overlap
+                double minVal, maxVal;
+                cv::minMaxLoc(result_match, &minVal, &maxVal);
+                searched++;
                 
-                sprintf_s(warningBuf, "ImageStitcher: Using conservative overlap with blending: %d pixels\n", bestOverlap);
-                OutputDebugStringA(warningBuf);
-            }
-            
-            int newHeight = result.rows + currentImage.rows - bestOverlap;
-            int newWidth = std::max(result.cols, currentImage.cols);
-            
-            cv::Mat newResult(newHeight, newWidth, CV_8UC4, cv::Scalar(255, 255, 255, 255));
-            
-            // Copy existing result
-            cv::Rect existingRect(0, 0, result.cols, result.rows);
-            cv::Mat existingRoi = newResult(existingRect);
-            result.copyTo(existingRoi);
-            
-            // Place current image with calculated overlap
-            int currentYPos = result.rows - bestOverlap;
-            cv::Rect currentRect(0, currentYPos, currentImage.cols, currentImage.rows);
-            cv::Mat currentRoi = newResult(currentRect);
+                if (maxVal > bestScore) {
+                    bestScore = maxVal;
+                    bestOverlap = overlap;
+                }
+            };
             
-            if (bestOverlap > 0 && foundGoodAlignment) {
-                // Blend the overlapping region with gradient blending
-                cv::Rect overlapRect(0, currentYPos, 
-                                   std::min(result.cols, currentImage.cols), 
-                                   bestOverlap);
-                cv::Mat overlapRoi = newResult(overlapRect);
-                cv::Mat currentOverlap = currentImage(cv::Rect(0, 0, overlapRect.width, overlapRect.height));
-                
-                // Create gradient mask for smooth blending
-                cv::Mat mask = cv::Mat::zeros(overlapRect.height, overlapRect.width, CV_32F);
-                for (int y = 0; y < overlapRect.height; y++) {
-                    float weight = (float)y / (float)overlapRect.height; // 0 to 1 from top to bottom
-                    mask.row(y).setTo(cv::Scalar(weight));
+            // Every row of the predicted window first, then the usual coarse sweep
+            // if nothing there scores and verifies. The sweep steps 3 rows, so
+            // its best is refined to the row before it is verified.
+            if (window.Active()) {
+                for (int overlap = std::max(5, window.Low()); overlap <= std::min(maxTestOverlap, window.High()); overlap++) {
+                    if (overlap < currentImage.rows)
+                        testOverlap(overlap);
                 }
-                
-                // Apply gradient blending
-                cv::Mat blended;
-                overlapRoi.convertTo(blended, CV_32FC4);
-                cv::Mat currentOverlapF;
-                currentOverlap.convertTo(currentOverlapF, CV_32FC4);
-                
-                for (int c = 0; c < 4; c++) {
-                    cv::Mat channelExisting, channelCurrent, channelMask;
-                    cv::extractChannel(blended, channelExisting, c);
-                    cv::extractChannel(currentOverlapF, channelCurrent, c);
-                    cv::extractChannel(mask, channelMask, 0);
-                    
-                    cv::Mat channelResult = channelExisting.mul(1.0 - channelMask) + channelCurrent.mul(channelMask);
-                    cv::insertChannel(channelResult, blended, c);
+                verified = bestScore > 0.5 && verify(bestOverlap);  // More lenient template match threshold
+            }
+            if (!verified) {
+                bestScore = -1;
+                for (int overlap = 5; overlap <= maxTestOverlap; overlap += 3) {
+                    if (overlap < currentImage.rows)
+                        testOverlap(overlap);
                 }
-                
-                blended.convertTo(overlapRoi, CV_8UC4);
-                
-                // Copy non-overlapping part
-                if (bestOverlap < currentImage.rows) {
-                    cv::Rect nonOverlapRect(0, currentYPos + bestOverlap, 
-                                          currentImage.cols, currentImage.rows - bestOverlap);
-                    cv::Mat nonOverlapRoi = newResult(nonOverlapRect);
-                    cv::Mat currentNonOverlap = currentImage(cv::Rect(0, bestOverlap, 
-                                                                     currentImage.cols, 
-                                                                     currentImage.rows - bestOverlap));
-                    currentNonOverlap.copyTo(nonOverlapRoi);
+                int coarse = bestOverlap;
+                for (int overlap = std::max(5, coarse - 2); overlap <= std::min(maxTestOverlap, coarse + 2); overlap++) {
+                    if (overlap != coarse && overlap < currentImage.rows)
+                        testOverlap(overlap);
                 }
-                
-                OutputDebugStringA("ImageStitcher: Applied gradient blended overlap\n");
-            } else {
-                // No overlap, just place adjacent
-                currentImage.copyTo(currentRoi);
-                OutputDebugStringA("ImageStitcher: Placed image without overlap\n");
+                verified = bestScore > 0.5 && verify(bestOverlap);
             }
-            
-            // Update result for next iteration
-            result = newResult;
-            
-            char resultBuf[256];
-            sprintf_s(resultBuf, "ImageStitcher: Result now %dx%d\n", result.cols, result.rows);
-            OutputDebugStringA(resultBuf);
         }
         
-        // Convert result back to HBITMAP
-        OutputDebugStringA("ImageStitcher: Converting result back to HBITMAP\n");
-        return MatToHBitmap(result);
+        if (verified) {
+            foundGoodAlignment = true;
+            source = OverlapSource::Template;
+            TRACE_MESSAGE(TRACE_VERBOSE, "ImageStitcher: Template matching found overlap: %d pixels (score: %.3f)\n", 
+                     bestOverlap, bestScore);
+        } else {
+            // If template matching fails, use a conservative overlap based on typical scroll distance
+            // For most content, a scroll typically moves 1/3 to 1/2 of the visible area
+            bestOverlap = std::min(std::max(sectionHeight / 3, 30), currentImage.rows / 5);
+            foundGoodAlignment = true; // Enable blending for conservative overlap
+            source = OverlapSource::Conservative;
+            TRACE_MESSAGE(TRACE_VERBOSE, "ImageStitcher: Using conservative scroll-based overlap with blending: %d pixels\n", bestOverlap);
+        }
+    }
+    
+    // Validate that the overlap makes sense before handing it to the composer
+    if (foundGoodAlignment && bestOverlap < 15 && bestOverlap > 0) {
+        // Small overlaps often indicate false matches, especially for repetitive content like code
+        TRACE_MESSAGE(TRACE_VERBOSE, "ImageStitcher: Very small overlap (%d pixels) detected - likely false match on repetitive content\n", bestOverlap);
         
-    } catch (const std::exception& e) {
-        char exBuf[512];
-        sprintf_s(exBuf, "ImageStitcher: Exception in StitchImagesWithFeatureMatching: %s\n", e.what());
-        OutputDebugStringA(exBuf);
-        // Fall back to simple vertical stacking in case of any exception
-        return StitchImagesVertically(bitmaps);
-    } catch (...) {
-        OutputDebugStringA("ImageStitcher: Unknown exception in StitchImagesWithFeatureMatching, falling back to simple stacking\n");
-        // Fall back to simple vertical stacking in case of any exception
-        return StitchImagesVertically(bitmaps);
+        // For small overlaps, use a more conservative approach
+        bestOverlap = std::min(std::max(sectionHeight / 4, 25), currentImage.rows / 6);
+        // Keep foundGoodAlignment = true so we still blend with the conservative overlap
+        source = OverlapSource::Conservative;
+        
+        TRACE_MESSAGE(TRACE_VERBOSE, "ImageStitcher: Using conservative overlap with blending: %d pixels\n", bestOverlap);
     }
+    
+    FramePlacement placement;
+    placement.overlap = bestOverlap;
+    placement.blend = foundGoodAlignment && bestOverlap > 0;
+    placement.source = source;
+    placement.searched = searched;
+    placement.rejected = rejected;
+    placement.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return placement;
 }
 
+void ImageStitcher::ComposeFrames(const std::vector<cv::Mat>& images, const std::vector<FramePlacement>& placements, cv::Mat& canvas,
+                                  ProgressReporter* progress) {
+    TRACE_SPAN(TRACE_INFO, "ComposeFrames");
+    size_t frameCount = std::min(images.size(), placements.size());
+    if (progress) {
+        long long totalRows = 0;
+        for (size_t i = 0; i < frameCount; i++) {
+            totalRows += images[i].rows;
+        }
+        progress->BeginStage(StitchStage::Composing, totalRows);
+    }
+    
+    for (size_t i = 0; i < frameCount; i++) {
+        if (progress)
+            progress->ThrowIfCancelled();
+        
+        const cv::Mat& currentImage = images[i];
+        const FramePlacement& placement = placements[i];
+        if (placement.duplicate) {
+            if (progress)
+                progress->Advance(currentImage.rows);
+            continue;
+        }
+        int currentXPos = placement.x;
+        int currentYPos = placement.y;
+        int bestOverlap = placement.overlap;
+        
+        cv::Rect currentRect(currentXPos, currentYPos, currentImage.cols, currentImage.rows);
+        cv::Mat currentRoi = canvas(currentRect);
+        
+        if (i > 0 && placement.blend) {
+            // Blend the columns this frame shares with the previous one; the
+            // rest of the overlap rows only this frame covers
+            int previousXPos = placements[i - 1].x;
+            int sharedStart = std::max(currentXPos, previousXPos);
+            int sharedEnd = std::min(currentXPos + currentImage.cols, previousXPos + images[i - 1].cols);
+            if (sharedEnd <= sharedStart)
+                sharedStart = sharedEnd = currentXPos;
+            
+            // Gradient weight runs from 0 at the top row to nearly 256 at the bottom
+            size_t pixelBytes = currentImage.elemSize();
+            size_t leftBytes = (size_t)(sharedStart - currentXPos) * pixelBytes;
+            size_t sharedBytes = (size_t)(sharedEnd - sharedStart) * pixelBytes;
+            size_t rowBytes = (size_t)currentImage.cols * pixelBytes;
+            RowTiles::ForEach(bestOverlap, rowBytes, [&](int begin, int end) {
+                for (int y = begin; y < end; y++) {
+                    uint8_t* canvasRow = canvas.ptr<uint8_t>(currentYPos + y) + (size_t)currentXPos * pixelBytes;
+                    const uint8_t* currentRow = currentImage.ptr<uint8_t>(y);
+                    int weight = y * 256 / bestOverlap;
+                    memcpy(canvasRow, currentRow, leftBytes);
+                    PixelKernels::BlendRow(canvasRow + leftBytes, currentRow + leftBytes, canvasRow + leftBytes, sharedBytes, weight);
+                    memcpy(canvasRow + leftBytes + sharedBytes, currentRow + leftBytes + sharedBytes, rowBytes - leftBytes - sharedBytes);
+                }
+            });
+            
+            // Copy non-overlapping part
+            if (bestOverlap < currentImage.rows) {
+                cv::Rect nonOverlapRect(currentXPos, currentYPos + bestOverlap, 
+                                      currentImage.cols, currentImage.rows - bestOverlap);
+                cv::Mat nonOverlapRoi = canvas(nonOverlapRect);
+                cv::Mat currentNonOverlap = currentImage(cv::Rect(0, bestOverlap, 
+                                                                 currentImage.cols, 
+                                                                 currentImage.rows - bestOverlap));
+                RowTiles::Copy(currentNonOverlap, nonOverlapRoi);
+            }
+            
+            TRACE_MESSAGE(TRACE_VERBOSE, "ImageStitcher: Applied gradient blended overlap\n");
+        } else {
+            // No overlap, just place adjacent
+            RowTiles::Copy(currentImage, currentRoi);
+            TRACE_MESSAGE(TRACE_VERBOSE, "ImageStitcher: Placed image without overlap\n");
+        }
+        FrameBuffer::RecordFullCopy();
+        if (progress)
+            progress->Advance(currentImage.rows);
+    }
+    
+    TRACE_MESSAGE(TRACE_VERBOSE, "ImageStitcher: Result now %dx%d\n", canvas.cols, canvas.rows);
+}
+
+
+#ifdef _WIN32
 HBITMAP ImageStitcher::StitchImagesVertically(const std::vector<HBITMAP>& bitmaps) {
     if (bitmaps.empty())
         return NULL;
@@ -560,6 +1262,102 @@ HBITMAP ImageStitcher::StitchImagesVertically(const std::vector<HBITMAP>& bitmap
     return hCombined;
 }
 
+HBITMAP ImageStitcher::CombineVertically(const std::vector<HBITMAP>& bitmaps) {
+    if (bitmaps.empty())
+        return NULL;
+        
+    // Get dimensions from first bitmap
+    BITMAP bmp;
+    GetObject(bitmaps[0], sizeof(BITMAP), &bmp);
+    
+    int width = bmp.bmWidth;
+    int totalHeight = 0;
+    
+    // Calculate total height and find largest width
+    for (auto& hBitmap : bitmaps) {
+        BITMAP bInfo;
+        GetObject(hBitmap, sizeof(BITMAP), &bInfo);
+        totalHeight += bInfo.bmHeight;
+        
+        // Use the largest width we find
+        if (bInfo.bmWidth > width) {
+            width = bInfo.bmWidth;
+        }
+    }
+    
+    // Debug output
+    TRACE_MESSAGE(TRACE_VERBOSE, "Creating combined bitmap with dimensions: %dx%d\n", width, totalHeight);
+    
+    // Create DC for combined bitmap
+    HDC hdcScreen = GetDC(NULL);
+    HDC hdcMem = CreateCompatibleDC(hdcScreen);
+    
+    // Create combined bitmap
+    HBITMAP hCombined = CreateCompatibleBitmap(hdcScreen, width, totalHeight);
+    HGDIOBJ hOldBitmap = SelectObject(hdcMem, hCombined);
+    
+    // Fill with white background
+    RECT rect = { 0, 0, width, totalHeight };
+    FillRect(hdcMem, &rect, (HBRUSH)GetStockObject(WHITE_BRUSH));
+    
+    // Copy each bitmap into combined bitmap
+    int yPos = 0;
+    for (size_t i = 0; i < bitmaps.size(); i++) {
+        BITMAP bInfo;
+        GetObject(bitmaps[i], sizeof(BITMAP), &bInfo);
+        
+        HDC hdcBitmap = CreateCompatibleDC(hdcScreen);
+        HGDIOBJ hOldBmp = SelectObject(hdcBitmap, bitmaps[i]);
+        
+        // Copy bitmap centered horizontally if widths differ
+        int xOffset = (width - bInfo.bmWidth) / 2;
+        if (xOffset < 0) xOffset = 0;
+        
+        // Use StretchBlt if bitmaps are different sizes
+        if (bInfo.bmWidth != width) {
+            // Scale while maintaining aspect ratio
+            StretchBlt(
+                hdcMem, xOffset, yPos, bInfo.bmWidth, bInfo.bmHeight,
+                hdcBitmap, 0, 0, bInfo.bmWidth, bInfo.bmHeight, 
+                SRCCOPY
+            );
+        } else {
+            // Use regular BitBlt if no scaling needed
+            BitBlt(
+                hdcMem, xOffset, yPos, bInfo.bmWidth, bInfo.bmHeight,
+                hdcBitmap, 0, 0, SRCCOPY
+            );
+        }
+        
+        // Add a subtle separator line between screenshots (except for the last one)
+        if (i < bitmaps.size() - 1) {
+            HPEN separatorPen = CreatePen(PS_DOT, 1, RGB(200, 200, 200));
+            HGDIOBJ oldPen = SelectObject(hdcMem, separatorPen);
+            
+            MoveToEx(hdcMem, 0, yPos + bInfo.bmHeight - 1, NULL);
+            LineTo(hdcMem, width, yPos + bInfo.bmHeight - 1);
+            
+            SelectObject(hdcMem, oldPen);
+            DeleteObject(separatorPen);
+        }
+        
+        // Clean up
+        SelectObject(hdcBitmap, hOldBmp);
+        DeleteDC(hdcBitmap);
+        
+        // Move down for the next bitmap
+        yPos += bInfo.bmHeight;
+    }
+    
+    // Clean up
+    SelectObject(hdcMem, hOldBitmap);
+    DeleteDC(hdcMem);
+    ReleaseDC(NULL, hdcScreen);
+    
+    return hCombined;
+}
+
+
 cv::Mat ImageStitcher::HBitmapToMat(HBITMAP hBitmap) {
     // Get bitmap information
     BITMAP bm;
@@ -572,51 +1370,42 @@ cv::Mat ImageStitcher::HBitmapToMat(HBITMAP hBitmap) {
     // Select the bitmap into the device context
     HBITMAP hOldBitmap = (HBITMAP)SelectObject(hdcMem, hBitmap);
     
-    // Create a temporary bitmap with 32-bit color depth
+    // Read 24-bit bitmaps at their own depth and expand them with the
+    // kernels; GDI converts every other depth to 32-bit itself
+    int bitCount = bm.bmBitsPixel == 24 ? 24 : 32;
     BITMAPINFO bi = { 0 };
     bi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
     bi.bmiHeader.biWidth = bm.bmWidth;
     bi.bmiHeader.biHeight = -bm.bmHeight;  // Negative for top-down
     bi.bmiHeader.biPlanes = 1;
-    bi.bmiHeader.biBitCount = 32;  // 4 channels (RGBA)
+    bi.bmiHeader.biBitCount = (WORD)bitCount;
     bi.bmiHeader.biCompression = BI_RGB;
     
-    // Create a buffer for pixel data
-    std::vector<BYTE> buffer(bm.bmWidth * bm.bmHeight * 4);
-    
-    // Get the bitmap bits
-    GetDIBits(hdcMem, hBitmap, 0, bm.bmHeight, buffer.data(), &bi, DIB_RGB_COLORS);
+    cv::Mat result(bm.bmHeight, bm.bmWidth, CV_8UC4);
+    if (bitCount == 32) {
+        // Read the bits straight into the Mat's storage (continuous, 4-byte aligned rows)
+        GetDIBits(hdcMem, hBitmap, 0, bm.bmHeight, result.data, &bi, DIB_RGB_COLORS);
+    } else {
+        ScratchArena::Scope scratch(ScratchArena::ForThread());
+        size_t stride = PixelKernels::DibStride(bm.bmWidth, 24);
+        uint8_t* bits = ScratchArena::ForThread().AllocateArray<uint8_t>(stride * bm.bmHeight);
+        GetDIBits(hdcMem, hBitmap, 0, bm.bmHeight, bits, &bi, DIB_RGB_COLORS);
+        RowTiles::ConvertRows<PixelFormat::BGR, PixelFormat::BGRA>(bits, stride, result.data, result.step,
+                                                                   bm.bmWidth, bm.bmHeight);
+    }
+    FrameBuffer::RecordFullCopy();
     
     // Clean up
     SelectObject(hdcMem, hOldBitmap);
     DeleteDC(hdcMem);
     ReleaseDC(NULL, hdcScreen);
     
-    // Create cv::Mat from the buffer (BGRA format)
-    cv::Mat mat(bm.bmHeight, bm.bmWidth, CV_8UC4, buffer.data());
-    
-    // Make a deep copy of the data
-    cv::Mat result;
-    mat.copyTo(result);
-    
     return result;
 }
 
 HBITMAP ImageStitcher::MatToHBitmap(const cv::Mat& mat) {
-    // Convert to BGR (24-bit) for better Paint compatibility
-    cv::Mat bgr;
-    
-    if (mat.type() == CV_8UC4) {
-        // Convert BGRA to BGR (remove alpha channel)
-        cv::cvtColor(mat, bgr, cv::COLOR_BGRA2BGR);
-    } 
-    else if (mat.type() == CV_8UC3) {
-        bgr = mat;
-    }
-    else if (mat.channels() == 1) {
-        cv::cvtColor(mat, bgr, cv::COLOR_GRAY2BGR);
-    }
-    else {
+    // Output is BGR (24-bit) for better Paint compatibility
+    if (mat.type() != CV_8UC4 && mat.type() != CV_8UC3 && mat.type() != CV_8UC1) {
         // Unsupported format, return NULL
         return NULL;
     }
@@ -624,8 +1413,8 @@ HBITMAP ImageStitcher::MatToHBitmap(const cv::Mat& mat) {
     // Create the bitmap info header for 24-bit BGR
     BITMAPINFO bi = { 0 };
     bi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-    bi.bmiHeader.biWidth = bgr.cols;
-    bi.bmiHeader.biHeight = -bgr.rows;  // Negative for top-down
+    bi.bmiHeader.biWidth = mat.cols;
+    bi.bmiHeader.biHeight = -mat.rows;  // Negative for top-down
     bi.bmiHeader.biPlanes = 1;
     bi.bmiHeader.biBitCount = 24;  // 3 channels (BGR), no alpha
     bi.bmiHeader.biCompression = BI_RGB;
@@ -638,16 +1427,21 @@ HBITMAP ImageStitcher::MatToHBitmap(const cv::Mat& mat) {
     HBITMAP hBitmap = CreateDIBSection(hdcScreen, &bi, DIB_RGB_COLORS, &pBits, NULL, 0);
     
     if (hBitmap && pBits) {
-        // Calculate the stride for 24-bit bitmap (must be 4-byte aligned)
-        int stride = ((bgr.cols * 3 + 3) / 4) * 4;
-        
-        // Copy the pixel data line by line, handling stride alignment
-        for (int y = 0; y < bgr.rows; y++) {
-            memcpy((BYTE*)pBits + y * stride, bgr.ptr<BYTE>(y), bgr.cols * 3);
+        // Convert directly into the DIB memory, whose rows are padded to 4 bytes
+        uint8_t* dib = (uint8_t*)pBits;
+        size_t stride = PixelKernels::DibStride(mat.cols, 24);
+        if (mat.type() == CV_8UC4) {
+            RowTiles::ConvertRows<PixelFormat::BGRA, PixelFormat::BGR>(mat.data, mat.step, dib, stride, mat.cols, mat.rows);
+        } else if (mat.type() == CV_8UC3) {
+            RowTiles::ConvertRows<PixelFormat::BGR, PixelFormat::BGR>(mat.data, mat.step, dib, stride, mat.cols, mat.rows);
+        } else {
+            RowTiles::ConvertRows<PixelFormat::Gray, PixelFormat::BGR>(mat.data, mat.step, dib, stride, mat.cols, mat.rows);
         }
+        FrameBuffer::RecordFullCopy();
     }
     
     ReleaseDC(NULL, hdcScreen);
     
     return hBitmap;
-}
\ No newline at end of file
+}
+#endif
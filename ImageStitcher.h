@@ -1,30 +1,162 @@
 #pragma once
 
+#ifdef _WIN32
 #include <Windows.h>
+#endif
+#include "DynamicMask.h"
+#include "Frame.h"
+#include "MotionPredictor.h"
+#include "SideColumns.h"
+#include "StitchingMethod.h"
+#include <memory>
 #include <vector>
 // OpenCV 4 headers
 #include <opencv2/core.hpp>
 #include <opencv2/imgproc.hpp>
 #include <opencv2/features2d.hpp>
 #include <opencv2/calib3d.hpp>
-#include <opencv2/xfeatures2d.hpp>
+
+class ProgressReporter;
+
+// Which overlap estimators AlignFrames may use
+enum class OverlapEstimator {
+	Auto,       // Feature matching, then template matching; seams neither trusts go to the global pass
+	Features,   // ORB feature matching only, then the conservative guess
+	Template,   // Template matching only, then the conservative guess
+	Global,     // Row-signature candidates for every pair, chosen jointly by the global pass
+	Cascade     // Cheapest first: exact row match, row-signature correlation, then as Auto (StitchingMethod::Auto)
+};
+
+// How a frame's overlap was decided
+enum class OverlapSource {
+	None,           // First frame, or no comparison was possible
+	Exact,          // The only overlap whose rows match byte for byte
+	Signature,      // Row-signature correlation with a clear best overlap
+	Features,       // ORB + RANSAC displacement
+	Template,       // Template matching score above threshold
+	Global,         // Chosen among row-signature candidates by the global pass (GlobalAlignment.h)
+	Index,          // Found elsewhere in the session by the row-hash index (RowHashIndex.h)
+	Conservative    // No estimator was trusted; a typical scroll distance was assumed
+};
+
+// Where a frame lands on the composed canvas
+struct FramePlacement {
+	int x = 0;            // Left column of the frame on the canvas
+	int y = 0;            // Top row of the frame on the canvas
+	int overlap = 0;      // Rows shared with the previous frame
+	bool blend = false;   // Gradient-blend the overlap instead of overwriting it
+	OverlapSource source = OverlapSource::None;
+	int searched = 0;     // Offsets the estimators examined (rows of the current frame, for feature matching)
+	bool duplicate = false;   // Every row is already on the canvas; the frame is not composed
+	double ms = 0;        // Time the estimators spent on this pair
+	int rejected = 0;     // Proposed overlaps that failed pixel verification
+	int drift = 0;        // Columns the content moved right since the previous frame (ColumnDrift.h)
+};
+
+// Seams each overlap source decided in a session, and the estimator time
+// those seams took. Indexed by OverlapSource.
+struct OverlapSourceStats {
+	static const int kSources = (int)OverlapSource::Conservative + 1;
+	int pairs[kSources] = {};
+	double ms[kSources] = {};
+
+	// Count every frame after the first
+	void Add(const std::vector<FramePlacement>& placements);
+};
+
+// What PruneFrames dropped before composition
+struct PruneStats {
+	int framesPruned = 0;
+	long long rowsSkipped = 0;    // Rows of the pruned frames
+	long long rowsComposed = 0;   // Rows of the frames that are still composed
+	double msSaved = 0;           // Estimated composition time saved; see RecordComposeTime
+
+	// Estimate the time saved from how long composing the kept rows took
+	void RecordComposeTime(double composeMs) {
+		msSaved = rowsComposed > 0 ? composeMs * (double)rowsSkipped / (double)rowsComposed : 0;
+	}
+};
 
 // Class to stitch multiple images together using OpenCV
 class ImageStitcher {
 public:
+#ifdef _WIN32
 	// Stitch multiple bitmaps vertically with feature detection
 		// Returns the resulting HBITMAP if successful, NULL if failed
 	static HBITMAP StitchImagesWithFeatureMatching(const std::vector<HBITMAP>& bitmaps);
+#endif
+
+	// Stitch already-converted BGRA frames with feature detection
+	// Returns the composed canvas; throws on OpenCV errors
+	static cv::Mat StitchMatsWithFeatureMatching(const std::vector<cv::Mat>& images);
 
+	// Stitch captured frames without copying them onto a newly allocated
+	// canvas that carries the first frame's FrameInfo. Static
+	// side columns are cropped or taken from the first frame, per sideColumns.
+	// Returns an empty frame if nothing could be stitched
+	static Frame StitchFrames(const std::vector<Frame>& frames,
+	                          ProgressReporter* progress = nullptr,
+	                          const DynamicMask* mask = nullptr,
+	                          OverlapEstimator estimator = OverlapEstimator::Auto,
+	                          SideColumnMode sideColumns = SideColumnMode::FirstFrame);
+
+	// Estimate where every frame goes without touching any pixels of the
+	// output. Dynamic regions of the mask are left out, and `sides`, if given,
+	// receives the static side columns left out of every estimate. Throws
+	// OperationCancelled once the progress reporter's token is cancelled.
+	static std::vector<FramePlacement> AlignFrames(const std::vector<cv::Mat>& frames,
+	                                               OverlapEstimator estimator = OverlapEstimator::Auto,
+	                                               ProgressReporter* progress = nullptr,
+	                                               const DynamicMask* mask = nullptr,
+	                                               SideColumns* sides = nullptr);
+
+	// Drop duplicate frames, and frames whose rows are all covered by the kept
+	// frames before and after them, where those two overlap by at least
+	// `margin` rows. Frames are kept in order; the kept frames' overlaps are
+	// recomputed against their new predecessors and their y is unchanged, so
+	// CanvasSize is the same and static content composes to the same pixels.
+	// Frames of a different width or x than their neighbours are never dropped.
+	// Returns the original indices of the kept frames.
+	static std::vector<size_t> PruneFrames(std::vector<cv::Mat>& images, std::vector<FramePlacement>& placements,
+	                                       PruneStats* stats = nullptr, int margin = 32);
+
+	// Size of the canvas needed to hold the frames at the given placements
+	static cv::Size CanvasSize(const std::vector<cv::Mat>& images, const std::vector<FramePlacement>& placements);
+
+	// Write every frame into a canvas at least CanvasSize() large at its (x, y),
+	// blending overlaps where a frame shares columns with its predecessor.
+	// Duplicate frames are skipped.
+	// Reports the Composing stage and checks for cancellation between frames.
+	static void ComposeFrames(const std::vector<cv::Mat>& images, const std::vector<FramePlacement>& placements, cv::Mat& canvas,
+	                          ProgressReporter* progress = nullptr);
+
+#ifdef _WIN32
 	// Stitch multiple bitmaps vertically using a simple approach
 	// Returns the resulting HBITMAP if successful, NULL if failed
 	static HBITMAP StitchImagesVertically(const std::vector<HBITMAP>& bitmaps);
 
+	// Combine bitmaps top to bottom with GDI, centering narrower ones (StitchingMethod::Simple)
+	// Returns the resulting HBITMAP if successful, NULL if failed
+	static HBITMAP CombineVertically(const std::vector<HBITMAP>& bitmaps);
+#endif
+
 private:
+	// Find the overlap between two consecutive frames with feature matching,
+	// falling back to template matching and then a conservative guess. The
+	// cascade first tries an exact row match and row-signature correlation,
+	// each decided only when it leaves no doubt. Every proposed overlap must
+	// also match pixel for pixel within a tolerance, or the next estimator runs.
+	// Each estimator tries the window first and widens when it finds nothing there.
+	static FramePlacement EstimateOverlap(const cv::Mat& previousFrame, const cv::Mat& currentFrame, int composedRows,
+	                                      OverlapEstimator estimator, const SearchWindow& window = SearchWindow(),
+	                                      const DynamicMask* mask = nullptr);
+
+#ifdef _WIN32
 	// Convert Windows HBITMAP to OpenCV Mat
 	static cv::Mat HBitmapToMat(HBITMAP hBitmap);
 
 	// Convert OpenCV Mat to Windows HBITMAP
 	static HBITMAP MatToHBitmap(const cv::Mat& mat);
+#endif
 
 };
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include "resource.h"
 #include "MainWindow.h"
 #include "ScreenshotService.h" // Include the screenshot service header
+#include "TaskExecutor.h"
 
 #include <cstdio>
 #include <Windows.h>
@@ -59,89 +60,6 @@ namespace
     }
 }
 
-// Queue-based command pattern - most scalable approach
-#include <queue>
-#include <mutex>
-#include <condition_variable>
-#include <functional>
-#include <thread>
-#include <atomic>
-
-enum class ActionType {
-    SCREENSHOT,
-    SCREENSHOT_AREA,
-};
-
-struct Command {
-    ActionType type;
-    std::function<void()> action;
-
-    Command(ActionType t, std::function<void()> a) : type(t), action(std::move(a)) {}
-};
-
-class CommandProcessor {
-private:
-    std::queue<Command> commandQueue;
-    std::mutex queueMutex;
-    std::condition_variable cv;
-    std::thread workerThread;
-    std::atomic<bool> running{ true };
-
-public:
-    CommandProcessor() {
-        workerThread = std::thread(&CommandProcessor::processCommands, this);
-    }
-
-    ~CommandProcessor() {
-        shutdown();
-    }
-
-    void enqueueCommand(ActionType type, std::function<void()> action) {
-        {
-            std::lock_guard<std::mutex> lock(queueMutex);
-            commandQueue.emplace(type, std::move(action));
-        }
-        cv.notify_one();
-    }
-
-    void shutdown() {
-        running = false;
-        cv.notify_all();
-        if (workerThread.joinable()) {
-            workerThread.join();
-        }
-    }
-
-private:
-    void processCommands() {
-        while (running) {
-            std::unique_lock<std::mutex> lock(queueMutex);
-
-            cv.wait(lock, [this] { return !commandQueue.empty() || !running; });
-
-            if (!running) break;
-
-            if (!commandQueue.empty()) {
-                Command cmd = std::move(commandQueue.front());
-                commandQueue.pop();
-                lock.unlock();
-
-                // Execute the command
-                executeCommand(cmd);
-            }
-        }
-    }
-
-    void executeCommand(const Command& cmd) {
-        printf("Executing command type: %d\n", static_cast<int>(cmd.type));
-
-        // Execute the specific action
-        if (cmd.action) {
-            cmd.action();
-        }
-    }
-};
-
 // Action implementations
 class Actions {
 private:
@@ -180,15 +98,18 @@ public:
     }
 };
 
-// Global command processor
-std::unique_ptr<CommandProcessor> g_commandProcessor;
-
 // Global screenshot service
 std::shared_ptr<ScreenshotService> g_screenshotService;
 
 // Store the currently selected stitching method
 StitchingMethod g_currentStitchingMethod = StitchingMethod::OpenCV;
 
+// Store the currently selected handling of static side columns
+SideColumnMode g_currentSideColumnMode = SideColumnMode::FirstFrame;
+
+// Store the currently selected way of scrolling during capture
+CaptureMode g_currentCaptureMode = CaptureMode::StepAndWait;
+
 // Declaration of the CreateScreenshotService function (implemented in ScreenshotService.cpp)
 extern std::shared_ptr<ScreenshotService> CreateScreenshotService(HWND mainWindow, HINSTANCE hInstance);
 
@@ -225,6 +146,18 @@ public:
                   L"Screenshot Cancelled", 
                   MB_OK | MB_ICONINFORMATION);
     }
+    
+    void OnScreenshotCancelled() override {
+        OutputDebugString(L"Screenshot callback: Capture cancelled\n");
+    }
+    
+    void OnProgress(const StitchProgress& progress) override {
+        static const char* stageNames[] = { "aligning", "composing", "encoding" };
+        char message[128];
+        sprintf_s(message, "Screenshot progress: %s %lld/%lld\n",
+                  stageNames[(int)progress.stage], progress.done, progress.total);
+        OutputDebugStringA(message);
+    }
 };
 
 // Handler for the stitching method dropdown selection
@@ -246,6 +179,9 @@ void MainWindow::stitchingMethodChangedHandler(winrt::Windows::Foundation::IInsp
         case 2:  // Simple Stacking
             selectedMethod = StitchingMethod::Simple;
             break;
+        case 3:  // Auto: cheapest alignment first
+            selectedMethod = StitchingMethod::Auto;
+            break;
         default:
             selectedMethod = StitchingMethod::OpenCV;  // Default to OpenCV
     }
@@ -260,6 +196,32 @@ void MainWindow::stitchingMethodChangedHandler(winrt::Windows::Foundation::IInsp
     }
 }
 
+// Handler for the side columns dropdown selection
+void MainWindow::sideColumnModeChangedHandler(winrt::Windows::Foundation::IInspectable const& sender,
+    winrt::Windows::UI::Xaml::Controls::SelectionChangedEventArgs const& args) {
+    
+    auto comboBox = sender.as<winrt::Windows::UI::Xaml::Controls::ComboBox>();
+    g_currentSideColumnMode = comboBox.SelectedIndex() == 1 ? SideColumnMode::Crop : SideColumnMode::FirstFrame;
+    
+    if (g_screenshotService) {
+        OutputDebugString(L"Updating side column mode\n");
+        g_screenshotService->SetSideColumnMode(g_currentSideColumnMode);
+    }
+}
+
+// Handler for the capture mode dropdown selection
+void MainWindow::captureModeChangedHandler(winrt::Windows::Foundation::IInspectable const& sender,
+    winrt::Windows::UI::Xaml::Controls::SelectionChangedEventArgs const& args) {
+    
+    auto comboBox = sender.as<winrt::Windows::UI::Xaml::Controls::ComboBox>();
+    g_currentCaptureMode = comboBox.SelectedIndex() == 1 ? CaptureMode::Continuous : CaptureMode::StepAndWait;
+    
+    if (g_screenshotService) {
+        OutputDebugString(L"Updating capture mode\n");
+        g_screenshotService->SetCaptureMode(g_currentCaptureMode);
+    }
+}
+
 void MainWindow::takeScreenshotHandler(winrt::Windows::Foundation::IInspectable const&,
     winrt::Windows::UI::Xaml::RoutedEventArgs const&) {
     printf("Screenshot button clicked\n");
@@ -330,7 +292,8 @@ int APIENTRY MainWindow::handleWinMain(_In_ HINSTANCE hInstance,
     _In_ int       nCmdShow)
 {
     _hInstance = hInstance;
-    g_commandProcessor = std::make_unique<CommandProcessor>();
+    // Start the task pool's workers now rather than on the first capture
+    TaskExecutor::Shared();
     // The main window class name.
     const wchar_t szWindowClass[] = L"Win32DesktopApp";
     WNDCLASSEX windowClass = { };
@@ -374,6 +337,8 @@ int APIENTRY MainWindow::handleWinMain(_In_ HINSTANCE hInstance,
     
     // Set the default stitching method
     g_screenshotService->SetStitchingMethod(g_currentStitchingMethod);
+    g_screenshotService->SetSideColumnMode(g_currentSideColumnMode);
+    g_screenshotService->SetCaptureMode(g_currentCaptureMode);
 
     // Begin XAML Island section.
 
@@ -443,6 +408,10 @@ int APIENTRY MainWindow::handleWinMain(_In_ HINSTANCE hInstance,
     item3.Content(box_value(L"Simple Stacking"));
     stitchComboBox.Items().Append(item3);
     
+    auto item4 = winrt::Windows::UI::Xaml::Controls::ComboBoxItem();
+    item4.Content(box_value(L"Auto (Cheapest Alignment First)"));
+    stitchComboBox.Items().Append(item4);
+    
     // Set default selection
     stitchComboBox.SelectedIndex(0); // OpenCV feature matching by default
     
@@ -452,6 +421,64 @@ int APIENTRY MainWindow::handleWinMain(_In_ HINSTANCE hInstance,
     stitchingPanel.Children().Append(stitchComboBox);
     xamlContainer.Children().Append(stitchingPanel);
     
+    // Add side column handling: scrollbars and fixed panels beside the scrolled content
+    Windows::UI::Xaml::Controls::StackPanel sidePanel;
+    sidePanel.Orientation(Windows::UI::Xaml::Controls::Orientation::Horizontal);
+    sidePanel.Margin(Windows::UI::Xaml::Thickness{10, 0, 10, 10});
+    sidePanel.HorizontalAlignment(Windows::UI::Xaml::HorizontalAlignment::Center);
+    
+    Windows::UI::Xaml::Controls::TextBlock sideLabel;
+    sideLabel.Text(L"Static Side Columns: ");
+    sideLabel.VerticalAlignment(Windows::UI::Xaml::VerticalAlignment::Center);
+    sideLabel.Margin(Windows::UI::Xaml::Thickness{0, 0, 10, 0});
+    sidePanel.Children().Append(sideLabel);
+    
+    Windows::UI::Xaml::Controls::ComboBox sideComboBox;
+    sideComboBox.Width(200);
+    
+    auto sideItem1 = winrt::Windows::UI::Xaml::Controls::ComboBoxItem();
+    sideItem1.Content(box_value(L"Keep From First Frame"));
+    sideComboBox.Items().Append(sideItem1);
+    
+    auto sideItem2 = winrt::Windows::UI::Xaml::Controls::ComboBoxItem();
+    sideItem2.Content(box_value(L"Crop"));
+    sideComboBox.Items().Append(sideItem2);
+    
+    sideComboBox.SelectedIndex(0); // Keep them, from the first frame, by default
+    sideComboBox.SelectionChanged({ this, &MainWindow::sideColumnModeChangedHandler });
+    
+    sidePanel.Children().Append(sideComboBox);
+    xamlContainer.Children().Append(sidePanel);
+    
+    // Add the capture mode: a notch at a time, or a steady scroll grabbing frames as it goes
+    Windows::UI::Xaml::Controls::StackPanel capturePanel;
+    capturePanel.Orientation(Windows::UI::Xaml::Controls::Orientation::Horizontal);
+    capturePanel.Margin(Windows::UI::Xaml::Thickness{10, 0, 10, 10});
+    capturePanel.HorizontalAlignment(Windows::UI::Xaml::HorizontalAlignment::Center);
+    
+    Windows::UI::Xaml::Controls::TextBlock captureLabel;
+    captureLabel.Text(L"Capture Mode: ");
+    captureLabel.VerticalAlignment(Windows::UI::Xaml::VerticalAlignment::Center);
+    captureLabel.Margin(Windows::UI::Xaml::Thickness{0, 0, 10, 0});
+    capturePanel.Children().Append(captureLabel);
+    
+    Windows::UI::Xaml::Controls::ComboBox captureComboBox;
+    captureComboBox.Width(200);
+    
+    auto captureItem1 = winrt::Windows::UI::Xaml::Controls::ComboBoxItem();
+    captureItem1.Content(box_value(L"Scroll and Wait"));
+    captureComboBox.Items().Append(captureItem1);
+    
+    auto captureItem2 = winrt::Windows::UI::Xaml::Controls::ComboBoxItem();
+    captureItem2.Content(box_value(L"Continuous"));
+    captureComboBox.Items().Append(captureItem2);
+    
+    captureComboBox.SelectedIndex(0); // Scroll and wait by default
+    captureComboBox.SelectionChanged({ this, &MainWindow::captureModeChangedHandler });
+    
+    capturePanel.Children().Append(captureComboBox);
+    xamlContainer.Children().Append(capturePanel);
+    
     // Add description
     Windows::UI::Xaml::Controls::TextBlock descriptionBlock;
     descriptionBlock.Text(L"Capture scrolling screenshots and automatically stitch them together");
@@ -574,6 +601,10 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT messageCode, WPARAM wParam, LPARAM lPar
         }
         break;
     case WM_DESTROY:
+        // Stop a capture still running on the pool so the process can exit promptly
+        if (g_screenshotService) {
+            g_screenshotService->CancelScreenshot();
+        }
         PostQuitMessage(0);
         break;
 
@@ -13,6 +13,8 @@ public:
     BOOL initInstance(HINSTANCE hInstance, int nCmdShow);
     void takeScreenshotHandler(winrt::Windows::Foundation::IInspectable const&, winrt::Windows::UI::Xaml::RoutedEventArgs const&);
     void stitchingMethodChangedHandler(winrt::Windows::Foundation::IInspectable const&, winrt::Windows::UI::Xaml::Controls::SelectionChangedEventArgs const&);
+    void sideColumnModeChangedHandler(winrt::Windows::Foundation::IInspectable const&, winrt::Windows::UI::Xaml::Controls::SelectionChangedEventArgs const&);
+    void captureModeChangedHandler(winrt::Windows::Foundation::IInspectable const&, winrt::Windows::UI::Xaml::Controls::SelectionChangedEventArgs const&);
 
     static HWND _hWnd;
     static HWND _childhWnd;
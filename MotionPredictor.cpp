@@ -0,0 +1,33 @@
+#include "MotionPredictor.h"
+#include <algorithm>
+#include <vector>
+
+MotionPredictor::MotionPredictor(int history, int minRadius, int minSamples)
+    : _history(std::max(1, history)), _minRadius(std::max(0, minRadius)), _minSamples(std::max(1, minSamples)) {}
+
+void MotionPredictor::Record(int step) {
+    if (step <= 0)
+        return;
+    _steps.push_back(step);
+    while ((int)_steps.size() > _history) {
+        _steps.pop_front();
+    }
+}
+
+SearchWindow MotionPredictor::Predict(int previousHeight) const {
+    SearchWindow window;
+    if ((int)_steps.size() < _minSamples)
+        return window;
+
+    std::vector<int> steps(_steps.begin(), _steps.end());
+    std::sort(steps.begin(), steps.end());
+    int median = steps[steps.size() / 2];
+    int center = previousHeight - median;
+    if (center <= 0)
+        return window;
+
+    // Steady scrolling keeps the window at its minimum; uneven steps widen it
+    window.center = center;
+    window.radius = _minRadius + (steps.back() - steps.front());
+    return window;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <deque>
+
+// A range of overlaps to search first: [center - radius, center + radius].
+// An inactive window (no prediction yet) means search everything.
+struct SearchWindow {
+	int center = -1;
+	int radius = 0;
+
+	bool Active() const { return center >= 0; }
+	int Low() const { return center - radius; }
+	int High() const { return center + radius; }
+};
+
+// Predicts the next pair's overlap from the scroll steps measured so far.
+// Wheel scrolling moves a page by nearly the same distance every time, so
+// the median of the last few steps is a good guess and the window around it
+// only needs to be as wide as those steps disagree. Estimators search the
+// window first and widen to their full range only when the match there is poor.
+class MotionPredictor {
+public:
+	explicit MotionPredictor(int history = 5, int minRadius = 8, int minSamples = 2);
+
+	// Add a step (previous frame height - overlap) from a trusted estimate
+	void Record(int step);
+
+	// Window of overlaps for a pair whose first frame is previousHeight rows
+	// tall. Inactive until minSamples steps have been recorded.
+	SearchWindow Predict(int previousHeight) const;
+
+	int Samples() const { return (int)_steps.size(); }
+
+private:
+	int _history;
+	int _minRadius;
+	int _minSamples;
+	std::deque<int> _steps;
+};
@@ -0,0 +1,234 @@
+#include "PixelKernels.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+
+#ifdef PIXEL_KERNELS_X86
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define KERNEL_TARGET(isa)
+#else
+#include <immintrin.h>
+#define KERNEL_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+namespace {
+    // Reflected CRC-32C (Castagnoli) polynomial, the one the CRC32 instruction computes
+    const uint32_t kCrc32cPolynomial = 0x82F63B78u;
+
+    struct CrcTable {
+        uint32_t entries[256];
+
+        CrcTable() {
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t crc = i;
+                for (int bit = 0; bit < 8; bit++) {
+                    crc = (crc >> 1) ^ ((crc & 1) ? kCrc32cPolynomial : 0);
+                }
+                entries[i] = crc;
+            }
+        }
+    };
+
+    void BlendRowScalar(const uint8_t* top, const uint8_t* bottom, uint8_t* dst, size_t bytes, int weight) {
+        int topWeight = 256 - weight;
+        for (size_t i = 0; i < bytes; i++) {
+            dst[i] = (uint8_t)((top[i] * topWeight + bottom[i] * weight + 128) >> 8);
+        }
+    }
+
+    uint64_t AbsDiffSumScalar(const uint8_t* a, const uint8_t* b, size_t bytes) {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < bytes; i++) {
+            sum += (uint64_t)std::abs((int)a[i] - (int)b[i]);
+        }
+        return sum;
+    }
+
+    uint32_t RowHashScalar(const uint8_t* row, size_t bytes) {
+        static const CrcTable table;
+        uint32_t crc = 0xFFFFFFFFu;
+        for (size_t i = 0; i < bytes; i++) {
+            crc = (crc >> 8) ^ table.entries[(crc ^ row[i]) & 0xFF];
+        }
+        return ~crc;
+    }
+
+#ifdef PIXEL_KERNELS_X86
+    KERNEL_TARGET("sse2")
+    void BlendRowSSE2(const uint8_t* top, const uint8_t* bottom, uint8_t* dst, size_t bytes, int weight) {
+        // Products stay below 65536, so 16-bit lanes hold the exact scalar sum
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i topWeight = _mm_set1_epi16((short)(256 - weight));
+        const __m128i bottomWeight = _mm_set1_epi16((short)weight);
+        const __m128i round = _mm_set1_epi16(128);
+        size_t i = 0;
+        for (; i + 16 <= bytes; i += 16) {
+            __m128i a = _mm_loadu_si128((const __m128i*)(top + i));
+            __m128i b = _mm_loadu_si128((const __m128i*)(bottom + i));
+            __m128i low = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), topWeight),
+                                                      _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), bottomWeight)), round);
+            __m128i high = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), topWeight),
+                                                       _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), bottomWeight)), round);
+            _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(_mm_srli_epi16(low, 8), _mm_srli_epi16(high, 8)));
+        }
+        BlendRowScalar(top + i, bottom + i, dst + i, bytes - i, weight);
+    }
+
+    KERNEL_TARGET("sse2")
+    uint64_t AbsDiffSumSSE2(const uint8_t* a, const uint8_t* b, size_t bytes) {
+        __m128i sums = _mm_setzero_si128();
+        size_t i = 0;
+        for (; i + 16 <= bytes; i += 16) {
+            __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+            __m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+            sums = _mm_add_epi64(sums, _mm_sad_epu8(x, y));
+        }
+        uint64_t lanes[2];
+        _mm_storeu_si128((__m128i*)lanes, sums);
+        return lanes[0] + lanes[1] + AbsDiffSumScalar(a + i, b + i, bytes - i);
+    }
+
+    KERNEL_TARGET("sse4.2")
+    uint32_t RowHashSSE42(const uint8_t* row, size_t bytes) {
+        uint32_t crc = 0xFFFFFFFFu;
+        size_t i = 0;
+#if defined(_M_X64) || defined(__x86_64__)
+        uint64_t crc64 = crc;
+        for (; i + 8 <= bytes; i += 8) {
+            uint64_t word;
+            memcpy(&word, row + i, sizeof(word));
+            crc64 = _mm_crc32_u64(crc64, word);
+        }
+        crc = (uint32_t)crc64;
+#endif
+        for (; i + 4 <= bytes; i += 4) {
+            uint32_t word;
+            memcpy(&word, row + i, sizeof(word));
+            crc = _mm_crc32_u32(crc, word);
+        }
+        for (; i < bytes; i++) {
+            crc = _mm_crc32_u8(crc, row[i]);
+        }
+        return ~crc;
+    }
+
+    KERNEL_TARGET("avx2")
+    void BlendRowAVX2(const uint8_t* top, const uint8_t* bottom, uint8_t* dst, size_t bytes, int weight) {
+        // Unpack and pack both work within 128-bit lanes, so byte order survives
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i topWeight = _mm256_set1_epi16((short)(256 - weight));
+        const __m256i bottomWeight = _mm256_set1_epi16((short)weight);
+        const __m256i round = _mm256_set1_epi16(128);
+        size_t i = 0;
+        for (; i + 32 <= bytes; i += 32) {
+            __m256i a = _mm256_loadu_si256((const __m256i*)(top + i));
+            __m256i b = _mm256_loadu_si256((const __m256i*)(bottom + i));
+            __m256i low = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(a, zero), topWeight),
+                                                            _mm256_mullo_epi16(_mm256_unpacklo_epi8(b, zero), bottomWeight)), round);
+            __m256i high = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(a, zero), topWeight),
+                                                             _mm256_mullo_epi16(_mm256_unpackhi_epi8(b, zero), bottomWeight)), round);
+            _mm256_storeu_si256((__m256i*)(dst + i), _mm256_packus_epi16(_mm256_srli_epi16(low, 8), _mm256_srli_epi16(high, 8)));
+        }
+        BlendRowSSE2(top + i, bottom + i, dst + i, bytes - i, weight);
+    }
+
+    KERNEL_TARGET("avx2")
+    uint64_t AbsDiffSumAVX2(const uint8_t* a, const uint8_t* b, size_t bytes) {
+        __m256i sums = _mm256_setzero_si256();
+        size_t i = 0;
+        for (; i + 32 <= bytes; i += 32) {
+            __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+            __m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+            sums = _mm256_add_epi64(sums, _mm256_sad_epu8(x, y));
+        }
+        uint64_t lanes[4];
+        _mm256_storeu_si256((__m256i*)lanes, sums);
+        return lanes[0] + lanes[1] + lanes[2] + lanes[3] + AbsDiffSumSSE2(a + i, b + i, bytes - i);
+    }
+#endif
+
+    SimdLevel DetectLevel() {
+#if !defined(PIXEL_KERNELS_X86)
+        return SimdLevel::Scalar;
+#else
+        bool sse2 = false, sse42 = false, avx2 = false;
+#if defined(_MSC_VER) && !defined(__clang__)
+        int info[4];
+        __cpuid(info, 0);
+        int maxLeaf = info[0];
+        __cpuid(info, 1);
+        sse2 = (info[3] & (1 << 26)) != 0;
+        sse42 = (info[2] & (1 << 20)) != 0;
+        // AVX2 also needs the OS to save YMM registers
+        bool osSavesYmm = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+        if (maxLeaf >= 7 && osSavesYmm) {
+            __cpuidex(info, 7, 0);
+            avx2 = (info[1] & (1 << 5)) != 0;
+        }
+#else
+        __builtin_cpu_init();
+        sse2 = __builtin_cpu_supports("sse2");
+        sse42 = __builtin_cpu_supports("sse4.2");
+        avx2 = __builtin_cpu_supports("avx2");
+#endif
+        if (avx2 && sse42)
+            return SimdLevel::AVX2;
+        if (sse42 && sse2)
+            return SimdLevel::SSE42;
+        return sse2 ? SimdLevel::SSE2 : SimdLevel::Scalar;
+#endif
+    }
+
+    // -1 until the first kernel call picks BestLevel()
+    std::atomic<int> s_level(-1);
+}
+
+SimdLevel PixelKernels::BestLevel() {
+    static const SimdLevel best = DetectLevel();
+    return best;
+}
+
+SimdLevel PixelKernels::Level() {
+    int level = s_level.load(std::memory_order_relaxed);
+    return level < 0 ? BestLevel() : (SimdLevel)level;
+}
+
+void PixelKernels::SetLevel(SimdLevel level) {
+    s_level.store((int)std::min(level, BestLevel()), std::memory_order_relaxed);
+}
+
+const char* PixelKernels::LevelName(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::SSE2:
+        return "sse2";
+    case SimdLevel::SSE42:
+        return "sse4.2";
+    case SimdLevel::AVX2:
+        return "avx2";
+    default:
+        return "scalar";
+    }
+}
+
+bool PixelKernels::SimdConversions() {
+#ifdef PIXEL_KERNELS_SSSE3
+    return true;
+#else
+    return false;
+#endif
+}
+
+const PixelKernels::Table& PixelKernels::Active() {
+    static const Table tables[] = {
+        { BlendRowScalar, AbsDiffSumScalar, RowHashScalar },
+#ifdef PIXEL_KERNELS_X86
+        { BlendRowSSE2, AbsDiffSumSSE2, RowHashScalar },
+        { BlendRowSSE2, AbsDiffSumSSE2, RowHashSSE42 },
+        { BlendRowAVX2, AbsDiffSumAVX2, RowHashSSE42 },
+#endif
+    };
+    size_t index = std::min((size_t)Level(), sizeof(tables) / sizeof(tables[0]) - 1);
+    return tables[index];
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PIXEL_KERNELS_X86 1
+#endif
+// Format conversions pick their SIMD version when the compiler targets it
+// (/arch:AVX2, -mssse3 and up); the other kernels dispatch at runtime
+#if defined(PIXEL_KERNELS_X86) && (defined(__SSSE3__) || defined(__AVX2__))
+#define PIXEL_KERNELS_SSSE3 1
+#include <immintrin.h>
+#endif
+
+// 8-bit pixel layouts. BGR and BGRA match DIBs and cv::Mat; RGB is PNG's order.
+enum class PixelFormat {
+	Gray,
+	BGR,
+	BGRA,
+	RGB
+};
+
+// Instruction sets the runtime-dispatched kernels have versions for, in
+// increasing order. SSE42 adds the CRC32 instruction RowHash uses.
+enum class SimdLevel {
+	Scalar,
+	SSE2,
+	SSE42,
+	AVX2
+};
+
+// Row kernels shared by capture conversion, stitching and output.
+// Every SIMD version produces exactly the bytes the scalar one does.
+class PixelKernels {
+public:
+	static constexpr int Channels(PixelFormat format) {
+		return format == PixelFormat::Gray ? 1 : format == PixelFormat::BGRA ? 4 : 3;
+	}
+
+	// Bytes per row of a DIB: rows are padded to a multiple of 4 bytes
+	static size_t DibStride(int width, int bitsPerPixel) {
+		return (((size_t)width * bitsPerPixel + 31) / 32) * 4;
+	}
+
+	// Convert `width` pixels. Alpha is written as 255; gray uses OpenCV's
+	// fixed-point BT.601 weights, so it matches cv::COLOR_BGR2GRAY.
+	template <PixelFormat Src, PixelFormat Dst>
+	static void ConvertRow(const uint8_t* src, uint8_t* dst, int width);
+
+	// Convert `rows` rows between buffers of any stride (a padded 24-bit DIB,
+	// a cv::Mat ROI). Equal formats copy.
+	template <PixelFormat Src, PixelFormat Dst>
+	static void ConvertRows(const uint8_t* src, size_t srcStride, uint8_t* dst, size_t dstStride, int width, int rows) {
+		for (int y = 0; y < rows; y++) {
+			ConvertRow<Src, Dst>(src + y * srcStride, dst + y * dstStride, width);
+		}
+	}
+
+	// dst = (top * (256 - weight) + bottom * weight + 128) >> 8, byte by byte.
+	// weight runs 0..256; dst may alias top or bottom.
+	static void BlendRow(const uint8_t* top, const uint8_t* bottom, uint8_t* dst, size_t bytes, int weight) {
+		Active().blendRow(top, bottom, dst, bytes, weight);
+	}
+
+	// Sum of absolute byte differences
+	static uint64_t AbsDiffSum(const uint8_t* a, const uint8_t* b, size_t bytes) {
+		return Active().absDiffSum(a, b, bytes);
+	}
+
+	// CRC-32C of a row, with the CRC32 instruction where there is one
+	static uint32_t RowHash(const uint8_t* row, size_t bytes) {
+		return Active().rowHash(row, bytes);
+	}
+
+	// Widest level this CPU supports, and the level the kernels run at.
+	// SetLevel clamps to BestLevel; tests and benchmarks use it to compare versions.
+	static SimdLevel BestLevel();
+	static SimdLevel Level();
+	static void SetLevel(SimdLevel level);
+	static const char* LevelName(SimdLevel level);
+
+	// Whether the format conversions were compiled with SIMD
+	static bool SimdConversions();
+
+private:
+	struct Table {
+		void (*blendRow)(const uint8_t*, const uint8_t*, uint8_t*, size_t, int);
+		uint64_t (*absDiffSum)(const uint8_t*, const uint8_t*, size_t);
+		uint32_t (*rowHash)(const uint8_t*, size_t);
+	};
+
+	static const Table& Active();
+};
+
+template <PixelFormat Src, PixelFormat Dst>
+void PixelKernels::ConvertRow(const uint8_t* src, uint8_t* dst, int width) {
+	constexpr int srcChannels = Channels(Src);
+	constexpr int dstChannels = Channels(Dst);
+	if constexpr (Src == Dst) {
+		memcpy(dst, src, (size_t)width * srcChannels);
+	} else {
+		for (int x = 0; x < width; x++) {
+			const uint8_t* in = src + x * srcChannels;
+			uint8_t* out = dst + x * dstChannels;
+			uint8_t b, g, r;
+			if constexpr (Src == PixelFormat::Gray) {
+				b = g = r = in[0];
+			} else if constexpr (Src == PixelFormat::RGB) {
+				r = in[0]; g = in[1]; b = in[2];
+			} else {
+				b = in[0]; g = in[1]; r = in[2];
+			}
+
+			if constexpr (Dst == PixelFormat::Gray) {
+				out[0] = (uint8_t)((b * 1868 + g * 9617 + r * 4899 + 8192) >> 14);
+			} else if constexpr (Dst == PixelFormat::RGB) {
+				out[0] = r; out[1] = g; out[2] = b;
+			} else {
+				out[0] = b; out[1] = g; out[2] = r;
+				if constexpr (Dst == PixelFormat::BGRA)
+					out[3] = 255;
+			}
+		}
+	}
+}
+
+#ifdef PIXEL_KERNELS_SSSE3
+// BGRA -> BGR and BGRA -> RGB drop alpha with one shuffle per four pixels.
+// Each store writes 16 bytes for 12, so the last pixels go through the scalar loop.
+template <>
+inline void PixelKernels::ConvertRow<PixelFormat::BGRA, PixelFormat::BGR>(const uint8_t* src, uint8_t* dst, int width) {
+	const __m128i shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	int x = 0;
+	for (; x + 6 <= width; x += 4) {
+		__m128i pixels = _mm_loadu_si128((const __m128i*)(src + x * 4));
+		_mm_storeu_si128((__m128i*)(dst + x * 3), _mm_shuffle_epi8(pixels, shuffle));
+	}
+	for (; x < width; x++) {
+		dst[x * 3 + 0] = src[x * 4 + 0];
+		dst[x * 3 + 1] = src[x * 4 + 1];
+		dst[x * 3 + 2] = src[x * 4 + 2];
+	}
+}
+
+template <>
+inline void PixelKernels::ConvertRow<PixelFormat::BGRA, PixelFormat::RGB>(const uint8_t* src, uint8_t* dst, int width) {
+	const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	int x = 0;
+	for (; x + 6 <= width; x += 4) {
+		__m128i pixels = _mm_loadu_si128((const __m128i*)(src + x * 4));
+		_mm_storeu_si128((__m128i*)(dst + x * 3), _mm_shuffle_epi8(pixels, shuffle));
+	}
+	for (; x < width; x++) {
+		dst[x * 3 + 0] = src[x * 4 + 2];
+		dst[x * 3 + 1] = src[x * 4 + 1];
+		dst[x * 3 + 2] = src[x * 4 + 0];
+	}
+}
+
+// BGR -> BGRA reads 16 bytes for 12, so it also stops short of the row's end
+template <>
+inline void PixelKernels::ConvertRow<PixelFormat::BGR, PixelFormat::BGRA>(const uint8_t* src, uint8_t* dst, int width) {
+	const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+	int x = 0;
+	for (; x + 6 <= width; x += 4) {
+		__m128i pixels = _mm_loadu_si128((const __m128i*)(src + x * 3));
+		_mm_storeu_si128((__m128i*)(dst + x * 4), _mm_or_si128(_mm_shuffle_epi8(pixels, shuffle), alpha));
+	}
+	for (; x < width; x++) {
+		dst[x * 4 + 0] = src[x * 3 + 0];
+		dst[x * 4 + 1] = src[x * 3 + 1];
+		dst[x * 4 + 2] = src[x * 3 + 2];
+		dst[x * 4 + 3] = 255;
+	}
+}
+#endif
@@ -0,0 +1,312 @@
+#include "PngStripEncoder.h"
+#include "PixelKernels.h"
+#include "StitchProgress.h"
+#include "TaskExecutor.h"
+#include "TiledCanvas.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <functional>
+
+#include <zlib.h>
+
+namespace {
+    // Deflate window size; also the amount of history carried between strips
+    const size_t kDictionarySize = 32768;
+
+    // PNG row filter type used for every row. "Up" is cheap, vectorizes well and
+    // compresses flat screenshot content (blank gutters, repeated rows) very well.
+    const uint8_t kFilterUp = 2;
+
+    // Filtered bytes per block: rows are filtered and deflated a block at a
+    // time, with cancellation checks and progress reports in between.
+    // Feeding deflate in blocks does not change its output.
+    const size_t kDeflateBlockSize = 256 * 1024;
+
+    // Where the encoder reads source rows from. Dense images hand out row
+    // pointers directly; tiled canvases expand each row into the scratch buffer.
+    struct RowSource {
+        int width = 0;
+        int height = 0;
+        int channels = 0;
+        std::function<const uint8_t*(int y, uint8_t* scratch)> row;
+    };
+
+    struct Strip {
+        int firstRow = 0;
+        int rowCount = 0;
+        std::vector<uint8_t> compressed;  // raw deflate data ending on a byte boundary
+        uLong adler = 1;                  // Adler-32 of the strip's filtered rows
+        bool ok = false;
+    };
+
+    // Run fn(index) for every index in [0, count) on up to threadCount threads of the task pool
+    void ParallelFor(int count, int threadCount, const std::function<void(int)>& fn) {
+        TaskExecutor::Current().ParallelFor(count, fn, threadCount);
+    }
+
+    // Convert one source row to the PNG sample order (RGB or gray)
+    void ConvertRow(const RowSource& source, int y, uint8_t* scratch, uint8_t* out) {
+        const uint8_t* src = source.row(y, scratch);
+        int channels = source.channels;
+        if (channels == 1)
+            PixelKernels::ConvertRow<PixelFormat::Gray, PixelFormat::Gray>(src, out, source.width);
+        else if (channels == 3)
+            PixelKernels::ConvertRow<PixelFormat::BGR, PixelFormat::RGB>(src, out, source.width);
+        else
+            PixelKernels::ConvertRow<PixelFormat::BGRA, PixelFormat::RGB>(src, out, source.width);
+    }
+
+    // Converts and filters rows in order, keeping the row above for the Up filter
+    class RowFilter {
+    public:
+        explicit RowFilter(const RowSource& source)
+            : _source(source), _rowBytes((size_t)source.width * (source.channels == 1 ? 1 : 3)),
+              _prev(_rowBytes, 0), _cur(_rowBytes), _scratch((size_t)source.width * source.channels) {}
+
+        size_t FilteredRowBytes() const { return _rowBytes + 1; }
+
+        // Start at row y; the row above it is read again for the filter
+        void Seek(int y) {
+            if (y > 0)
+                ConvertRow(_source, y - 1, _scratch.data(), _prev.data());
+            else
+                std::fill(_prev.begin(), _prev.end(), 0);
+            _next = y;
+        }
+
+        // Filter the next `rows` rows into out (filter byte + filtered scanline, per row)
+        void Filter(int rows, uint8_t* out) {
+            for (int r = 0; r < rows; r++) {
+                ConvertRow(_source, _next++, _scratch.data(), _cur.data());
+                *out++ = kFilterUp;
+                for (size_t i = 0; i < _rowBytes; i++) {
+                    out[i] = (uint8_t)(_cur[i] - _prev[i]);
+                }
+                out += _rowBytes;
+                _prev.swap(_cur);
+            }
+        }
+
+    private:
+        const RowSource& _source;
+        size_t _rowBytes;
+        std::vector<uint8_t> _prev, _cur, _scratch;
+        int _next = 0;
+    };
+
+    // Filter and deflate one strip as a raw stream, a block of rows at a time,
+    // so only one block of filtered rows exists per worker. The dictionary is
+    // the tail of the previous strip's filtered rows (previousRows of them),
+    // filtered again here. Non-final strips end with a sync flush so the next
+    // strip's output can be appended directly. Stops early, leaving strip.ok
+    // false, if progress is cancelled.
+    void EncodeStrip(const RowSource& source, Strip& strip, int previousRows, bool last, int level,
+                     ProgressReporter* progress) {
+        z_stream zs = {};
+        if (deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return;
+        }
+
+        RowFilter filter(source);
+        size_t rowBytes = filter.FilteredRowBytes();
+        std::vector<uint8_t> block;
+        if (strip.firstRow > 0 && previousRows > 0) {
+            int dictionaryRows = std::min(previousRows, (int)((kDictionarySize + rowBytes - 1) / rowBytes));
+            block.resize(dictionaryRows * rowBytes);
+            filter.Seek(strip.firstRow - dictionaryRows);
+            filter.Filter(dictionaryRows, block.data());
+            size_t dictionarySize = std::min(kDictionarySize, block.size());
+            deflateSetDictionary(&zs, block.data() + block.size() - dictionarySize, (uInt)dictionarySize);
+        } else {
+            filter.Seek(strip.firstRow);
+        }
+
+        // deflateBound covers Z_FINISH; a sync flush adds at most a few bytes
+        size_t total = strip.rowCount * rowBytes;
+        strip.compressed.resize(deflateBound(&zs, (uLong)total) + 16);
+        zs.next_out = strip.compressed.data();
+        zs.avail_out = (uInt)strip.compressed.size();
+
+        // Every block but the last is fed without flushing; the output buffer
+        // is large enough that deflate always consumes a whole block
+        int blockRows = std::max(1, (int)(kDeflateBlockSize / rowBytes));
+        block.resize(std::min(blockRows, strip.rowCount) * rowBytes);
+        uLong adler = adler32(0L, Z_NULL, 0);
+        bool ok = true;
+        for (int r = 0; ok && r < strip.rowCount; r += blockRows) {
+            if (progress && progress->IsCancelled()) {
+                ok = false;
+                break;
+            }
+            int rows = std::min(blockRows, strip.rowCount - r);
+            size_t bytes = rows * rowBytes;
+            filter.Filter(rows, block.data());
+            adler = adler32(adler, block.data(), (uInt)bytes);
+
+            bool lastBlock = r + rows == strip.rowCount;
+            zs.next_in = block.data();
+            zs.avail_in = (uInt)bytes;
+            int ret = deflate(&zs, !lastBlock ? Z_NO_FLUSH : last ? Z_FINISH : Z_SYNC_FLUSH);
+            ok = !lastBlock ? (ret == Z_OK && zs.avail_in == 0)
+               : last ? (ret == Z_STREAM_END) : (ret == Z_OK && zs.avail_in == 0 && zs.avail_out > 0);
+            if (progress)
+                progress->Advance((long long)bytes);
+        }
+
+        strip.compressed.resize(zs.total_out);
+        deflateEnd(&zs);
+        strip.adler = adler;
+        strip.ok = ok;
+    }
+
+    void PutU32(std::vector<uint8_t>& out, uint32_t value) {
+        out.push_back((uint8_t)(value >> 24));
+        out.push_back((uint8_t)(value >> 16));
+        out.push_back((uint8_t)(value >> 8));
+        out.push_back((uint8_t)value);
+    }
+
+    // Append a chunk whose payload is prefix + body + suffix (any may be empty)
+    void PutChunk(std::vector<uint8_t>& out, const char type[4],
+                  const uint8_t* prefix, size_t prefixSize,
+                  const uint8_t* body, size_t bodySize,
+                  const uint8_t* suffix = nullptr, size_t suffixSize = 0) {
+        PutU32(out, (uint32_t)(prefixSize + bodySize + suffixSize));
+        size_t typeOffset = out.size();
+        out.insert(out.end(), type, type + 4);
+        if (prefixSize) out.insert(out.end(), prefix, prefix + prefixSize);
+        if (bodySize) out.insert(out.end(), body, body + bodySize);
+        if (suffixSize) out.insert(out.end(), suffix, suffix + suffixSize);
+        uLong crc = crc32(0L, Z_NULL, 0);
+        crc = crc32(crc, out.data() + typeOffset, (uInt)(out.size() - typeOffset));
+        PutU32(out, (uint32_t)crc);
+    }
+
+    // Filter, compress and frame every strip of the source into a PNG file image
+    std::vector<uint8_t> EncodeRows(const RowSource& image, const PngEncodeOptions& options) {
+        int threadCount = options.threadCount > 0 ? options.threadCount : TaskExecutor::Current().WorkerCount();
+        int level = std::min(9, std::max(1, options.compressionLevel));
+
+        // Two strips per worker keeps cores busy when strips compress at different speeds
+        int rowsPerStrip = options.rowsPerStrip;
+        if (rowsPerStrip <= 0) {
+            int stripCount = threadCount == 1 ? 1 : threadCount * 2;
+            rowsPerStrip = (image.height + stripCount - 1) / stripCount;
+        }
+        rowsPerStrip = std::max(1, rowsPerStrip);
+
+        std::vector<Strip> strips;
+        for (int y = 0; y < image.height; y += rowsPerStrip) {
+            Strip strip;
+            strip.firstRow = y;
+            strip.rowCount = std::min(rowsPerStrip, image.height - y);
+            strips.push_back(std::move(strip));
+        }
+        int stripCount = (int)strips.size();
+
+        // Each strip's dictionary depends only on the tail of the previous
+        // strip's filtered rows, which its worker filters again, so strips are
+        // filtered and compressed in one pass and never wait on each other
+        size_t filteredRowBytes = (size_t)image.width * (image.channels == 1 ? 1 : 3) + 1;
+        ProgressReporter* progress = options.progress;
+        if (progress)
+            progress->BeginStage(StitchStage::Encoding, (long long)(filteredRowBytes * image.height));
+        ParallelFor(stripCount, threadCount, [&](int i) {
+            EncodeStrip(image, strips[i], i > 0 ? strips[i - 1].rowCount : 0, i == stripCount - 1, level, progress);
+        });
+        if (progress)
+            progress->ThrowIfCancelled();
+
+        uLong adler = adler32(0L, Z_NULL, 0);
+        size_t compressedTotal = 0;
+        for (const auto& strip : strips) {
+            if (!strip.ok) {
+                return {};
+            }
+            adler = adler32_combine(adler, strip.adler, (z_off_t)(strip.rowCount * filteredRowBytes));
+            compressedTotal += strip.compressed.size();
+        }
+
+        std::vector<uint8_t> png;
+        png.reserve(compressedTotal + 128 + stripCount * 12);
+
+        static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+        png.insert(png.end(), signature, signature + 8);
+
+        uint8_t ihdr[13];
+        ihdr[0] = (uint8_t)(image.width >> 24); ihdr[1] = (uint8_t)(image.width >> 16);
+        ihdr[2] = (uint8_t)(image.width >> 8);  ihdr[3] = (uint8_t)image.width;
+        ihdr[4] = (uint8_t)(image.height >> 24); ihdr[5] = (uint8_t)(image.height >> 16);
+        ihdr[6] = (uint8_t)(image.height >> 8);  ihdr[7] = (uint8_t)image.height;
+        ihdr[8] = 8;                                   // bit depth
+        ihdr[9] = image.channels == 1 ? 0 : 2;       // gray or RGB
+        ihdr[10] = 0;                                  // deflate
+        ihdr[11] = 0;                                  // adaptive filtering
+        ihdr[12] = 0;                                  // no interlace
+        PutChunk(png, "IHDR", ihdr, sizeof(ihdr), nullptr, 0);
+
+        // zlib header (32K window, default compression) goes in front of the first
+        // strip, the combined Adler-32 after the last one
+        static const uint8_t zlibHeader[2] = { 0x78, 0x9C };
+        uint8_t zlibTrailer[4] = {
+            (uint8_t)(adler >> 24), (uint8_t)(adler >> 16), (uint8_t)(adler >> 8), (uint8_t)adler
+        };
+        for (int i = 0; i < stripCount; i++) {
+            bool first = i == 0;
+            bool last = i == stripCount - 1;
+            PutChunk(png, "IDAT",
+                     first ? zlibHeader : nullptr, first ? sizeof(zlibHeader) : 0,
+                     strips[i].compressed.data(), strips[i].compressed.size(),
+                     last ? zlibTrailer : nullptr, last ? sizeof(zlibTrailer) : 0);
+        }
+
+        PutChunk(png, "IEND", nullptr, 0, nullptr, 0);
+        return png;
+    }
+}
+
+std::vector<uint8_t> PngStripEncoder::Encode(const cv::Mat& image, const PngEncodeOptions& options) {
+    if (image.empty() || image.depth() != CV_8U ||
+        (image.channels() != 1 && image.channels() != 3 && image.channels() != 4)) {
+        return {};
+    }
+
+    RowSource source;
+    source.width = image.cols;
+    source.height = image.rows;
+    source.channels = image.channels();
+    source.row = [&image](int y, uint8_t*) { return image.ptr<uint8_t>(y); };
+    return EncodeRows(source, options);
+}
+
+std::vector<uint8_t> PngStripEncoder::Encode(const TiledCanvas& canvas, const PngEncodeOptions& options) {
+    if (canvas.Empty()) {
+        return {};
+    }
+
+    // Tiles are only expanded a row at a time inside each strip worker
+    RowSource source;
+    source.width = canvas.Width();
+    source.height = canvas.Height();
+    source.channels = canvas.Channels();
+    source.row = [&canvas](int y, uint8_t* scratch) {
+        canvas.ExpandRow(y, scratch);
+        return (const uint8_t*)scratch;
+    };
+    return EncodeRows(source, options);
+}
+
+bool PngStripEncoder::EncodeToFile(const cv::Mat& image, const std::string& path, const PngEncodeOptions& options) {
+    std::vector<uint8_t> png = Encode(image, options);
+    if (png.empty()) {
+        return false;
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(png.data()), (std::streamsize)png.size());
+    return (bool)file;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+// OpenCV 4 headers
+#include <opencv2/core.hpp>
+
+class ProgressReporter;
+class TiledCanvas;
+
+// Options for the strip-parallel PNG encoder
+struct PngEncodeOptions {
+	int threadCount = 0;        // Strips deflated at once on the task pool; 0 = every worker
+	int compressionLevel = 6;   // zlib level, 1 (fast) to 9 (small)
+	int rowsPerStrip = 0;       // 0 = pick automatically from the thread count
+	ProgressReporter* progress = nullptr;   // Optional; gets the Encoding stage and may cancel it
+};
+
+// Encodes a composed canvas to PNG by splitting it into horizontal strips.
+// Strips are deflated as task-pool work at the caller's priority and each ends on a sync flush, so the
+// strips concatenate into one zlib stream; each strip is written as its own
+// IDAT chunk. Strips after the first are primed with the previous strip's
+// last 32 KB, so the output is nearly as small as a single-threaded encode.
+// Each worker filters and deflates its strip 256 KB at a time, so no
+// filtered copy of the whole image is ever held.
+class PngStripEncoder {
+public:
+	// Encode a CV_8UC4 (BGRA), CV_8UC3 (BGR) or CV_8UC1 image.
+	// Color images are written as 24-bit RGB (alpha is dropped, like MatToHBitmap).
+	// Returns an empty buffer if the image format is unsupported or zlib fails.
+	// Throws OperationCancelled, within about one 256 KB block per strip, once
+	// options.progress is cancelled.
+	static std::vector<uint8_t> Encode(const cv::Mat& image, const PngEncodeOptions& options = PngEncodeOptions());
+
+	// Encode a deduplicated canvas; tiles are expanded row by row inside each strip, so the dense canvas never exists
+	static std::vector<uint8_t> Encode(const TiledCanvas& canvas, const PngEncodeOptions& options = PngEncodeOptions());
+
+	// Encode and write to disk. Returns false on any failure; a cancelled
+	// encode throws before the file is created.
+	static bool EncodeToFile(const cv::Mat& image, const std::string& path, const PngEncodeOptions& options = PngEncodeOptions());
+};
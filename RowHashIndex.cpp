@@ -0,0 +1,131 @@
+#include "RowHashIndex.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cstdlib>
+
+namespace {
+    const uint64_t kFnvOffset = 1469598103934665603ULL;
+    const uint64_t kFnvPrime = 1099511628211ULL;
+
+    // Signature levels are hashed at 1/8 resolution, so rendering noise of a
+    // level or two rarely changes a row's hash
+    const int kLevelShift = 3;
+}
+
+RowHashIndex::RowHashIndex(int runLength, int maxPositions)
+    : _runLength(std::max(1, runLength)), _maxPositions(std::max(1, maxPositions)) {}
+
+uint64_t RowHashIndex::RowHash(const uint8_t* signature) const {
+    uint64_t hash = kFnvOffset;
+    for (int bin = 0; bin < _bins; bin++) {
+        hash = (hash ^ (uint64_t)(signature[bin] >> kLevelShift)) * kFnvPrime;
+    }
+    return hash;
+}
+
+bool RowHashIndex::RunHash(const std::vector<uint64_t>& hashes, int first, uint64_t& hash) const {
+    hash = kFnvOffset;
+    bool varied = false;
+    for (int r = first; r < first + _runLength; r++) {
+        hash = (hash ^ hashes[r]) * kFnvPrime;
+        varied = varied || hashes[r] != hashes[first];
+    }
+    return varied;
+}
+
+void RowHashIndex::Append(const cv::Mat& frameSignatures, int y) {
+    if (frameSignatures.empty())
+        return;
+    if (_bins == 0)
+        _bins = frameSignatures.cols;
+    if (frameSignatures.cols != _bins)
+        return;
+
+    // Rows above the canvas bottom are already indexed; a gap, which the
+    // stitcher never produces, would be filled with the frame's first row
+    int oldRows = _rows;
+    int newRows = y + frameSignatures.rows;
+    if (newRows <= oldRows)
+        return;
+    _signatures.resize((size_t)newRows * _bins);
+    _rowHashes.resize(newRows);
+    for (int row = oldRows; row < newRows; row++) {
+        int frameRow = std::max(0, row - y);
+        const uint8_t* source = frameSignatures.ptr<uint8_t>(frameRow);
+        std::copy(source, source + _bins, _signatures.begin() + (size_t)row * _bins);
+        _rowHashes[row] = RowHash(source);
+    }
+    _rows = newRows;
+
+    // Every run that now ends on a new row
+    for (int first = std::max(0, oldRows - _runLength + 1); first + _runLength <= _rows; first++) {
+        uint64_t hash;
+        if (!RunHash(_rowHashes, first, hash))
+            continue;
+        std::vector<int>& positions = _runs[hash];
+        // One past the limit marks the run as repetitive; more add nothing
+        if ((int)positions.size() <= _maxPositions)
+            positions.push_back(first);
+    }
+}
+
+IndexMatch RowHashIndex::Locate(const cv::Mat& frameSignatures, double maxCost) const {
+    TRACE_SPAN(TRACE_DEBUG, "IndexLocate");
+    IndexMatch match;
+    if (_rows == 0 || frameSignatures.cols != _bins || frameSignatures.rows < _runLength)
+        return match;
+
+    std::vector<uint64_t> hashes(frameSignatures.rows);
+    for (int row = 0; row < frameSignatures.rows; row++) {
+        hashes[row] = RowHash(frameSignatures.ptr<uint8_t>(row));
+    }
+
+    // Each distinctive run votes for the frame top its canvas positions imply
+    std::unordered_map<int, int> votes;
+    int informative = 0;
+    for (int first = 0; first + _runLength <= frameSignatures.rows; first++) {
+        uint64_t hash;
+        if (!RunHash(hashes, first, hash))
+            continue;
+        informative++;
+        auto found = _runs.find(hash);
+        if (found == _runs.end() || (int)found->second.size() > _maxPositions)
+            continue;
+        for (int position : found->second) {
+            votes[position - first]++;
+        }
+    }
+
+    // Ties go to the lower canvas position, the most recent content
+    for (const auto& entry : votes) {
+        if (entry.second > match.votes || (entry.second == match.votes && entry.first > match.y)) {
+            match.y = entry.first;
+            match.votes = entry.second;
+        }
+    }
+    if (match.votes < std::max(4, informative / 8))
+        return match;
+
+    match.cost = Cost(frameSignatures, match.y);
+    match.found = match.cost <= maxCost;
+    return match;
+}
+
+double RowHashIndex::Cost(const cv::Mat& frameSignatures, int y) const {
+    if (frameSignatures.cols != _bins || _bins == 0)
+        return 255.0;
+    int first = std::max(0, y);
+    int last = std::min(_rows, y + frameSignatures.rows);
+    if (last - first < _runLength)
+        return 255.0;
+
+    long long sum = 0;
+    for (int row = first; row < last; row++) {
+        const uint8_t* canvas = &_signatures[(size_t)row * _bins];
+        const uint8_t* frame = frameSignatures.ptr<uint8_t>(row - y);
+        for (int bin = 0; bin < _bins; bin++) {
+            sum += std::abs((int)canvas[bin] - (int)frame[bin]);
+        }
+    }
+    return (double)sum / ((double)(last - first) * _bins);
+}
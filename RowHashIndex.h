@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+// OpenCV 4 headers
+#include <opencv2/core.hpp>
+
+// Where RowHashIndex::Locate found a frame
+struct IndexMatch {
+	bool found = false;
+	int y = 0;          // Canvas row the frame's top lands on; may be above the canvas bottom or negative
+	int votes = 0;      // Row runs that agreed on y
+	double cost = 255;  // Mean absolute row-signature difference over the rows shared with the canvas
+};
+
+// Whole-session index of the composed canvas: row signatures
+// (GlobalAlignment::RowSignatures) of every canvas row, and a hash map from
+// each run of consecutive row signatures to the canvas rows it starts at.
+// Appending a frame indexes only the rows it adds below the canvas, and
+// locating a frame looks up each of its runs once, so both take expected
+// time linear in the frame height. This lets a frame be placed anywhere in
+// the session rather than only after its predecessor: scroll-back, loops and
+// re-rendered content land where they were first seen.
+class RowHashIndex {
+public:
+	// runLength: rows hashed together. Runs that start at more than
+	// maxPositions canvas rows are repetitive and ignored when locating.
+	explicit RowHashIndex(int runLength = 8, int maxPositions = 8);
+
+	// Add a frame placed with its top at canvas row y; only its rows below
+	// the current canvas bottom are new. Frames must share one signature width.
+	void Append(const cv::Mat& frameSignatures, int y);
+
+	// Canvas rows indexed so far
+	int Rows() const { return _rows; }
+
+	// Vote over the frame's row runs for where its top lands on the canvas.
+	// found is set when enough runs agree and the rows shared with the canvas
+	// match within maxCost.
+	IndexMatch Locate(const cv::Mat& frameSignatures, double maxCost = 2.0) const;
+
+	// Mean absolute signature difference between the frame placed at y and
+	// the canvas rows it covers; 255 if it covers fewer than runLength rows
+	double Cost(const cv::Mat& frameSignatures, int y) const;
+
+private:
+	uint64_t RowHash(const uint8_t* signature) const;
+	// Hash of rows [first, first + runLength) of `hashes`; false for a run of
+	// identical rows, which says nothing about position
+	bool RunHash(const std::vector<uint64_t>& hashes, int first, uint64_t& hash) const;
+
+	int _runLength;
+	int _maxPositions;
+	int _bins = 0;
+	int _rows = 0;
+	std::vector<uint8_t> _signatures;   // _rows x _bins
+	std::vector<uint64_t> _rowHashes;
+	std::unordered_map<uint64_t, std::vector<int>> _runs;
+};
@@ -0,0 +1,64 @@
+#include "RowTiles.h"
+#include "TaskExecutor.h"
+#include "Trace.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+namespace {
+    // Target work per band: large enough to amortize claiming it, small
+    // enough that the bands even out between faster and slower workers
+    const size_t kBandBytes = (size_t)512 << 10;
+
+    // Bands per thread taking part, at most
+    const int kBandsPerThread = 4;
+
+    std::atomic<size_t> s_minBytes(RowTiles::kDefaultMinBytes);
+    std::atomic<long long> s_tiledPasses(0);
+}
+
+void RowTiles::ForEach(int rows, size_t rowBytes, const std::function<void(int, int)>& fn) {
+    if (rows <= 0)
+        return;
+    size_t bytes = (size_t)rows * rowBytes;
+    TaskExecutor& executor = TaskExecutor::Current();
+    int bands = 1;
+    if (bytes >= MinBytes()) {
+        size_t byBytes = std::max<size_t>(1, bytes / kBandBytes);
+        size_t byThreads = (size_t)(executor.WorkerCount() + 1) * kBandsPerThread;
+        bands = (int)std::min({ byBytes, byThreads, (size_t)rows });
+    }
+    if (bands <= 1) {
+        fn(0, rows);
+        return;
+    }
+
+    TRACE_SPAN(TRACE_DEBUG, "RowTiles");
+    s_tiledPasses.fetch_add(1, std::memory_order_relaxed);
+    executor.ParallelFor(bands, [&](int band) {
+        int begin = (int)((long long)rows * band / bands);
+        int end = (int)((long long)rows * (band + 1) / bands);
+        fn(begin, end);
+    });
+}
+
+void RowTiles::Copy(const cv::Mat& src, cv::Mat& dst) {
+    size_t rowBytes = (size_t)src.cols * src.elemSize();
+    ForEach(src.rows, rowBytes, [&](int begin, int end) {
+        for (int y = begin; y < end; y++) {
+            memcpy(dst.ptr<uint8_t>(y), src.ptr<uint8_t>(y), rowBytes);
+        }
+    });
+}
+
+size_t RowTiles::MinBytes() {
+    return s_minBytes.load(std::memory_order_relaxed);
+}
+
+void RowTiles::SetMinBytes(size_t bytes) {
+    s_minBytes.store(bytes, std::memory_order_relaxed);
+}
+
+long long RowTiles::TiledPasses() {
+    return s_tiledPasses.load(std::memory_order_relaxed);
+}
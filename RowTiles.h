@@ -0,0 +1,45 @@
+#pragma once
+
+#include "PixelKernels.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+// OpenCV 4 headers
+#include <opencv2/core.hpp>
+
+// Splits a per-frame pixel pass (gray conversion, blending, copying,
+// conversion back to BGR) into bands of whole rows and runs the bands on the
+// calling thread's task pool, with the caller working through bands too.
+// Bands write disjoint rows, so the row kernels run on them unchanged and the
+// output is identical to a single-threaded pass. Passes smaller than
+// MinBytes() stay on the calling thread: below it, waking workers costs more
+// than it saves. `StitchTool width-bench` measures the crossover.
+class RowTiles {
+public:
+	// A 1920 x 1080 BGRA frame (8 MB) is tiled; a 1000 x 700 one (2.7 MB) is not
+	static constexpr size_t kDefaultMinBytes = (size_t)4 << 20;
+
+	// Run fn(begin, end) over bands of rows covering [0, rows), where each row
+	// holds rowBytes bytes of work. Every band runs exactly once.
+	static void ForEach(int rows, size_t rowBytes, const std::function<void(int, int)>& fn);
+
+	// PixelKernels::ConvertRows, a band of rows at a time
+	template <PixelFormat Src, PixelFormat Dst>
+	static void ConvertRows(const uint8_t* src, size_t srcStride, uint8_t* dst, size_t dstStride, int width, int rows) {
+		ForEach(rows, (size_t)width * PixelKernels::Channels(Src), [=](int begin, int end) {
+			PixelKernels::ConvertRows<Src, Dst>(src + begin * srcStride, srcStride, dst + begin * dstStride, dstStride,
+			                                    width, end - begin);
+		});
+	}
+
+	// src.copyTo(dst) for a destination of the same size and type, such as a canvas ROI
+	static void Copy(const cv::Mat& src, cv::Mat& dst);
+
+	// Smallest pass, in bytes, that is split into bands. Benchmarks and tests
+	// set 0 to always tile or SIZE_MAX to never tile.
+	static size_t MinBytes();
+	static void SetMinBytes(size_t bytes);
+
+	// Passes split into more than one band since the process started
+	static long long TiledPasses();
+};
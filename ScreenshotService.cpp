@@ -1,7 +1,15 @@
 #include "ScreenshotService.h"
+#include "CaptureSession.h"
 #include "ImageStitcher.h"
-#include <thread>
-#include <chrono>
+#include "Frame.h"
+#include "FrameBuffer.h"
+#include "FramePool.h"
+#include "PixelKernels.h"
+#include "RowTiles.h"
+#include "StitchProgress.h"
+#include "TaskExecutor.h"
+#include "Trace.h"
+#include <mutex>
 #include <vector>
 #include <algorithm> // For min, max functions
 
@@ -9,6 +17,41 @@
 using std::min;
 using std::max;
 
+// Posted to the overlay window when a capture task finishes; wParam is a CaptureOutcome
+#define WM_CAPTURE_COMPLETE (WM_APP + 1)
+
+// Overlay timer that shows the overlay once the main window has had time to minimize
+#define OVERLAY_REVEAL_TIMER 1
+#define OVERLAY_REVEAL_DELAY_MS 300
+
+// Hotkey the overlay holds while a capture runs, so Esc cancels it even
+// though the overlay is hidden and another window has focus
+#define CANCEL_CAPTURE_HOTKEY 1
+
+// Idle pooled frame bytes kept once a capture run ends, about four 1080p
+// frames; the rest of the session's frames go back to the system
+const size_t kIdleFrameBytesAfterCapture = (size_t)32 * 1024 * 1024;
+
+enum CaptureOutcome {
+    CaptureFailed = 0,
+    CaptureSucceeded = 1,
+    CaptureCancelled = 2
+};
+
+// Convert a frame into a bottom-up 24-bit DIB: source row y lands on DIB row
+// height - 1 - y. Bands of rows run on the task pool, as in RowTiles::ConvertRows.
+template <PixelFormat Src>
+static void ConvertToBottomUpDib(const FrameBuffer& frame, uint8_t* dib, size_t dibStride) {
+    int width = frame.Width();
+    int height = frame.Height();
+    RowTiles::ForEach(height, (size_t)width * PixelKernels::Channels(Src), [&](int begin, int end) {
+        for (int y = begin; y < end; y++) {
+            PixelKernels::ConvertRow<Src, PixelFormat::BGR>(frame.Data() + y * frame.Stride(),
+                                                           dib + (size_t)(height - 1 - y) * dibStride, width);
+        }
+    });
+}
+
 // Implementation of the ScreenshotService
 class ScreenshotServiceImpl : public ScreenshotService {
 public:
@@ -35,26 +78,20 @@ public:
             _overlayWnd = nullptr;
         }
         
-        // Wait for the window to minimize
-        std::this_thread::sleep_for(std::chrono::milliseconds(300));
-        
         // Register window class for overlay
         RegisterOverlayClass();
         
-        // Create overlay window
+        // Create overlay window, hidden until the main window has minimized
         _overlayWnd = CreateOverlayWindow();
         
         if (_overlayWnd) {
             // Store this instance in window's user data for the static proc
             SetWindowLongPtr(_overlayWnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(this));
             
-            // Show and focus the overlay window
-            ::ShowWindow(_overlayWnd, SW_SHOW);
-            ::UpdateWindow(_overlayWnd);
-            ::SetForegroundWindow(_overlayWnd);
-            ::SetFocus(_overlayWnd);
+            // Show it from WM_TIMER rather than sleeping here, so the message loop keeps running
+            SetTimer(_overlayWnd, OVERLAY_REVEAL_TIMER, OVERLAY_REVEAL_DELAY_MS, NULL);
             
-            OutputDebugString(L"Screenshot overlay created and shown\n");
+            OutputDebugString(L"Screenshot overlay created\n");
         } else {
             OutputDebugString(L"Failed to create screenshot overlay\n");
             ::ShowWindow(_mainWindow, SW_RESTORE);
@@ -69,6 +106,23 @@ public:
         _stitchingMethod = method;
     }
     
+    void SetSideColumnMode(SideColumnMode mode) override {
+        _sideColumnMode = mode;
+    }
+    
+    void SetCaptureMode(CaptureMode mode) override {
+        _captureMode = mode;
+    }
+    
+    void CancelScreenshot() override {
+        _cancel.Cancel();
+        
+        // Step the session now instead of when its current wait ends
+        if (_capture) {
+            _capture->Wake();
+        }
+    }
+    
     LRESULT HandleOverlayWindowMessage(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam) override {
         switch (message) {
         case WM_CREATE:
@@ -81,6 +135,21 @@ public:
             SetCursor(LoadCursor(NULL, IDC_CROSS));
             return TRUE;
             
+        case WM_TIMER:
+            if (wParam == OVERLAY_REVEAL_TIMER) {
+                KillTimer(hWnd, OVERLAY_REVEAL_TIMER);
+                
+                // Show and focus the overlay window
+                ::ShowWindow(hWnd, SW_SHOW);
+                ::UpdateWindow(hWnd);
+                ::SetForegroundWindow(hWnd);
+                ::SetFocus(hWnd);
+                
+                OutputDebugString(L"Screenshot overlay shown\n");
+                return 0;
+            }
+            break;
+            
         case WM_LBUTTONDOWN:
             // Start selection
             _isSelecting = true;
@@ -113,24 +182,22 @@ public:
                 
                 // Check if selection is large enough
                 if (width > 10 && height > 10) {
-                    // Hide overlay before capturing
+                    // Hide overlay before capturing; the session waits for it to
+                    // disappear before taking the first frame
                     ::ShowWindow(_overlayWnd, SW_HIDE);
                     
-                    // Process pending messages
-                    MSG msg;
-                    while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
-                        TranslateMessage(&msg);
-                        DispatchMessage(&msg);
-                    }
-                    
-                    // Wait for overlay to hide
-                    std::this_thread::sleep_for(std::chrono::milliseconds(200));
-                    
                     // Create selection area
                     ScreenshotArea area = { left, top, width, height };
                     
-                    // Take scrolling screenshots
-                    CaptureScrollingScreenshot(area);
+                    // Capture and stitch on the task pool so this window keeps pumping
+                    // messages; the result comes back as WM_CAPTURE_COMPLETE. Each
+                    // session gets a fresh token so an earlier cancel does not carry over.
+                    _cancel = CancellationToken();
+                    _capture = std::make_shared<CaptureRun>(*this, area, _overlayWnd, _cancel);
+                    if (!RegisterHotKey(_overlayWnd, CANCEL_CAPTURE_HOTKEY, MOD_NOREPEAT, VK_ESCAPE)) {
+                        TRACE_MESSAGE(TRACE_INFO, "Esc is taken by another app; the capture cannot be cancelled with it\n");
+                    }
+                    _capture->Start();
                 } else {
                     // Selection too small, cancel
                     ::DestroyWindow(_overlayWnd);
@@ -173,7 +240,34 @@ public:
             }
             break;
             
+        case WM_HOTKEY:
+            if (wParam == CANCEL_CAPTURE_HOTKEY && _capture) {
+                TRACE_MESSAGE(TRACE_INFO, "Capture cancelled with Esc\n");
+                CancelScreenshot();
+                return 0;
+            }
+            break;
+            
+        case WM_CAPTURE_COMPLETE:
+            // Back on the window's thread: tear down the overlay and report
+            UnregisterHotKey(hWnd, CANCEL_CAPTURE_HOTKEY);
+            _capture.reset();
+            ::DestroyWindow(_overlayWnd);
+            _overlayWnd = nullptr;
+            
+            ::ShowWindow(_mainWindow, SW_RESTORE);
+            
+            if (_callback) {
+                if (wParam == CaptureCancelled) {
+                    _callback->OnScreenshotCancelled();
+                } else {
+                    _callback->OnScreenshotCaptured(wParam == CaptureSucceeded);
+                }
+            }
+            return 0;
+            
         case WM_DESTROY:
+            UnregisterHotKey(hWnd, CANCEL_CAPTURE_HOTKEY);
             _overlayWnd = nullptr;
             return 0;
         }
@@ -207,7 +301,7 @@ private:
             WS_EX_TOPMOST | WS_EX_LAYERED | WS_EX_TOOLWINDOW,
             L"ScrollingScreenshotOverlay",
             L"Scrolling Screenshot",
-            WS_POPUP | WS_VISIBLE,
+            WS_POPUP,
             0, 0, screenWidth, screenHeight,
             NULL, NULL, _hInstance, NULL
         );
@@ -301,237 +395,354 @@ private:
         }
     }
     
-    // Capture a series of screenshots while scrolling
-    void CaptureScrollingScreenshot(const ScreenshotArea& area) {
-        OutputDebugString(L"Starting scrolling screenshot capture\n");
+    // Captures the selected screen area and scrolls the window under it
+    class ScreenCaptureSource : public CaptureFrameSource {
+    public:
+        ScreenCaptureSource(ScreenshotServiceImpl& service, const ScreenshotArea& area)
+            : _service(service), _area(area), _targetWindow(NULL) {
+            // Scroll at the center of the selected area
+            _point.x = area.left + area.width / 2;
+            _point.y = area.top + area.height / 2;
+        }
+        
+        Frame CaptureFrame() override {
+            return _service.CaptureAreaToFrame(_area);
+        }
         
-        // Vector to store all screenshot bitmaps
-        std::vector<HBITMAP> screenshots;
+        bool FindScrollTarget() override {
+            _targetWindow = _service.FindScrollableWindow(_point);
+            return _targetWindow != NULL;
+        }
+        
+        void BeginScroll() override {
+            // Try multiple approaches to scrolling
+            
+            // Approach 1: Direct message to the window
+            SendMessage(_targetWindow, WM_MOUSEWHEEL, MAKEWPARAM(0, -WHEEL_DELTA), MAKELPARAM(_point.x, _point.y));
+            
+            // Approach 2: Try posting the message
+            PostMessage(_targetWindow, WM_MOUSEWHEEL, MAKEWPARAM(0, -WHEEL_DELTA), MAKELPARAM(_point.x, _point.y));
+            
+            // Approach 3 (InjectScroll): SendInput for more reliable scrolling.
+            // First, bring the window to the foreground and move the mouse over it
+            SetForegroundWindow(_targetWindow);
+            SetCursorPos(_point.x, _point.y);
+        }
+        
+        void InjectScroll() override {
+            // Simulate a mouse wheel scroll
+            INPUT input = {0};
+            input.type = INPUT_MOUSE;
+            input.mi.dwFlags = MOUSEEVENTF_WHEEL;
+            input.mi.mouseData = -WHEEL_DELTA;
+            SendInput(1, &input, sizeof(INPUT));
+        }
+        
+    private:
+        ScreenshotServiceImpl& _service;
+        ScreenshotArea _area;
+        POINT _point;
+        HWND _targetWindow;
+    };
+    
+    // One capture session in flight. Each step of the session runs as an
+    // Interactive task on the pool; between steps a thread-pool timer waits
+    // for the session's next deadline, so no thread sleeps. The last step
+    // stitches the frames and posts WM_CAPTURE_COMPLETE to the overlay.
+    class CaptureRun : public std::enable_shared_from_this<CaptureRun> {
+    public:
+        CaptureRun(ScreenshotServiceImpl& service, const ScreenshotArea& area, HWND overlay, const CancellationToken& cancel)
+            : _service(service), _source(service, area), _session(_source, _clock, Timing(service._captureMode), cancel),
+              _overlay(overlay), _cancel(cancel) {
+            _timer = CreateThreadpoolTimer(OnTimer, this, NULL);
+        }
+        
+        ~CaptureRun() {
+            if (_timer) {
+                // Cancel a pending expiry and wait out a callback already running
+                SetThreadpoolTimer(_timer, NULL, 0, 0);
+                WaitForThreadpoolTimerCallbacks(_timer, TRUE);
+                CloseThreadpoolTimer(_timer);
+            }
+        }
+        
+        void Start() {
+            Trace::BeginSession();
+            TRACE_MESSAGE(TRACE_INFO, "Starting scrolling screenshot capture\n");
+            Wake();
+        }
+        
+        // Run the next step as soon as a worker is free
+        void Wake() {
+            std::weak_ptr<CaptureRun> self = weak_from_this();
+            TaskExecutor::Shared().Post(TaskPriority::Interactive, [self]() {
+                if (std::shared_ptr<CaptureRun> run = self.lock()) {
+                    run->Step();
+                }
+            });
+        }
+        
+    private:
+        static CaptureTiming Timing(CaptureMode mode) {
+            CaptureTiming timing;
+            timing.mode = mode;
+            return timing;
+        }
+        
+        static void CALLBACK OnTimer(PTP_CALLBACK_INSTANCE, PVOID context, PTP_TIMER) {
+            // Only queue the step here: the last reference must never be dropped
+            // on the timer's own callback, whose destructor waits for it
+            static_cast<CaptureRun*>(context)->Wake();
+        }
+        
+        void Step() {
+            // A cancel can wake the session while a timer-driven step is running
+            std::lock_guard<std::mutex> lock(_stepMutex);
+            if (_completed)
+                return;
+            
+            CaptureOutcome outcome;
+            if (!_timer) {
+                TRACE_MESSAGE(TRACE_INFO, "Could not create the capture timer\n");
+                outcome = CaptureFailed;
+            } else {
+                int64_t waitMs = _session.Poll();
+                if (waitMs > 0) {
+                    // Negative due times are relative, in 100 ns units
+                    ULARGE_INTEGER due;
+                    due.QuadPart = (ULONGLONG)(-waitMs * 10000);
+                    FILETIME dueTime;
+                    dueTime.dwLowDateTime = due.LowPart;
+                    dueTime.dwHighDateTime = due.HighPart;
+                    SetThreadpoolTimer(_timer, &dueTime, 0, 0);
+                    return;
+                }
+                outcome = _session.State() == CaptureState::Cancelled
+                    ? CaptureCancelled
+                    : _service.StitchAndSave(_session, _cancel);
+            }
+            
+            _completed = true;
+            _service.WriteSessionTrace();
+            PostMessage(_overlay, WM_CAPTURE_COMPLETE, outcome, 0);
+        }
+        
+        // The run is destroyed once it completes or is cancelled; this then
+        // trims the shared pool. Declared first, so it runs after the session
+        // has released its frames.
+        struct PoolTrim {
+            ~PoolTrim() { FramePool::Shared().Trim(kIdleFrameBytesAfterCapture); }
+        } _poolTrim;
+        
+        ScreenshotServiceImpl& _service;
+        SteadyCaptureClock _clock;
+        ScreenCaptureSource _source;
+        CaptureSession _session;
+        HWND _overlay;
+        CancellationToken _cancel;
+        PTP_TIMER _timer = NULL;
+        std::mutex _stepMutex;
+        bool _completed = false;
+    };
+    
+    // Write the session's trace events next to other temp files as Chrome trace JSON
+    void WriteSessionTrace() {
+        if (Trace::Level() <= 0)
+            return;
+        
+        char tempPath[MAX_PATH];
+        DWORD length = GetTempPathA(MAX_PATH, tempPath);
+        if (length == 0 || length > MAX_PATH)
+            return;
+        
+        char tracePath[MAX_PATH + 64];
+        sprintf_s(tracePath, "%sScrollingScreenshot-trace-%llu.json", tempPath, (unsigned long long)GetTickCount64());
+        if (Trace::WriteChromeTrace(tracePath)) {
+            char message[MAX_PATH + 96];
+            sprintf_s(message, "Capture trace written to %s (%lld events dropped)\n", tracePath, Trace::DroppedEvents());
+            OutputDebugStringA(message);
+        }
+    }
+    
+    // Stitch a finished session's frames and put the result on the clipboard.
+    // Runs as the session's last task on the pool.
+    CaptureOutcome StitchAndSave(const CaptureSession& session, const CancellationToken& cancel) {
+        TRACE_SPAN(TRACE_INFO, "StitchAndSave");
+        const std::vector<Frame>& screenshots = session.Frames();
+        bool success = false;
+        
+        // Forward stitching progress to the callback, at most ten times a second
+        std::shared_ptr<ScreenshotCallback> callback = _callback;
+        ProgressReporter progress([callback](const StitchProgress& update) {
+            if (callback) {
+                callback->OnProgress(update);
+            }
+        }, cancel);
         
         try {
-            // Take initial screenshot
-            HBITMAP initialScreenshot = CaptureAreaToHBitmap(area);
-            screenshots.push_back(initialScreenshot);
-            
-            // Start time for 5-second capture
-            auto startTime = std::chrono::steady_clock::now();
-            auto endTime = startTime + std::chrono::seconds(5);
-            
-            // Find window to scroll - use the center of the selected area
-            POINT pt;
-            pt.x = area.left + area.width / 2;
-            pt.y = area.top + area.height / 2;
-            
-            // Get the best scrollable window at that point
-            HWND targetWindow = FindScrollableWindow(pt);
-            
-            if (targetWindow) {
-                // Main capture loop
-                int captureCount = 0;
-                int similarFrames = 0;  // Count of consecutive similar frames
-                const int MAX_SIMILAR_FRAMES = 3;  // Stop after this many similar frames
+            if (session.ScrollTargetFound() && screenshots.size() > 1) {
+                // Combine all screenshots based on the selected stitching method
+                TRACE_MESSAGE(TRACE_INFO, "Combining %d screenshots using method: %d\n",
+                              (int)screenshots.size(), static_cast<int>(_stitchingMethod));
                 
-                while (std::chrono::steady_clock::now() < endTime && similarFrames < MAX_SIMILAR_FRAMES) {
-                    // Try multiple approaches to scrolling
-                    
-                    // Approach 1: Direct message to the window
-                    SendMessage(targetWindow, WM_MOUSEWHEEL, MAKEWPARAM(0, -WHEEL_DELTA), MAKELPARAM(pt.x, pt.y));
-                    
-                    // Approach 2: Try posting the message
-                    PostMessage(targetWindow, WM_MOUSEWHEEL, MAKEWPARAM(0, -WHEEL_DELTA), MAKELPARAM(pt.x, pt.y));
-                    
-                    // Approach 3: SendInput for more reliable scrolling
-                    // First, bring the window to the foreground
-                    SetForegroundWindow(targetWindow);
-                    
-                    // Move mouse to the center of the target area
-                    SetCursorPos(pt.x, pt.y);
-                    
-                    // Wait a bit to ensure the cursor has moved
-                    std::this_thread::sleep_for(std::chrono::milliseconds(50));
-                    
-                    // Simulate a mouse wheel scroll
-                    INPUT input = {0};
-                    input.type = INPUT_MOUSE;
-                    input.mi.dwFlags = MOUSEEVENTF_WHEEL;
-                    input.mi.mouseData = -WHEEL_DELTA;
-                    SendInput(1, &input, sizeof(INPUT));
-                    
-                    // Wait for scroll animation to finish
-                    std::this_thread::sleep_for(std::chrono::milliseconds(500));
-                    
-                    // Capture another screenshot
-                    HBITMAP newScreenshot = CaptureAreaToHBitmap(area);
-                    
-                    // Compare with the previous screenshot to see if scrolling is still happening
-                    if (screenshots.size() > 0 && AreBitmapsSimilar(screenshots.back(), newScreenshot)) {
-                        // Screenshots are too similar - scrolling may have stopped
-                        similarFrames++;
-                        OutputDebugString(L"Similar frame detected\n");
-                        
-                        // Delete the duplicate screenshot
-                        DeleteObject(newScreenshot);
-                    } else {
-                        // Screenshots are different - scrolling is still happening
-                        screenshots.push_back(newScreenshot);
-                        captureCount++;
-                        similarFrames = 0; // Reset the similar frame counter
-                        OutputDebugString(L"New content detected - continuing to scroll\n");
-                    }
+                // GDI-based methods work on the DIB sections behind the frames
+                std::vector<HBITMAP> bitmaps;
+                for (const Frame& frame : screenshots) {
+                    bitmaps.push_back(frame.Bitmap());
                 }
                 
-                if (screenshots.size() > 1) {
-                    // Combine all screenshots based on the selected stitching method
-                    wchar_t buffer[256];
-                    swprintf_s(buffer, L"Combining %d screenshots using method: %d\n", 
-                              (int)screenshots.size(), static_cast<int>(_stitchingMethod));
-                    OutputDebugString(buffer);
-                    
-                    HBITMAP combinedBitmap = NULL;
-                    
-                    // Choose the appropriate stitching method
-                    switch (_stitchingMethod) {
-                        case StitchingMethod::OpenCV:
-                            combinedBitmap = ImageStitcher::StitchImagesWithFeatureMatching(screenshots);
-                            break;
-                        
-                        case StitchingMethod::OpenCVVertical:
-                            combinedBitmap = ImageStitcher::StitchImagesVertically(screenshots);
-                            break;
-                        
-                        case StitchingMethod::Simple:
-                        default:
-                            combinedBitmap = CombineVertically(screenshots);
-                            break;
-                    }
-                    
-                    // Save to clipboard
-                    bool success = false;
-                    if (combinedBitmap) {
-                        success = SaveToClipboard(combinedBitmap);
-                    } else {
-                        // If OpenCV stitching failed, fall back to simple approach
-                        combinedBitmap = CombineVertically(screenshots);
-                        if (combinedBitmap) {
-                            success = SaveToClipboard(combinedBitmap);
+                HBITMAP combinedBitmap = NULL;
+                Frame canvas;
+                
+                // Choose the appropriate stitching method
+                switch (_stitchingMethod) {
+                    case StitchingMethod::OpenCV:
+                    case StitchingMethod::Auto:
+                        // Stitch in place; the canvas goes straight to the clipboard
+                        try {
+                            canvas = ImageStitcher::StitchFrames(screenshots, &progress, &session.Mask(),
+                                                                 _stitchingMethod == StitchingMethod::Auto
+                                                                     ? OverlapEstimator::Cascade : OverlapEstimator::Auto,
+                                                                 _sideColumnMode);
+                        } catch (const OperationCancelled&) {
+                            throw;
+                        } catch (const std::exception& e) {
+                            TRACE_MESSAGE(TRACE_INFO, "Exception in StitchFrames: %s\n", e.what());
+                            combinedBitmap = ImageStitcher::StitchImagesVertically(bitmaps);
                         }
-                    }
+                        break;
                     
-                    // Clean up individual screenshots
-                    for (auto& bmp : screenshots) {
-                        DeleteObject(bmp);
-                    }
+                    case StitchingMethod::OpenCVVertical:
+                        combinedBitmap = ImageStitcher::StitchImagesVertically(bitmaps);
+                        break;
                     
-                    // Restore main window
-                    ::ShowWindow(_mainWindow, SW_RESTORE);
-                    
-                    // Notify about result
-                    if (_callback) {
-                        _callback->OnScreenshotCaptured(success);
-                    }
-                } else {
-                    // If we didn't scroll successfully, use the single screenshot
-                    OutputDebugString(L"No scrolling detected - using single screenshot\n");
-                    
-                    // Save the first screenshot to clipboard
-                    bool success = SaveToClipboard(screenshots[0]);
-                    
-                    // Clean up screenshots
-                    for (auto& bmp : screenshots) {
-                        DeleteObject(bmp);
-                    }
-                    
-                    // Restore main window
-                    ::ShowWindow(_mainWindow, SW_RESTORE);
-                    
-                    // Notify about result
-                    if (_callback) {
-                        _callback->OnScreenshotCaptured(success);
-                    }
+                    case StitchingMethod::Simple:
+                    default:
+                        combinedBitmap = ImageStitcher::CombineVertically(bitmaps);
+                        break;
                 }
-            } else {
-                OutputDebugString(L"Could not find window to scroll\n");
                 
-                // If we couldn't find a window to scroll, use the first screenshot
-                if (!screenshots.empty()) {
-                    // Save the first screenshot to clipboard
-                    bool success = SaveToClipboard(screenshots[0]);
-                    
-                    // Clean up screenshots
-                    for (auto& bmp : screenshots) {
-                        DeleteObject(bmp);
-                    }
-                    
-                    // Notify about result (partial success - we got one screenshot at least)
-                    if (_callback) {
-                        _callback->OnScreenshotCaptured(success);
-                    }
+                // Save to clipboard
+                if (canvas) {
+                    success = SaveToClipboard(canvas.Buffer());
                 } else {
-                    // No screenshots at all
-                    if (_callback) {
-                        _callback->OnScreenshotCaptured(false);
+                    // If OpenCV stitching failed, fall back to simple approach
+                    if (!combinedBitmap) {
+                        combinedBitmap = ImageStitcher::CombineVertically(bitmaps);
+                    }
+                    if (combinedBitmap) {
+                        success = SaveToClipboard(combinedBitmap);
+                        // The clipboard holds its own DIB copy
+                        DeleteObject(combinedBitmap);
                     }
                 }
-                
-                // Restore main window
-                ::ShowWindow(_mainWindow, SW_RESTORE);
+            } else {
+                // Without a window to scroll, or if scrolling never changed the
+                // frame, use the first screenshot
+                TRACE_MESSAGE(TRACE_INFO, "No scrolling detected - using single screenshot\n");
+                success = !screenshots.empty() && SaveToClipboard(screenshots[0].Buffer());
             }
+        } catch (const OperationCancelled&) {
+            // The canvas is released as the stack unwinds; the frames go with the session
+            TRACE_MESSAGE(TRACE_INFO, "Scrolling screenshot cancelled\n");
+            return CaptureCancelled;
         } catch (const std::exception& e) {
             // Log the exception
-            char exceptionBuf[1024];
-            sprintf_s(exceptionBuf, "Exception during scrolling screenshot: %s\n", e.what());
-            OutputDebugStringA(exceptionBuf);
-            
-            // Clean up screenshots
-            for (auto& bmp : screenshots) {
-                DeleteObject(bmp);
-            }
-            
-            // Restore main window
-            ::ShowWindow(_mainWindow, SW_RESTORE);
-            
-            if (_callback) {
-                _callback->OnScreenshotCaptured(false);
-            }
+            TRACE_MESSAGE(TRACE_INFO, "Exception during scrolling screenshot: %s\n", e.what());
+            success = false;
         } catch (...) {
-            OutputDebugString(L"Unknown exception during scrolling screenshot\n");
-            
-            // Clean up screenshots
-            for (auto& bmp : screenshots) {
-                DeleteObject(bmp);
-            }
-            
-            // Restore main window
-            ::ShowWindow(_mainWindow, SW_RESTORE);
-            
-            if (_callback) {
-                _callback->OnScreenshotCaptured(false);
-            }
+            TRACE_MESSAGE(TRACE_INFO, "Unknown exception during scrolling screenshot\n");
+            success = false;
         }
         
-        // Clean up overlay
-        if (_overlayWnd) {
-            ::DestroyWindow(_overlayWnd);
-            _overlayWnd = nullptr;
-        }
+        // The overlay and main window belong to the UI thread, which restores them
+        // when it receives WM_CAPTURE_COMPLETE
+        return success ? CaptureSucceeded : CaptureFailed;
     }
     
-    // Capture a screenshot of the specified area
-    HBITMAP CaptureAreaToHBitmap(const ScreenshotArea& area) {
+    // Capture a screenshot of the specified area straight into a frame buffer
+    Frame CaptureAreaToFrame(const ScreenshotArea& area) {
+        TRACE_SPAN(TRACE_DEBUG, "CaptureFrame");
+        // Frames of earlier sessions are recycled; the pool only allocates while it warms up
+        Frame frame = Frame::Acquire(area.width, area.height, 4);
+        if (!frame)
+            return frame;
+        frame.Info().screenLeft = area.left;
+        frame.Info().screenTop = area.top;
+        
         HDC hdcScreen = GetDC(NULL);
         HDC hdcMem = CreateCompatibleDC(hdcScreen);
         
-        HBITMAP hBitmap = CreateCompatibleBitmap(hdcScreen, area.width, area.height);
-        HGDIOBJ hOldBitmap = SelectObject(hdcMem, hBitmap);
+        // The DIB section is the frame's memory, so the blit is the only copy
+        HGDIOBJ hOldBitmap = SelectObject(hdcMem, frame.Bitmap());
         
         BitBlt(hdcMem, 0, 0, area.width, area.height,
                hdcScreen, area.left, area.top, SRCCOPY);
+        FrameBuffer::RecordFullCopy();
         
         SelectObject(hdcMem, hOldBitmap);
         DeleteDC(hdcMem);
         ReleaseDC(NULL, hdcScreen);
         
-        return hBitmap;
+        // Make sure GDI has finished writing before the pixels are read directly
+        GdiFlush();
+        
+        return frame;
+    }
+    
+    // Save a stitched canvas to the clipboard as a 24-bit DIB
+    bool SaveToClipboard(const FrameBuffer& frame) {
+        TRACE_SPAN(TRACE_INFO, "SaveToClipboard");
+        if (!OpenClipboard(NULL))
+            return false;
+        
+        EmptyClipboard();
+        
+        // Use 24-bit bottom-up DIB for better Paint compatibility
+        size_t stride = PixelKernels::DibStride(frame.Width(), 24);
+        
+        BITMAPINFOHEADER header = {0};
+        header.biSize = sizeof(BITMAPINFOHEADER);
+        header.biWidth = frame.Width();
+        header.biHeight = frame.Height();
+        header.biPlanes = 1;
+        header.biBitCount = 24;
+        header.biCompression = BI_RGB;
+        header.biSizeImage = (DWORD)(stride * frame.Height());
+        
+        HGLOBAL hDIB = GlobalAlloc(GMEM_MOVEABLE, sizeof(BITMAPINFOHEADER) + header.biSizeImage);
+        if (!hDIB) {
+            CloseClipboard();
+            return false;
+        }
+        
+        BYTE* dib = (BYTE*)GlobalLock(hDIB);
+        if (!dib) {
+            GlobalFree(hDIB);
+            CloseClipboard();
+            return false;
+        }
+        
+        memcpy(dib, &header, sizeof(BITMAPINFOHEADER));
+        
+        // Convert the canvas directly into the clipboard memory, flipping to bottom-up
+        BYTE* pixels = dib + sizeof(BITMAPINFOHEADER);
+        if (frame.Channels() == 4) {
+            ConvertToBottomUpDib<PixelFormat::BGRA>(frame, pixels, stride);
+        } else if (frame.Channels() == 3) {
+            ConvertToBottomUpDib<PixelFormat::BGR>(frame, pixels, stride);
+        } else {
+            ConvertToBottomUpDib<PixelFormat::Gray>(frame, pixels, stride);
+        }
+        FrameBuffer::RecordFullCopy();
+        
+        GlobalUnlock(hDIB);
+        
+        // Set the DIB to clipboard
+        SetClipboardData(CF_DIB, hDIB);
+        CloseClipboard();
+        
+        return true;
     }
     
     // Save bitmap to clipboard
@@ -586,6 +797,7 @@ private:
             CloseClipboard();
             return false;
         }
+        FrameBuffer::RecordFullCopy();
         
         ReleaseDC(NULL, hdcScreen);
         GlobalUnlock(hDIB);
@@ -597,104 +809,6 @@ private:
         return true;
     }
     
-    // Combine multiple bitmaps vertically into one bitmap
-    HBITMAP CombineVertically(const std::vector<HBITMAP>& bitmaps) {
-        if (bitmaps.empty())
-            return NULL;
-            
-        // Get dimensions from first bitmap
-        BITMAP bmp;
-        GetObject(bitmaps[0], sizeof(BITMAP), &bmp);
-        
-        int width = bmp.bmWidth;
-        int totalHeight = 0;
-        
-        // Calculate total height and find largest width
-        for (auto& hBitmap : bitmaps) {
-            BITMAP bInfo;
-            GetObject(hBitmap, sizeof(BITMAP), &bInfo);
-            totalHeight += bInfo.bmHeight;
-            
-            // Use the largest width we find
-            if (bInfo.bmWidth > width) {
-                width = bInfo.bmWidth;
-            }
-        }
-        
-        // Debug output
-        wchar_t buffer[256];
-        swprintf_s(buffer, L"Creating combined bitmap with dimensions: %dx%d\n", width, totalHeight);
-        OutputDebugString(buffer);
-        
-        // Create DC for combined bitmap
-        HDC hdcScreen = GetDC(NULL);
-        HDC hdcMem = CreateCompatibleDC(hdcScreen);
-        
-        // Create combined bitmap
-        HBITMAP hCombined = CreateCompatibleBitmap(hdcScreen, width, totalHeight);
-        HGDIOBJ hOldBitmap = SelectObject(hdcMem, hCombined);
-        
-        // Fill with white background
-        RECT rect = { 0, 0, width, totalHeight };
-        FillRect(hdcMem, &rect, (HBRUSH)GetStockObject(WHITE_BRUSH));
-        
-        // Copy each bitmap into combined bitmap
-        int yPos = 0;
-        for (size_t i = 0; i < bitmaps.size(); i++) {
-            BITMAP bInfo;
-            GetObject(bitmaps[i], sizeof(BITMAP), &bInfo);
-            
-            HDC hdcBitmap = CreateCompatibleDC(hdcScreen);
-            HGDIOBJ hOldBmp = SelectObject(hdcBitmap, bitmaps[i]);
-            
-            // Copy bitmap centered horizontally if widths differ
-            int xOffset = (width - bInfo.bmWidth) / 2;
-            if (xOffset < 0) xOffset = 0;
-            
-            // Use StretchBlt if bitmaps are different sizes
-            if (bInfo.bmWidth != width) {
-                // Scale while maintaining aspect ratio
-                StretchBlt(
-                    hdcMem, xOffset, yPos, bInfo.bmWidth, bInfo.bmHeight,
-                    hdcBitmap, 0, 0, bInfo.bmWidth, bInfo.bmHeight, 
-                    SRCCOPY
-                );
-            } else {
-                // Use regular BitBlt if no scaling needed
-                BitBlt(
-                    hdcMem, xOffset, yPos, bInfo.bmWidth, bInfo.bmHeight,
-                    hdcBitmap, 0, 0, SRCCOPY
-                );
-            }
-            
-            // Add a subtle separator line between screenshots (except for the last one)
-            if (i < bitmaps.size() - 1) {
-                HPEN separatorPen = CreatePen(PS_DOT, 1, RGB(200, 200, 200));
-                HGDIOBJ oldPen = SelectObject(hdcMem, separatorPen);
-                
-                MoveToEx(hdcMem, 0, yPos + bInfo.bmHeight - 1, NULL);
-                LineTo(hdcMem, width, yPos + bInfo.bmHeight - 1);
-                
-                SelectObject(hdcMem, oldPen);
-                DeleteObject(separatorPen);
-            }
-            
-            // Clean up
-            SelectObject(hdcBitmap, hOldBmp);
-            DeleteDC(hdcBitmap);
-            
-            // Move down for the next bitmap
-            yPos += bInfo.bmHeight;
-        }
-        
-        // Clean up
-        SelectObject(hdcMem, hOldBitmap);
-        DeleteDC(hdcMem);
-        ReleaseDC(NULL, hdcScreen);
-        
-        return hCombined;
-    }
-    
     // Helper function to find a scrollable window under a point
     HWND FindScrollableWindow(POINT pt) {
         // Get the window at the point
@@ -767,74 +881,6 @@ private:
         return hwnd;
     }
 
-    // Helper function to compare two bitmaps and check if they're similar (indicating scrolling has stopped)
-    bool AreBitmapsSimilar(HBITMAP bmp1, HBITMAP bmp2) {
-        if (!bmp1 || !bmp2)
-            return false;
-            
-        // Get bitmap info
-        BITMAP bm1 = {0}, bm2 = {0};
-        GetObject(bmp1, sizeof(BITMAP), &bm1);
-        GetObject(bmp2, sizeof(BITMAP), &bm2);
-        
-        // If sizes differ significantly, they're not similar
-        if (bm1.bmWidth != bm2.bmWidth || abs(bm1.bmHeight - bm2.bmHeight) > 5)
-            return false;
-            
-        // Create DCs for comparison
-        HDC hdcScreen = GetDC(NULL);
-        HDC hdc1 = CreateCompatibleDC(hdcScreen);
-        HDC hdc2 = CreateCompatibleDC(hdcScreen);
-        
-        HGDIOBJ oldBmp1 = SelectObject(hdc1, bmp1);
-        HGDIOBJ oldBmp2 = SelectObject(hdc2, bmp2);
-        
-        // We'll sample a few rows of pixels for comparison
-        const int sampleRows = 5;
-        const int rowHeight = bm1.bmHeight / (sampleRows + 1);
-        
-        int matchingPixels = 0;
-        int totalPixels = 0;
-        
-        // Sample pixels at specific rows
-        for (int row = 1; row <= sampleRows; row++) {
-            int y = row * rowHeight;
-            
-            // Sample pixels across this row
-            for (int x = 0; x < bm1.bmWidth; x += 10) { // Sample every 10th pixel
-                COLORREF color1 = GetPixel(hdc1, x, y);
-                COLORREF color2 = GetPixel(hdc2, x, y);
-                
-                // Count as matching if colors are close enough
-                if (abs(GetRValue(color1) - GetRValue(color2)) < 10 &&
-                    abs(GetGValue(color1) - GetGValue(color2)) < 10 &&
-                    abs(GetBValue(color1) - GetBValue(color2)) < 10) {
-                    matchingPixels++;
-                }
-                
-                totalPixels++;
-            }
-        }
-        
-        // Clean up
-        SelectObject(hdc1, oldBmp1);
-        SelectObject(hdc2, oldBmp2);
-        DeleteDC(hdc1);
-        DeleteDC(hdc2);
-        ReleaseDC(NULL, hdcScreen);
-        
-        // Calculate similarity percentage
-        float similarityPercent = (float)matchingPixels / totalPixels * 100;
-        
-        // Log the similarity for debugging
-        wchar_t buffer[256];
-        swprintf_s(buffer, L"Bitmap similarity: %.1f%%\n", similarityPercent);
-        OutputDebugString(buffer);
-        
-        // Consider similar if more than 95% of pixels match
-        return similarityPercent > 95;
-    }
-
 private:
     HWND _mainWindow;
     HINSTANCE _hInstance;
@@ -847,6 +893,18 @@ private:
     
     // The stitching method to use for combining screenshots
     StitchingMethod _stitchingMethod;
+    
+    // What the stitched image shows of static side columns
+    SideColumnMode _sideColumnMode = SideColumnMode::FirstFrame;
+    
+    // Whether capture scrolls a notch at a time or continuously
+    CaptureMode _captureMode = CaptureMode::StepAndWait;
+    
+    // Cancels the capture session in flight, if any
+    CancellationToken _cancel;
+    
+    // The capture session in flight; only touched on the UI thread
+    std::shared_ptr<CaptureRun> _capture;
 };
 
 // Factory function implementation
@@ -4,6 +4,10 @@
 #include <string>
 #include <vector>
 #include <optional>
+#include "CaptureSession.h"
+#include "SideColumns.h"
+#include "StitchingMethod.h"
+#include "StitchProgress.h"
 
 // Structure to represent a screenshot selection area
 struct ScreenshotArea {
@@ -26,13 +30,12 @@ public:
     
     virtual void OnScreenshotCaptured(bool success) = 0;
     virtual void OnSelectionCancelled() = 0;
-};
-
-// Enum for different stitching methods
-enum class StitchingMethod {
-    Simple,              // Simple vertical stacking
-    OpenCV,              // OpenCV stitching with feature matching
-    OpenCVVertical       // OpenCV simple vertical stitching
+    
+    // Called when CancelScreenshot() aborts a capture in progress
+    virtual void OnScreenshotCancelled() {}
+    
+    // Stitching progress; called from the capture task's thread, not the UI thread
+    virtual void OnProgress(const StitchProgress& progress) {}
 };
 
 // Main service class for screenshot functionality
@@ -50,6 +53,15 @@ public:
     // Set the stitching method to use
     virtual void SetStitchingMethod(StitchingMethod method) = 0;
     
+    // Set whether static side columns are cropped or taken from the first frame
+    virtual void SetSideColumnMode(SideColumnMode mode) = 0;
+    
+    // Set whether capture scrolls a notch at a time or continuously
+    virtual void SetCaptureMode(CaptureMode mode) = 0;
+    
+    // Abort the capture in progress; it stops at the next frame or stitching step
+    virtual void CancelScreenshot() = 0;
+    
     // Window procedure message handler
     virtual LRESULT HandleOverlayWindowMessage(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam) = 0;
 };
\ No newline at end of file
@@ -1,5 +1,8 @@
 #pragma once
-#include "ScreenshotService.h"
 
 // Function to run all screenshot service tests
-void RunScreenshotServiceTests();
\ No newline at end of file
+// Throws std::exception on the first failing check
+void RunScreenshotServiceTests();
+
+// Run the tests and report the outcome; returns true if every test passed
+bool RunScreenshotTests();
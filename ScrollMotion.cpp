@@ -0,0 +1,136 @@
+#include "ScrollMotion.h"
+#include "GlobalAlignment.h"
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+    // Rows either side of the expected displacement searched first
+    const int kWindowRadius = 16;
+
+    // Mean absolute difference between current rows [start, end) and the reference rows `offset` below them
+    double BandCost(const cv::Mat& reference, const cv::Mat& current, int start, int end, int offset) {
+        long long sum = 0;
+        for (int y = start; y < end; y++) {
+            const uint8_t* a = reference.ptr<uint8_t>(y + offset);
+            const uint8_t* b = current.ptr<uint8_t>(y);
+            for (int x = 0; x < current.cols; x++) {
+                sum += std::abs((int)a[x] - (int)b[x]);
+            }
+        }
+        return (double)sum / ((double)(end - start) * current.cols);
+    }
+
+    // Mean change from each signature row in [start, end) to the next
+    double BandTexture(const cv::Mat& signatures, int start, int end) {
+        long long sum = 0;
+        for (int y = start; y + 1 < end; y++) {
+            const uint8_t* a = signatures.ptr<uint8_t>(y);
+            const uint8_t* b = signatures.ptr<uint8_t>(y + 1);
+            for (int x = 0; x < signatures.cols; x++) {
+                sum += std::abs((int)a[x] - (int)b[x]);
+            }
+        }
+        return (double)sum / ((double)std::max(1, end - start - 1) * signatures.cols);
+    }
+
+    // Whether textured bands of the current grab, each matched on its own at
+    // any offset that keeps it inside the reference, fit at offsets that
+    // disagree. This is how a torn grab shows when it fits nowhere as a whole.
+    bool BandsDisagree(const cv::Mat& reference, const cv::Mat& current, const ScrollMotionOptions& options) {
+        int rows = current.rows;
+        int bands = std::max(1, std::min(options.bands, rows / std::max(1, options.minBandRows)));
+        int lowest = INT_MAX;
+        int highest = INT_MIN;
+        for (int band = 0; band < bands; band++) {
+            int start = rows * band / bands;
+            int end = rows * (band + 1) / bands;
+            if (end - start < 2 || BandTexture(current, start, end) < options.minBandTexture)
+                continue;
+
+            int bestOffset = 0;
+            double bestCost = options.maxCost;
+            bool matched = false;
+            for (int offset = std::max(-options.bandSearch, -start); offset <= rows - end; offset++) {
+                double cost = BandCost(reference, current, start, end, offset);
+                if (cost <= bestCost) {
+                    bestOffset = offset;
+                    bestCost = cost;
+                    matched = true;
+                }
+            }
+            if (matched) {
+                lowest = std::min(lowest, bestOffset);
+                highest = std::max(highest, bestOffset);
+            }
+        }
+        return lowest != INT_MAX && highest - lowest > options.maxBandDisagreement;
+    }
+}
+
+ScrollMotion ScrollMotion::Measure(const cv::Mat& referenceSignatures, const cv::Mat& currentSignatures, int expected,
+                                   const ScrollMotionOptions& options) {
+    ScrollMotion motion;
+    int rows = currentSignatures.rows;
+    if (referenceSignatures.empty() || currentSignatures.empty() || referenceSignatures.size() != currentSignatures.size() ||
+        rows <= options.minOverlap)
+        return motion;
+
+    // FindCandidates never tries a full overlap, which is what grabs of a page that stopped share
+    GlobalAlignmentOptions search;
+    search.candidatesPerPair = 1;
+    search.minOverlap = std::max(1, options.minOverlap);
+    search.maxWindowCost = options.maxCost;
+    SearchWindow window;
+    if (expected > 0) {
+        window.center = rows - expected;
+        window.radius = kWindowRadius;
+    }
+    double still = GlobalAlignment::MatchCost(referenceSignatures, currentSignatures, rows);
+    std::vector<OverlapCandidate> best = GlobalAlignment::FindCandidates(referenceSignatures, currentSignatures, search, window);
+    int displacement = 0;
+    double cost = still;
+    if (!best.empty() && best[0].cost < still) {
+        displacement = rows - best[0].overlap;
+        cost = best[0].cost;
+    }
+    motion.displacement = displacement;
+    motion.cost = cost;
+
+    // A torn grab fits poorly as a whole, and the whole-range search may then
+    // settle on a short overlap of blank rows; match its bands on their own
+    bool outsideWindow = expected > 0 && std::abs(displacement - expected) > kWindowRadius;
+    if ((cost > options.maxCost || outsideWindow) && BandsDisagree(referenceSignatures, currentSignatures, options)) {
+        motion.smeared = true;
+        return motion;
+    }
+
+    // Every band of the shared rows must follow the grab's displacement. Blank
+    // bands fit anywhere and say nothing. A slightly smeared grab can still
+    // match poorly as a whole, so this runs before the cost is judged.
+    int overlap = rows - displacement;
+    int bands = std::max(1, std::min(options.bands, overlap / std::max(1, options.minBandRows)));
+    for (int band = 0; band < bands && !motion.smeared; band++) {
+        int start = overlap * band / bands;
+        int end = overlap * (band + 1) / bands;
+        if (end - start < 2 || BandTexture(currentSignatures, start, end) < options.minBandTexture)
+            continue;
+
+        double atDisplacement = BandCost(referenceSignatures, currentSignatures, start, end, displacement);
+        int low = std::max(displacement - options.bandSearch, -start);
+        int high = std::min(displacement + options.bandSearch, rows - end);
+        for (int offset = low; offset <= high; offset++) {
+            if (std::abs(offset - displacement) <= options.maxBandDisagreement)
+                continue;
+            if (BandCost(referenceSignatures, currentSignatures, start, end, offset) + options.maxCost < atDisplacement) {
+                motion.smeared = true;
+                break;
+            }
+        }
+    }
+    if (!motion.smeared && cost > options.maxCost)
+        motion.displacement = -1;
+    return motion;
+}
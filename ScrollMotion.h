@@ -0,0 +1,37 @@
+#pragma once
+
+// OpenCV 4 headers
+#include <opencv2/core.hpp>
+
+struct ScrollMotionOptions {
+	int minOverlap = 32;            // Rows two grabs must share for their displacement to be measured
+	double maxCost = 3.0;           // Mean row-signature difference above which two grabs do not match
+	int bands = 4;                  // Bands of the shared rows whose offsets must agree
+	int minBandRows = 12;           // ... at least this tall; fewer bands when the overlap is short
+	int bandSearch = 32;            // Rows either side of the grab's displacement each band searches
+	int maxBandDisagreement = 1;    // Rows a band's offset may differ from the grab's before it is smeared
+	double minBandTexture = 1.0;    // Bands whose signatures change less than this per row (blank space) are not judged
+};
+
+// How far a screen grab's content moved up from an earlier grab of the same
+// scroll, taken while the page scrolls continuously. Both grabs are reduced
+// to row signatures (GlobalAlignment::RowSignatures); the displacement is the
+// offset at which the shared rows match best. A grab taken while the window
+// was repainting, or smeared by the motion, shows parts of the page from
+// different scroll positions: the shared rows are split into bands and each
+// is matched on its own, and a band that fits clearly better at another
+// offset marks the grab as smeared. A grab that fits poorly as a whole is
+// also smeared if its bands fit well at offsets that disagree.
+struct ScrollMotion {
+	int displacement = -1;    // Rows the content moved up; -1 if the grabs do not match and are not smeared
+	bool smeared = false;     // Bands of the grab moved by different amounts; the grab is unusable
+	double cost = 0;          // Mean signature difference at the displacement
+
+	bool Measured() const { return displacement >= 0; }
+
+	// Motion from the grab with referenceSignatures to the one with
+	// currentSignatures. `expected`, if not negative, is the displacement
+	// searched first; the whole range is searched if it fits poorly.
+	static ScrollMotion Measure(const cv::Mat& referenceSignatures, const cv::Mat& currentSignatures, int expected = -1,
+	                            const ScrollMotionOptions& options = ScrollMotionOptions());
+};
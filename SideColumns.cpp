@@ -0,0 +1,123 @@
+#include "SideColumns.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+
+namespace {
+    // Sampled rows, per pair, where two columns of one thumb may disagree:
+    // antialiased corners change a row or so earlier or later than the middle
+    const int kMaxThumbMismatch = 2;
+
+    // Whether each sampled row of column x changed between consecutive frames, pair after pair
+    std::vector<uint8_t> ColumnChanges(const std::vector<cv::Mat>& frames, int x, const SideColumnOptions& options) {
+        int channels = std::min(frames[0].channels(), 3);  // Alpha is ignored
+        size_t pixelBytes = frames[0].elemSize();
+        std::vector<uint8_t> changes;
+        for (size_t i = 1; i < frames.size(); i++) {
+            for (int y = 0; y < frames[i].rows; y += options.rowStep) {
+                const uint8_t* a = frames[i - 1].ptr<uint8_t>(y) + x * pixelBytes;
+                const uint8_t* b = frames[i].ptr<uint8_t>(y) + x * pixelBytes;
+                bool changed = false;
+                for (int c = 0; c < channels && !changed; c++) {
+                    changed = std::abs((int)a[c] - (int)b[c]) > options.tolerance;
+                }
+                changes.push_back(changed ? 1 : 0);
+            }
+        }
+        return changes;
+    }
+
+    bool Unchanged(const std::vector<uint8_t>& changes) {
+        return std::none_of(changes.begin(), changes.end(), [](uint8_t changed) { return changed != 0; });
+    }
+
+    // Whether every pair's changes form at most two runs of rows, covering at most half of them
+    bool ThumbLike(const std::vector<uint8_t>& changes, int rowsPerPair) {
+        for (size_t pair = 0; pair < changes.size(); pair += rowsPerPair) {
+            int runs = 0;
+            int changed = 0;
+            for (int row = 0; row < rowsPerPair; row++) {
+                uint8_t current = changes[pair + row];
+                changed += current;
+                if (current && (row == 0 || !changes[pair + row - 1]))
+                    runs++;
+            }
+            if (runs > 2 || 2 * changed > rowsPerPair)
+                return false;
+        }
+        return true;
+    }
+
+    bool ChangeTogether(const std::vector<uint8_t>& first, const std::vector<uint8_t>& second, int rowsPerPair) {
+        for (size_t pair = 0; pair < first.size(); pair += rowsPerPair) {
+            int mismatched = 0;
+            for (int row = 0; row < rowsPerPair; row++) {
+                mismatched += first[pair + row] != second[pair + row];
+            }
+            if (mismatched > kMaxThumbMismatch)
+                return false;
+        }
+        return true;
+    }
+
+    // Side columns counted from column `edge` inwards (direction +1 from the
+    // left, -1 from the right), at most `limit`. Returns -1 if every column up
+    // to the limit is a side column: then nothing between them scrolled.
+    int SideWidth(const std::vector<cv::Mat>& frames, int edge, int direction, int limit, const SideColumnOptions& options) {
+        int rowsPerPair = (frames[0].rows + options.rowStep - 1) / options.rowStep;
+        bool thumbSeen = false;
+        int count = 0;
+        while (count < limit) {
+            std::vector<uint8_t> changes = ColumnChanges(frames, edge + direction * count, options);
+            if (Unchanged(changes)) {
+                count++;
+                continue;
+            }
+            if (thumbSeen || !ThumbLike(changes, rowsPerPair))
+                return count;
+
+            // A thumb is a narrow group of columns that change together, with unchanging columns on its inner side
+            int group = 1;
+            bool bounded = false;
+            while (group <= options.maxThumbWidth && count + group < limit) {
+                std::vector<uint8_t> next = ColumnChanges(frames, edge + direction * (count + group), options);
+                if (Unchanged(next)) {
+                    bounded = true;
+                    break;
+                }
+                if (!ThumbLike(next, rowsPerPair) || !ChangeTogether(changes, next, rowsPerPair))
+                    break;
+                group++;
+            }
+            if (!bounded || group < options.minThumbWidth || group > options.maxThumbWidth)
+                return count;
+            thumbSeen = true;
+            count += group;
+        }
+        return -1;
+    }
+}
+
+SideColumns SideColumns::Detect(const std::vector<cv::Mat>& frames, const SideColumnOptions& options) {
+    TRACE_SPAN(TRACE_DEBUG, "SideColumns");
+    SideColumns sides;
+    if (frames.size() < 2 || frames[0].empty() || frames[0].depth() != CV_8U || options.rowStep < 1)
+        return sides;
+    for (const cv::Mat& frame : frames) {
+        if (frame.size() != frames[0].size() || frame.type() != frames[0].type())
+            return sides;
+    }
+
+    int width = frames[0].cols;
+    int left = SideWidth(frames, 0, 1, width - options.minContentWidth, options);
+    if (left < 0)
+        return sides;
+    int right = SideWidth(frames, width - 1, -1, width - left - options.minContentWidth, options);
+    if (right < 0)
+        return sides;
+    sides.left = left;
+    sides.right = right;
+    TRACE_COUNTER(TRACE_DEBUG, "side_columns", left + right);
+    return sides;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+// OpenCV 4 headers
+#include <opencv2/core.hpp>
+
+// What the stitched output shows of the static side columns (SideColumns)
+enum class SideColumnMode {
+	FirstFrame,    // Take them from the first frame only; below it the canvas stays background
+	Crop           // Leave them out of the output
+};
+
+struct SideColumnOptions {
+	int rowStep = 4;          // Every rowStep-th row is compared
+	int tolerance = 8;        // A channel difference above this marks a pixel as changed
+	int maxThumbWidth = 24;   // Widest scrollbar thumb recognised, in columns
+	int minThumbWidth = 4;    // ... narrowest
+	int minContentWidth = 64; // Fewer columns left between the sides means nothing scrolled; no sides
+};
+
+// Columns at the left and right edges of a session's frames that do not move
+// with the content: scrollbars, fixed side panels, window borders, and blank
+// page margins. They dilute alignment scores and cost time in every estimator,
+// so alignment leaves them out.
+// A side column is one whose pixels are the same in every frame, or one of a
+// scrollbar thumb: a group of at most maxThumbWidth columns, bounded by
+// unchanging columns or the frame edge, that change together in at most two
+// runs of rows (the thumb's old and new places) between consecutive frames.
+// Only the columns from each edge up to the first content column are read.
+struct SideColumns {
+	int left = 0;     // Side columns at the left edge
+	int right = 0;    // ... at the right edge
+
+	bool Empty() const { return left == 0 && right == 0; }
+
+	// The columns between the sides of a frame `width` columns wide
+	cv::Range Content(int width) const { return cv::Range(left, width - right); }
+
+	// Frames of different sizes or types, or fewer than two, have no side columns
+	static SideColumns Detect(const std::vector<cv::Mat>& frames, const SideColumnOptions& options = SideColumnOptions());
+};
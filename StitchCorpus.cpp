@@ -0,0 +1,343 @@
+#include "StitchCorpus.h"
+#include "PixelKernels.h"
+#include "PngStripEncoder.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+// OpenCV 4 headers
+#include <opencv2/imgcodecs.hpp>
+
+namespace {
+    const char* kManifestName = "manifest.txt";
+
+    // Pull a numeric or string field out of a flat one-line JSON object
+    bool JsonField(const std::string& line, const char* key, std::string& value) {
+        std::string pattern = std::string("\"") + key + "\":";
+        size_t pos = line.find(pattern);
+        if (pos == std::string::npos)
+            return false;
+        pos += pattern.size();
+        if (pos < line.size() && line[pos] == '"') {
+            size_t end = line.find('"', pos + 1);
+            if (end == std::string::npos)
+                return false;
+            value = line.substr(pos + 1, end - pos - 1);
+        } else {
+            size_t end = line.find_first_of(",}", pos);
+            value = line.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+        }
+        return true;
+    }
+
+    double JsonNumber(const std::string& line, const char* key) {
+        std::string value;
+        return JsonField(line, key, value) ? atof(value.c_str()) : 0.0;
+    }
+}
+
+const char* StitchCorpus::EstimatorName(OverlapEstimator estimator) {
+    switch (estimator) {
+        case OverlapEstimator::Auto: return "auto";
+        case OverlapEstimator::Features: return "features";
+        case OverlapEstimator::Template: return "template";
+        case OverlapEstimator::Global: return "global";
+        case OverlapEstimator::Cascade: return "cascade";
+    }
+    return "unknown";
+}
+
+bool StitchCorpus::ParseEstimator(const std::string& name, OverlapEstimator& estimator) {
+    for (OverlapEstimator candidate : { OverlapEstimator::Auto, OverlapEstimator::Features, OverlapEstimator::Template,
+                                        OverlapEstimator::Global, OverlapEstimator::Cascade }) {
+        if (name == EstimatorName(candidate)) {
+            estimator = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* StitchCorpus::SourceName(OverlapSource source) {
+    switch (source) {
+        case OverlapSource::None: return "none";
+        case OverlapSource::Exact: return "exact";
+        case OverlapSource::Signature: return "signature";
+        case OverlapSource::Features: return "features";
+        case OverlapSource::Template: return "template";
+        case OverlapSource::Global: return "global";
+        case OverlapSource::Index: return "index";
+        case OverlapSource::Conservative: return "conservative";
+    }
+    return "unknown";
+}
+
+std::string StitchCorpus::SourcesJson(const OverlapSourceStats& stats) {
+    std::string pairs, ms;
+    char field[64];
+    for (int source = 0; source < OverlapSourceStats::kSources; source++) {
+        if (stats.pairs[source] == 0)
+            continue;
+        const char* separator = pairs.empty() ? "" : ",";
+        snprintf(field, sizeof(field), "%s\"%s\":%d", separator, SourceName((OverlapSource)source), stats.pairs[source]);
+        pairs += field;
+        snprintf(field, sizeof(field), "%s\"%s\":%.3f", separator, SourceName((OverlapSource)source),
+                 stats.ms[source] / stats.pairs[source]);
+        ms += field;
+    }
+    return "\"tier_pairs\":{" + pairs + "},\"tier_ms\":{" + ms + "}";
+}
+
+std::vector<std::string> StitchCorpus::FindSessions(const std::string& root) {
+    namespace fs = std::filesystem;
+    std::vector<std::string> sessions;
+    std::error_code ec;
+
+    if (fs::exists(fs::path(root) / kManifestName, ec)) {
+        sessions.push_back(root);
+        return sessions;
+    }
+    for (fs::recursive_directory_iterator it(root, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->is_directory(ec) && fs::exists(it->path() / kManifestName, ec))
+            sessions.push_back(it->path().string());
+    }
+    std::sort(sessions.begin(), sessions.end());
+    return sessions;
+}
+
+bool StitchCorpus::LoadSession(const std::string& directory, CorpusSession& session, std::string& error) {
+    namespace fs = std::filesystem;
+    std::ifstream manifest(fs::path(directory) / kManifestName);
+    if (!manifest) {
+        error = "cannot open " + (fs::path(directory) / kManifestName).string();
+        return false;
+    }
+
+    CorpusSession result;
+    result.directory = directory;
+    result.name = fs::path(directory).filename().string();
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(manifest, line)) {
+        lineNumber++;
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        std::istringstream fields(line);
+        std::string keyword;
+        if (!(fields >> keyword) || keyword[0] == '#')
+            continue;
+
+        if (keyword == "name") {
+            fields >> result.name;
+        } else if (keyword == "frame") {
+            std::string file;
+            int offset = 0;
+            if (!(fields >> file >> offset)) {
+                error = "manifest line " + std::to_string(lineNumber) + ": expected 'frame <file> <top row>'";
+                return false;
+            }
+            result.frameFiles.push_back(file);
+            result.trueOffsets.push_back(offset);
+        } else {
+            error = "manifest line " + std::to_string(lineNumber) + ": unknown keyword '" + keyword + "'";
+            return false;
+        }
+    }
+
+    if (result.frameFiles.size() < 2) {
+        error = "manifest in " + directory + " lists fewer than two frames";
+        return false;
+    }
+    session = std::move(result);
+    return true;
+}
+
+bool StitchCorpus::LoadFrames(const CorpusSession& session, std::vector<cv::Mat>& frames, std::string& error) {
+    namespace fs = std::filesystem;
+    frames.clear();
+    for (const std::string& file : session.frameFiles) {
+        std::string path = (fs::path(session.directory) / file).string();
+        cv::Mat image = cv::imread(path, cv::IMREAD_UNCHANGED);
+        if (image.empty() || image.depth() != CV_8U) {
+            error = "cannot read 8-bit image " + path;
+            return false;
+        }
+
+        // The stitcher works on BGRA, like captured DIB sections
+        cv::Mat bgra = image;
+        if (image.channels() != 4)
+            bgra.create(image.rows, image.cols, CV_8UC4);
+        if (image.channels() == 1)
+            PixelKernels::ConvertRows<PixelFormat::Gray, PixelFormat::BGRA>(image.data, image.step, bgra.data, bgra.step,
+                                                                            image.cols, image.rows);
+        else if (image.channels() == 3)
+            PixelKernels::ConvertRows<PixelFormat::BGR, PixelFormat::BGRA>(image.data, image.step, bgra.data, bgra.step,
+                                                                           image.cols, image.rows);
+        frames.push_back(bgra);
+    }
+    return true;
+}
+
+bool StitchCorpus::WriteSession(const std::string& directory, const std::string& name,
+                                const std::vector<cv::Mat>& frames, const std::vector<int>& trueOffsets) {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    fs::create_directories(directory, ec);
+    if (ec || frames.size() != trueOffsets.size())
+        return false;
+
+    std::ofstream manifest(fs::path(directory) / kManifestName);
+    if (!manifest)
+        return false;
+    manifest << "# StitchTool corpus manifest\n";
+    manifest << "# frame <image file> <top row of the frame on the full page>\n";
+    manifest << "name " << name << "\n";
+
+    for (size_t i = 0; i < frames.size(); i++) {
+        char file[32];
+        snprintf(file, sizeof(file), "frame_%03d.png", (int)i);
+        if (!PngStripEncoder::EncodeToFile(frames[i], (fs::path(directory) / file).string()))
+            return false;
+        manifest << "frame " << file << " " << trueOffsets[i] << "\n";
+    }
+    return (bool)manifest;
+}
+
+CorpusResult StitchCorpus::Run(const CorpusSession& session, const std::vector<cv::Mat>& frames,
+                               OverlapEstimator estimator, int repeat) {
+    CorpusResult result;
+    result.session = session.name;
+    result.estimator = estimator;
+    result.frames = (int)frames.size();
+    result.pairs = std::max(0, (int)frames.size() - 1);
+    if (result.pairs == 0 || frames.size() != session.trueOffsets.size())
+        return result;
+
+    // Alignment is deterministic, so every repeat produces the same placements
+    std::vector<FramePlacement> placements;
+    double bestSeconds = 1e30;
+    for (int run = 0; run < std::max(1, repeat); run++) {
+        auto start = std::chrono::steady_clock::now();
+        placements = ImageStitcher::AlignFrames(frames, estimator);
+        bestSeconds = std::min(bestSeconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    result.msPerPair = bestSeconds * 1000.0 / result.pairs;
+
+    // Score each pair's scroll distance, so one bad pair does not count against every later frame
+    double errorSum = 0;
+    int fallbacks = 0;
+    long long searched = 0;
+    int rejected = 0;
+    for (size_t i = 1; i < placements.size(); i++) {
+        int estimated = placements[i].y - placements[i - 1].y;
+        int truth = session.trueOffsets[i] - session.trueOffsets[i - 1];
+        int error = std::abs(estimated - truth);
+        errorSum += error;
+        result.maxError = std::max(result.maxError, error);
+        if (placements[i].source == OverlapSource::Conservative)
+            fallbacks++;
+        searched += placements[i].searched;
+        rejected += placements[i].rejected;
+    }
+    result.meanError = errorSum / result.pairs;
+    result.fallbackRate = (double)fallbacks / result.pairs;
+    result.searchedPerPair = (double)searched / result.pairs;
+    result.rejectedPerPair = (double)rejected / result.pairs;
+    result.sources.Add(placements);
+    return result;
+}
+
+std::string StitchCorpus::ToJson(const CorpusResult& result) {
+    char buffer[512];
+    snprintf(buffer, sizeof(buffer),
+             "{\"benchmark\":\"corpus_session\",\"session\":\"%s\",\"estimator\":\"%s\",\"frames\":%d,\"pairs\":%d,"
+             "\"mean_error\":%.3f,\"max_error\":%d,\"fallback_rate\":%.4f,\"ms_per_pair\":%.3f,\"searched_per_pair\":%.1f,"
+             "\"rejected_per_pair\":%.3f,",
+             result.session.c_str(), EstimatorName(result.estimator), result.frames, result.pairs,
+             result.meanError, result.maxError, result.fallbackRate, result.msPerPair, result.searchedPerPair,
+             result.rejectedPerPair);
+    return buffer + SourcesJson(result.sources) + "}";
+}
+
+bool StitchCorpus::WriteBaseline(const std::string& path, const std::vector<CorpusResult>& results) {
+    std::ofstream file(path);
+    if (!file)
+        return false;
+    for (const CorpusResult& result : results) {
+        file << ToJson(result) << "\n";
+    }
+    return (bool)file;
+}
+
+bool StitchCorpus::ReadBaseline(const std::string& path, std::vector<CorpusResult>& results) {
+    std::ifstream file(path);
+    if (!file)
+        return false;
+
+    results.clear();
+    std::string line;
+    while (std::getline(file, line)) {
+        std::string benchmark, estimatorName;
+        if (!JsonField(line, "benchmark", benchmark) || benchmark != "corpus_session")
+            continue;
+
+        CorpusResult result;
+        if (!JsonField(line, "session", result.session) || !JsonField(line, "estimator", estimatorName) ||
+            !ParseEstimator(estimatorName, result.estimator))
+            continue;
+        result.frames = (int)JsonNumber(line, "frames");
+        result.pairs = (int)JsonNumber(line, "pairs");
+        result.meanError = JsonNumber(line, "mean_error");
+        result.maxError = (int)JsonNumber(line, "max_error");
+        result.fallbackRate = JsonNumber(line, "fallback_rate");
+        result.msPerPair = JsonNumber(line, "ms_per_pair");
+        result.searchedPerPair = JsonNumber(line, "searched_per_pair");
+        result.rejectedPerPair = JsonNumber(line, "rejected_per_pair");
+        results.push_back(result);
+    }
+    return true;
+}
+
+std::vector<std::string> StitchCorpus::FindRegressions(const std::vector<CorpusResult>& results,
+                                                       const std::vector<CorpusResult>& baseline,
+                                                       const CorpusTolerance& tolerance) {
+    std::vector<std::string> regressions;
+    char message[512];
+
+    for (const CorpusResult& result : results) {
+        auto expected = std::find_if(baseline.begin(), baseline.end(), [&](const CorpusResult& entry) {
+            return entry.session == result.session && entry.estimator == result.estimator;
+        });
+        if (expected == baseline.end())
+            continue;
+
+        const char* session = result.session.c_str();
+        const char* estimator = EstimatorName(result.estimator);
+        if (result.meanError > expected->meanError + tolerance.meanError) {
+            snprintf(message, sizeof(message), "%s/%s: mean error %.3f exceeds baseline %.3f + %.3f",
+                     session, estimator, result.meanError, expected->meanError, tolerance.meanError);
+            regressions.push_back(message);
+        }
+        if (result.maxError > expected->maxError + tolerance.maxError) {
+            snprintf(message, sizeof(message), "%s/%s: max error %d exceeds baseline %d + %d",
+                     session, estimator, result.maxError, expected->maxError, tolerance.maxError);
+            regressions.push_back(message);
+        }
+        if (result.fallbackRate > expected->fallbackRate + tolerance.fallbackRate) {
+            snprintf(message, sizeof(message), "%s/%s: fallback rate %.4f exceeds baseline %.4f + %.4f",
+                     session, estimator, result.fallbackRate, expected->fallbackRate, tolerance.fallbackRate);
+            regressions.push_back(message);
+        }
+        if (expected->msPerPair > 0 && result.msPerPair > expected->msPerPair * tolerance.timeRatio) {
+            snprintf(message, sizeof(message), "%s/%s: %.3f ms per pair exceeds baseline %.3f x %.2f",
+                     session, estimator, result.msPerPair, expected->msPerPair, tolerance.timeRatio);
+            regressions.push_back(message);
+        }
+    }
+    return regressions;
+}
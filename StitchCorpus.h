@@ -0,0 +1,91 @@
+#pragma once
+
+#include "ImageStitcher.h"
+#include <string>
+#include <vector>
+// OpenCV 4 headers
+#include <opencv2/core.hpp>
+
+// One recorded scrolling session: a directory of frame images plus manifest.txt.
+//
+// manifest.txt is line based; blank lines and lines starting with '#' are ignored:
+//   name <session name>                 (optional, defaults to the directory name)
+//   frame <image file> <true top row>   (one per frame, in capture order)
+// The true top row is where the frame's first row sits on the full page,
+// so the first frame is normally 0 and the difference between consecutive
+// frames is the real scroll distance.
+struct CorpusSession {
+	std::string name;
+	std::string directory;
+	std::vector<std::string> frameFiles;   // Relative to directory
+	std::vector<int> trueOffsets;
+};
+
+// Accuracy and speed of one estimator on one session
+struct CorpusResult {
+	std::string session;
+	OverlapEstimator estimator = OverlapEstimator::Auto;
+	int frames = 0;
+	int pairs = 0;
+	double meanError = 0;        // Mean |estimated - true| scroll distance per pair, in rows
+	int maxError = 0;
+	double fallbackRate = 0;     // Fraction of pairs that ended on the conservative overlap
+	double msPerPair = 0;        // Alignment time per pair (best of the repeats)
+	double searchedPerPair = 0;  // Offsets the estimators examined per pair (FramePlacement::searched)
+	double rejectedPerPair = 0;  // Proposed overlaps that failed pixel verification per pair
+	OverlapSourceStats sources;  // Pairs each source decided and their estimator time
+};
+
+// How far a run may drift from its baseline before it counts as a regression
+struct CorpusTolerance {
+	double meanError = 1.0;      // Rows added to the baseline mean error
+	int maxError = 8;            // Rows added to the baseline max error
+	double fallbackRate = 0.05;  // Added to the baseline fallback rate
+	double timeRatio = 1.5;      // Allowed slowdown factor on ms per pair
+};
+
+// Loads, writes and runs ground-truth alignment corpora.
+// Everything here is portable so the corpus can be run headless on Linux.
+class StitchCorpus {
+public:
+	// Lower-case estimator name used in output and on the command line
+	static const char* EstimatorName(OverlapEstimator estimator);
+	static bool ParseEstimator(const std::string& name, OverlapEstimator& estimator);
+
+	// Lower-case overlap source name used in output
+	static const char* SourceName(OverlapSource source);
+
+	// "tier_pairs":{...},"tier_ms":{...}: pairs each source decided and their
+	// mean estimator time in ms, for the sources that decided any
+	static std::string SourcesJson(const OverlapSourceStats& stats);
+
+	// Directories under root (or root itself) that contain a manifest.txt, sorted by path
+	static std::vector<std::string> FindSessions(const std::string& root);
+
+	// Parse a session's manifest. Returns false and sets error on malformed input.
+	static bool LoadSession(const std::string& directory, CorpusSession& session, std::string& error);
+
+	// Read a session's frames as CV_8UC4. Returns false if any frame is missing or unreadable.
+	static bool LoadFrames(const CorpusSession& session, std::vector<cv::Mat>& frames, std::string& error);
+
+	// Write frames as PNGs plus a manifest into directory (created if needed)
+	static bool WriteSession(const std::string& directory, const std::string& name,
+	                         const std::vector<cv::Mat>& frames, const std::vector<int>& trueOffsets);
+
+	// Align the frames repeat times with the estimator and score the best run against the manifest
+	static CorpusResult Run(const CorpusSession& session, const std::vector<cv::Mat>& frames,
+	                        OverlapEstimator estimator, int repeat = 1);
+
+	// One JSON object on a single line; also the baseline file format
+	static std::string ToJson(const CorpusResult& result);
+
+	// Baselines are files of ToJson() lines. Lines that are not corpus results are skipped.
+	static bool WriteBaseline(const std::string& path, const std::vector<CorpusResult>& results);
+	static bool ReadBaseline(const std::string& path, std::vector<CorpusResult>& results);
+
+	// Compare results with the baseline entry for the same session and estimator.
+	// Returns one message per regression; sessions missing from the baseline are not regressions.
+	static std::vector<std::string> FindRegressions(const std::vector<CorpusResult>& results,
+	                                                const std::vector<CorpusResult>& baseline,
+	                                                const CorpusTolerance& tolerance);
+};
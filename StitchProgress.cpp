@@ -0,0 +1,48 @@
+#include "StitchProgress.h"
+#include <chrono>
+
+namespace {
+    int64_t NowMicroseconds() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+}
+
+ProgressReporter::ProgressReporter(Callback callback, CancellationToken token, int intervalMs)
+    : _callback(std::move(callback)), _token(std::move(token)), _intervalUs((int64_t)intervalMs * 1000) {}
+
+void ProgressReporter::BeginStage(StitchStage stage, long long total) {
+    _stage = (int)stage;
+    _total = total;
+    _done = 0;
+    _nextReportUs = NowMicroseconds() + _intervalUs;
+    Report(0);
+}
+
+void ProgressReporter::Advance(long long amount) {
+    long long done = _done.fetch_add(amount) + amount;
+    if (!_callback)
+        return;
+
+    // Stage completion is always reported; otherwise only the thread that
+    // moves the deadline forward reports
+    if (done < _total.load()) {
+        int64_t now = NowMicroseconds();
+        int64_t next = _nextReportUs.load();
+        if (now < next || !_nextReportUs.compare_exchange_strong(next, now + _intervalUs))
+            return;
+    }
+    Report(done);
+}
+
+void ProgressReporter::Report(long long done) {
+    if (!_callback)
+        return;
+    StitchProgress progress;
+    progress.stage = (StitchStage)_stage.load();
+    progress.done = done;
+    progress.total = _total.load();
+
+    std::lock_guard<std::mutex> lock(_callbackMutex);
+    _callback(progress);
+}
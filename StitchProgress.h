@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+// Thrown out of stitching and encoding once their token has been cancelled
+class OperationCancelled : public std::runtime_error {
+public:
+	OperationCancelled() : std::runtime_error("operation cancelled") {}
+};
+
+// Cooperative cancellation flag. Copies share the flag, so the owner keeps one
+// copy to call Cancel() on and hands others to the work, which checks it
+// between frame pairs, frames and encoder strips.
+class CancellationToken {
+public:
+	CancellationToken() : _cancelled(std::make_shared<std::atomic<bool>>(false)) {}
+
+	// Safe to call from any thread, including a signal handler
+	void Cancel() const { _cancelled->store(true, std::memory_order_relaxed); }
+	bool IsCancelled() const { return _cancelled->load(std::memory_order_relaxed); }
+
+	void ThrowIfCancelled() const {
+		if (IsCancelled())
+			throw OperationCancelled();
+	}
+
+private:
+	std::shared_ptr<std::atomic<bool>> _cancelled;
+};
+
+enum class StitchStage {
+	Aligning,    // done/total are frames aligned
+	Composing,   // done/total are canvas rows written
+	Encoding     // done/total are bytes of filtered image data compressed
+};
+
+struct StitchProgress {
+	StitchStage stage = StitchStage::Aligning;
+	long long done = 0;
+	long long total = 0;
+};
+
+// Counts progress from every thread of one job and forwards it to a callback
+// at most once per interval, plus once at the start and end of each stage.
+// Advance() is one atomic add and a clock read, so it can be called per frame
+// or per strip. The callback runs on whichever thread crossed the interval,
+// never on two threads at once.
+class ProgressReporter {
+public:
+	using Callback = std::function<void(const StitchProgress&)>;
+
+	explicit ProgressReporter(Callback callback = nullptr, CancellationToken token = CancellationToken(),
+	                          int intervalMs = 100);
+
+	// Start a stage: reset the count and report 0 of total
+	void BeginStage(StitchStage stage, long long total);
+
+	// Add to the current stage's count; thread-safe
+	void Advance(long long amount);
+
+	const CancellationToken& Token() const { return _token; }
+	bool IsCancelled() const { return _token.IsCancelled(); }
+	void ThrowIfCancelled() const { _token.ThrowIfCancelled(); }
+
+private:
+	void Report(long long done);
+
+	Callback _callback;
+	CancellationToken _token;
+	int64_t _intervalUs;
+	std::atomic<int> _stage{ 0 };
+	std::atomic<long long> _total{ 0 };
+	std::atomic<long long> _done{ 0 };
+	std::atomic<int64_t> _nextReportUs{ 0 };
+	std::mutex _callbackMutex;
+};
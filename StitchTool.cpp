@@ -0,0 +1,1125 @@
+// StitchTool.cpp : Console entry point for offline stitching utilities and benchmarks.
+//
+// Usage:
+//   StitchTool test
+//   StitchTool bench [--width N] [--height N] [--step N] [--frames N] [--seed N] [--side-panel N] [--methods a,b] [--documents a,b]
+//   StitchTool corpus --dir DIR [--estimator auto|features|template|global|cascade] [--repeat N]
+//                     [--baseline FILE] [--write-baseline FILE] [--tolerance-error X] [--tolerance-time X]
+//   StitchTool corpus-make --out DIR [--width N] [--height N] [--step N] [--frames N] [--seed N] [--side-panel N] [--documents a,b]
+//   StitchTool batch --in DIR --out DIR [--method opencv|auto|opencv_vertical|simple] [--estimator auto|features|template|global|cascade]
+//                    [--workers N] [--memory-mb N] [--encode-threads N]
+//   StitchTool encode-bench [--height N] [--width N] [--max-threads N] [--out file.png]
+//   StitchTool tile-bench [--height N] [--width N] [--tile N]
+//   StitchTool kernel-bench [--width N] [--rows N]
+//   StitchTool width-bench [--rows N] [--min-width N] [--max-width N]
+//   StitchTool pool-bench [--width N] [--height N] [--step N] [--frames N] [--side-panel N] [--sessions N] [--warmup N] [--documents a,b]
+//   StitchTool executor-bench [--workers N] [--samples N] [--tasks N] [--work-us N] [--load-tasks N]
+//   Any command also accepts --trace FILE to write a Chrome trace of the run.
+//
+// Benchmarks print one JSON object per line so results can be collected by scripts.
+
+#include "BatchStitcher.h"
+#include "Frame.h"
+#include "FrameBuffer.h"
+#include "FramePool.h"
+#include "ImageStitcher.h"
+#include "PixelKernels.h"
+#include "PngStripEncoder.h"
+#include "RowTiles.h"
+#include "ScreenshotServiceTests.h"
+#include "StitchCorpus.h"
+#include "StitchingMethod.h"
+#include "SyntheticDocuments.h"
+#include "TaskExecutor.h"
+#include "TiledCanvas.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <Psapi.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace
+{
+    // Cut a page into overlapping viewport frames, as a scrolling capture would
+    std::vector<cv::Mat> SplitIntoFrames(const cv::Mat& page, int frameHeight, int scrollStep) {
+        std::vector<cv::Mat> frames;
+        for (int y = 0; y + frameHeight <= page.rows; y += scrollStep) {
+            frames.push_back(page(cv::Rect(0, y, page.cols, frameHeight)).clone());
+        }
+        return frames;
+    }
+
+    int IntArg(int argc, char** argv, const char* name, int defaultValue) {
+        for (int i = 0; i + 1 < argc; i++) {
+            if (strcmp(argv[i], name) == 0)
+                return atoi(argv[i + 1]);
+        }
+        return defaultValue;
+    }
+
+    const char* StringArg(int argc, char** argv, const char* name, const char* defaultValue) {
+        for (int i = 0; i + 1 < argc; i++) {
+            if (strcmp(argv[i], name) == 0)
+                return argv[i + 1];
+        }
+        return defaultValue;
+    }
+
+    // Measure PngStripEncoder throughput on an ImageStitcher canvas at 1..maxThreads workers
+    int RunEncodeBenchmark(int argc, char** argv) {
+        int width = IntArg(argc, argv, "--width", 1280);
+        int height = IntArg(argc, argv, "--height", 20000);
+        int maxThreads = IntArg(argc, argv, "--max-threads", 16);
+        const char* outPath = StringArg(argc, argv, "--out", nullptr);
+
+        const int frameHeight = 800;
+        const int scrollStep = 600;
+        std::vector<cv::Mat> frames = SplitIntoFrames(SyntheticDocuments::RenderPage(DocumentKind::Text, width, height, 12345), frameHeight, scrollStep);
+        cv::Mat canvas = ImageStitcher::StitchMatsWithFeatureMatching(frames);
+        if (canvas.empty()) {
+            fprintf(stderr, "encode-bench: stitching produced no canvas\n");
+            return 1;
+        }
+
+        // Throughput is measured against the raw 24-bit pixel payload the encoder writes
+        double inputMB = (double)canvas.cols * canvas.rows * 3 / (1024.0 * 1024.0);
+        double singleThreadSeconds = 0;
+
+        for (int threads = 1; threads <= maxThreads; threads *= 2) {
+            PngEncodeOptions options;
+            options.threadCount = threads;
+
+            // Best of three runs to filter out scheduler noise
+            double bestSeconds = 1e30;
+            size_t outputBytes = 0;
+            for (int run = 0; run < 3; run++) {
+                auto start = std::chrono::steady_clock::now();
+                std::vector<uint8_t> png = PngStripEncoder::Encode(canvas, options);
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                if (png.empty()) {
+                    fprintf(stderr, "encode-bench: encoding failed at %d threads\n", threads);
+                    return 1;
+                }
+                bestSeconds = std::min(bestSeconds, seconds);
+                outputBytes = png.size();
+            }
+            if (threads == 1)
+                singleThreadSeconds = bestSeconds;
+
+            printf("{\"benchmark\":\"png_strip_encode\",\"width\":%d,\"height\":%d,\"threads\":%d,"
+                   "\"output_bytes\":%zu,\"seconds\":%.4f,\"mb_per_s\":%.1f,\"speedup\":%.2f}\n",
+                   canvas.cols, canvas.rows, threads, outputBytes, bestSeconds,
+                   inputMB / bestSeconds, singleThreadSeconds / bestSeconds);
+        }
+
+        if (outPath && !PngStripEncoder::EncodeToFile(canvas, outPath)) {
+            fprintf(stderr, "encode-bench: failed to write %s\n", outPath);
+            return 1;
+        }
+        return 0;
+    }
+
+    // Measure tile deduplication on synthetic spreadsheet and code-listing documents
+    int RunTileBenchmark(int argc, char** argv) {
+        int width = IntArg(argc, argv, "--width", 1280);
+        int height = IntArg(argc, argv, "--height", 20000);
+        int tileSize = IntArg(argc, argv, "--tile", TiledCanvas::DefaultTileSize);
+
+        struct Document {
+            const char* name;
+            cv::Mat page;
+        };
+        Document documents[] = {
+            { "spreadsheet", SyntheticDocuments::RenderPage(DocumentKind::Table, width, height, 2024) },
+            { "code_listing", SyntheticDocuments::RenderPage(DocumentKind::Code, width, height, 77) },
+            { "text", SyntheticDocuments::RenderPage(DocumentKind::Text, width, height, 12345) },
+        };
+
+        for (const Document& document : documents) {
+            auto start = std::chrono::steady_clock::now();
+            TiledCanvas tiled = TiledCanvas::FromMat(document.page, tileSize);
+            double buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            start = std::chrono::steady_clock::now();
+            std::vector<uint8_t> densePng = PngStripEncoder::Encode(document.page);
+            double denseEncodeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            start = std::chrono::steady_clock::now();
+            std::vector<uint8_t> tiledPng = PngStripEncoder::Encode(tiled);
+            double tiledEncodeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            std::string archivePath = std::string("tile-bench-") + document.name + ".stc";
+            if (!tiled.WriteArchive(archivePath)) {
+                fprintf(stderr, "tile-bench: failed to write %s\n", archivePath.c_str());
+                return 1;
+            }
+            FILE* archive = fopen(archivePath.c_str(), "rb");
+            long archiveBytes = 0;
+            if (archive) {
+                fseek(archive, 0, SEEK_END);
+                archiveBytes = ftell(archive);
+                fclose(archive);
+            }
+            remove(archivePath.c_str());
+
+            TileDedupStats stats = tiled.Stats();
+            printf("{\"benchmark\":\"tile_dedup\",\"document\":\"%s\",\"width\":%d,\"height\":%d,\"tile\":%d,"
+                   "\"grid_tiles\":%d,\"unique_tiles\":%d,\"dedup_ratio\":%.2f,"
+                   "\"dense_bytes\":%zu,\"stored_bytes\":%zu,\"build_seconds\":%.4f,"
+                   "\"png_bytes\":%zu,\"archive_bytes\":%ld,"
+                   "\"dense_encode_seconds\":%.4f,\"tiled_encode_seconds\":%.4f,\"identical_png\":%s}\n",
+                   document.name, width, height, tileSize,
+                   stats.gridTiles, stats.uniqueTiles, stats.DedupRatio(),
+                   stats.denseBytes, stats.storedBytes, buildSeconds,
+                   densePng.size(), archiveBytes,
+                   denseEncodeSeconds, tiledEncodeSeconds, densePng == tiledPng ? "true" : "false");
+        }
+        return 0;
+    }
+
+    // Source megabytes one kernel pass processes per second, over at least 0.2 s of passes
+    double KernelThroughput(size_t bytesPerPass, const std::function<void()>& pass) {
+        pass();
+        int passes = 0;
+        double seconds = 0;
+        auto start = std::chrono::steady_clock::now();
+        do {
+            pass();
+            passes++;
+            seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        } while (seconds < 0.2);
+        return (double)bytesPerPass * passes / seconds / 1e6;
+    }
+
+    // Time the pixel kernels on a rendered text page: format conversions
+    // against cv::cvtColor, and each runtime-dispatched kernel at every SIMD
+    // level this CPU supports against its scalar version
+    int RunKernelBenchmark(int argc, char** argv) {
+        int width = IntArg(argc, argv, "--width", 1920);
+        int rows = IntArg(argc, argv, "--rows", 1080);
+        if (width <= 0 || rows <= 1) {
+            fprintf(stderr, "kernel-bench: --width and --rows must be positive\n");
+            return 2;
+        }
+
+        cv::Mat bgra = SyntheticDocuments::RenderPage(DocumentKind::Text, width, rows, 2024);
+        cv::Mat shifted = SyntheticDocuments::RenderPage(DocumentKind::Text, width, rows, 2025);
+        cv::Mat bgr(rows, width, CV_8UC3), gray(rows, width, CV_8UC1), rgb(rows, width, CV_8UC3), out4(rows, width, CV_8UC4);
+        size_t dibStride = PixelKernels::DibStride(width, 24);
+        std::vector<uint8_t> dib(dibStride * rows);
+        size_t bgraBytes = (size_t)width * 4 * rows;
+        size_t bgrBytes = (size_t)width * 3 * rows;
+
+        struct Conversion {
+            const char* name;
+            size_t bytes;
+            std::function<void()> kernel;
+            std::function<void()> opencv;
+        };
+        Conversion conversions[] = {
+            { "bgra_to_bgr_dib", bgraBytes,
+              [&] { PixelKernels::ConvertRows<PixelFormat::BGRA, PixelFormat::BGR>(bgra.data, bgra.step, dib.data(), dibStride, width, rows); },
+              [&] { cv::Mat padded(rows, width, CV_8UC3, dib.data(), dibStride); cv::cvtColor(bgra, padded, cv::COLOR_BGRA2BGR); } },
+            { "bgr_to_bgra", bgrBytes,
+              [&] { PixelKernels::ConvertRows<PixelFormat::BGR, PixelFormat::BGRA>(bgr.data, bgr.step, out4.data, out4.step, width, rows); },
+              [&] { cv::cvtColor(bgr, out4, cv::COLOR_BGR2BGRA); } },
+            { "bgra_to_gray", bgraBytes,
+              [&] { PixelKernels::ConvertRows<PixelFormat::BGRA, PixelFormat::Gray>(bgra.data, bgra.step, gray.data, gray.step, width, rows); },
+              [&] { cv::cvtColor(bgra, gray, cv::COLOR_BGRA2GRAY); } },
+            { "bgra_to_rgb", bgraBytes,
+              [&] { PixelKernels::ConvertRows<PixelFormat::BGRA, PixelFormat::RGB>(bgra.data, bgra.step, rgb.data, rgb.step, width, rows); },
+              nullptr },
+        };
+        cv::cvtColor(bgra, bgr, cv::COLOR_BGRA2BGR);
+        for (const Conversion& conversion : conversions) {
+            double kernel = KernelThroughput(conversion.bytes, conversion.kernel);
+            double opencv = conversion.opencv ? KernelThroughput(conversion.bytes, conversion.opencv) : 0;
+            printf("{\"benchmark\":\"kernel\",\"kernel\":\"%s\",\"width\":%d,\"rows\":%d,\"simd\":\"%s\","
+                   "\"mb_per_s\":%.1f,\"opencv_mb_per_s\":%.1f}\n",
+                   conversion.name, width, rows, PixelKernels::SimdConversions() ? "ssse3" : "scalar", kernel, opencv);
+        }
+
+        size_t rowBytes = (size_t)width * 4;
+        uint64_t diffSink = 0;
+        uint32_t hashSink = 0;
+        struct Dispatched {
+            const char* name;
+            std::function<void()> kernel;
+        };
+        Dispatched dispatched[] = {
+            { "blend", [&] {
+                for (int y = 0; y < rows; y++) {
+                    PixelKernels::BlendRow(bgra.ptr<uint8_t>(y), shifted.ptr<uint8_t>(y), out4.ptr<uint8_t>(y), rowBytes, y * 256 / rows);
+                }
+            } },
+            { "abs_diff", [&] {
+                for (int y = 0; y < rows; y++) {
+                    diffSink += PixelKernels::AbsDiffSum(bgra.ptr<uint8_t>(y), shifted.ptr<uint8_t>(y), rowBytes);
+                }
+            } },
+            { "row_hash", [&] {
+                for (int y = 0; y < rows; y++) {
+                    hashSink ^= PixelKernels::RowHash(bgra.ptr<uint8_t>(y), rowBytes);
+                }
+            } },
+        };
+        SimdLevel active = PixelKernels::Level();
+        for (const Dispatched& kernel : dispatched) {
+            double scalar = 0;
+            for (int level = 0; level <= (int)PixelKernels::BestLevel(); level++) {
+                PixelKernels::SetLevel((SimdLevel)level);
+                double throughput = KernelThroughput(bgraBytes, kernel.kernel);
+                if (level == 0)
+                    scalar = throughput;
+                printf("{\"benchmark\":\"kernel\",\"kernel\":\"%s\",\"width\":%d,\"rows\":%d,\"level\":\"%s\","
+                       "\"mb_per_s\":%.1f,\"speedup\":%.2f}\n",
+                       kernel.name, width, rows, PixelKernels::LevelName((SimdLevel)level), throughput,
+                       throughput / std::max(scalar, 1e-9));
+            }
+        }
+        PixelKernels::SetLevel(active);
+        // Keep the results live so the loops are not optimized away
+        if ((diffSink ^ hashSink) == 1)
+            fprintf(stderr, "\n");
+        return 0;
+    }
+
+    // Time ImageStitcher's per-frame passes on one thread and in row tiles on
+    // the task pool, at frame widths from --min-width to --max-width, and
+    // report the narrowest width from which tiling is faster at every width
+    int RunWidthBenchmark(int argc, char** argv) {
+        int rows = IntArg(argc, argv, "--rows", 1080);
+        int minWidth = IntArg(argc, argv, "--min-width", 800);
+        int maxWidth = IntArg(argc, argv, "--max-width", 7680);
+        if (rows <= 1 || minWidth <= 0 || maxWidth < minWidth) {
+            fprintf(stderr, "width-bench: --rows and the widths must be positive, with --min-width <= --max-width\n");
+            return 2;
+        }
+
+        std::vector<int> widths;
+        for (int width : { 800, 1024, 1280, 1600, 1920, 2560, 3200, 3840, 5120, 6400, 7680 }) {
+            if (width >= minWidth && width <= maxWidth)
+                widths.push_back(width);
+        }
+        if (widths.empty() || widths.front() != minWidth)
+            widths.insert(widths.begin(), minWidth);
+        if (widths.back() != maxWidth)
+            widths.push_back(maxWidth);
+
+        const char* stages[] = { "gray", "blend", "copy", "to_bgr_dib" };
+        const int stageCount = sizeof(stages) / sizeof(stages[0]);
+        // Per stage, the index of the narrowest width from which every wider one tiled faster
+        std::vector<int> crossover(stageCount, -1);
+        size_t defaultMinBytes = RowTiles::MinBytes();
+
+        for (size_t w = 0; w < widths.size(); w++) {
+            int width = widths[w];
+            cv::Mat bgra = SyntheticDocuments::RenderPage(DocumentKind::Text, width, rows, 2024);
+            cv::Mat shifted = SyntheticDocuments::RenderPage(DocumentKind::Text, width, rows, 2025);
+            cv::Mat gray(rows, width, CV_8UC1), out4(rows, width, CV_8UC4);
+            size_t dibStride = PixelKernels::DibStride(width, 24);
+            std::vector<uint8_t> dib(dibStride * rows);
+            size_t rowBytes = (size_t)width * 4;
+            size_t frameBytes = rowBytes * rows;
+
+            std::function<void()> passes[] = {
+                [&] { RowTiles::ConvertRows<PixelFormat::BGRA, PixelFormat::Gray>(bgra.data, bgra.step, gray.data, gray.step, width, rows); },
+                [&] {
+                    RowTiles::ForEach(rows, rowBytes, [&](int begin, int end) {
+                        for (int y = begin; y < end; y++) {
+                            PixelKernels::BlendRow(bgra.ptr<uint8_t>(y), shifted.ptr<uint8_t>(y), out4.ptr<uint8_t>(y), rowBytes, y * 256 / rows);
+                        }
+                    });
+                },
+                [&] { RowTiles::Copy(bgra, out4); },
+                [&] { RowTiles::ConvertRows<PixelFormat::BGRA, PixelFormat::BGR>(bgra.data, bgra.step, dib.data(), dibStride, width, rows); },
+            };
+            for (int stage = 0; stage < stageCount; stage++) {
+                RowTiles::SetMinBytes(SIZE_MAX);
+                double serial = KernelThroughput(frameBytes, passes[stage]);
+                RowTiles::SetMinBytes(0);
+                double tiled = KernelThroughput(frameBytes, passes[stage]);
+                if (tiled <= serial)
+                    crossover[stage] = -1;
+                else if (crossover[stage] < 0)
+                    crossover[stage] = (int)w;
+                printf("{\"benchmark\":\"row_tiles\",\"stage\":\"%s\",\"width\":%d,\"rows\":%d,\"workers\":%d,"
+                       "\"serial_mb_per_s\":%.1f,\"tiled_mb_per_s\":%.1f,\"speedup\":%.2f,\"tiled_by_default\":%s}\n",
+                       stages[stage], width, rows, TaskExecutor::Shared().WorkerCount(), serial, tiled, tiled / std::max(serial, 1e-9),
+                       frameBytes >= defaultMinBytes ? "true" : "false");
+                fflush(stdout);
+            }
+        }
+        RowTiles::SetMinBytes(defaultMinBytes);
+
+        for (int stage = 0; stage < stageCount; stage++) {
+            int width = crossover[stage] < 0 ? 0 : widths[crossover[stage]];
+            printf("{\"benchmark\":\"row_tiles\",\"stage\":\"%s\",\"crossover_width\":%d,\"crossover_mb\":%.1f,"
+                   "\"default_min_mb\":%.1f}\n",
+                   stages[stage], width, (double)width * 4 * rows / (1 << 20), defaultMinBytes / (double)(1 << 20));
+        }
+        return 0;
+    }
+
+    // The single worker draining a mutex-guarded std::queue that MainWindow ran
+    // every command on before TaskExecutor; kept as the executor-bench baseline
+    class SingleQueueProcessor {
+    public:
+        SingleQueueProcessor() : _thread(&SingleQueueProcessor::Run, this) {}
+
+        ~SingleQueueProcessor() {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _running = false;
+            }
+            _cv.notify_all();
+            _thread.join();
+        }
+
+        void Post(std::function<void()> task) {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _queue.push(std::move(task));
+            }
+            _cv.notify_one();
+        }
+
+    private:
+        void Run() {
+            while (true) {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _cv.wait(lock, [this]() { return !_queue.empty() || !_running; });
+                if (_queue.empty())
+                    return;
+                std::function<void()> task = std::move(_queue.front());
+                _queue.pop();
+                lock.unlock();
+                task();
+            }
+        }
+
+        std::queue<std::function<void()>> _queue;
+        std::mutex _mutex;
+        std::condition_variable _cv;
+        bool _running = true;
+        std::thread _thread;
+    };
+
+    double NowMicroseconds() {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void SpinMicroseconds(int microseconds) {
+        double end = NowMicroseconds() + microseconds;
+        while (NowMicroseconds() < end) {
+        }
+    }
+
+    void WaitForCount(const std::atomic<long long>& counter, long long target) {
+        while (counter.load() < target) {
+            std::this_thread::yield();
+        }
+    }
+
+    double Percentile(std::vector<double> samples, double fraction) {
+        if (samples.empty())
+            return 0;
+        std::sort(samples.begin(), samples.end());
+        return samples[std::min(samples.size() - 1, (size_t)(fraction * samples.size()))];
+    }
+
+    using PostTask = std::function<void(TaskPriority, std::function<void()>)>;
+
+    // Dispatch latency and throughput of one queue; every test waits for its tasks to finish
+    void RunQueueBenchmark(const char* queue, int workers, const PostTask& post, int samples, int tasks, int workUs, int loadTasks) {
+        auto reportLatency = [&](const char* test, const std::vector<double>& latencies) {
+            printf("{\"benchmark\":\"executor\",\"queue\":\"%s\",\"workers\":%d,\"test\":\"%s\",\"median_us\":%.2f,\"p99_us\":%.2f}\n",
+                   queue, workers, test, Percentile(latencies, 0.5), Percentile(latencies, 0.99));
+            fflush(stdout);
+        };
+        auto reportThroughput = [&](const char* test, int count, double startUs) {
+            printf("{\"benchmark\":\"executor\",\"queue\":\"%s\",\"workers\":%d,\"test\":\"%s\",\"tasks_per_s\":%.0f}\n",
+                   queue, workers, test, count / ((NowMicroseconds() - startUs) / 1e6));
+            fflush(stdout);
+        };
+        std::atomic<long long> done{ 0 };
+
+        // Post-to-start time of a single task on an idle queue
+        std::vector<double> latencies;
+        for (int i = 0; i < samples; i++) {
+            double posted = NowMicroseconds();
+            double started = 0;
+            post(TaskPriority::Interactive, [&]() { started = NowMicroseconds(); done++; });
+            WaitForCount(done, i + 1);
+            latencies.push_back(started - posted);
+        }
+        reportLatency("latency_idle", latencies);
+
+        // Post-to-start time of an interactive task queued behind background work
+        latencies.clear();
+        for (int round = 0; round < 5; round++) {
+            done = 0;
+            for (int i = 0; i < loadTasks; i++) {
+                post(TaskPriority::Background, [&]() { SpinMicroseconds(workUs); done++; });
+            }
+            double posted = NowMicroseconds();
+            double started = 0;
+            post(TaskPriority::Interactive, [&]() { started = NowMicroseconds(); done++; });
+            WaitForCount(done, loadTasks + 1);
+            latencies.push_back(started - posted);
+        }
+        reportLatency("latency_under_load", latencies);
+
+        // Empty tasks posted from outside the queue
+        done = 0;
+        double start = NowMicroseconds();
+        for (int i = 0; i < tasks; i++) {
+            post(TaskPriority::Normal, [&]() { done++; });
+        }
+        WaitForCount(done, tasks);
+        reportThroughput("throughput_empty", tasks, start);
+
+        // Empty tasks spawned by a running task
+        done = 0;
+        start = NowMicroseconds();
+        post(TaskPriority::Normal, [&]() {
+            for (int i = 0; i < tasks; i++) {
+                post(TaskPriority::Normal, [&]() { done++; });
+            }
+        });
+        WaitForCount(done, tasks);
+        reportThroughput("throughput_spawned", tasks, start);
+
+        // Tasks that each do workUs of computation
+        int workTasks = std::max(1, tasks / 10);
+        done = 0;
+        start = NowMicroseconds();
+        for (int i = 0; i < workTasks; i++) {
+            post(TaskPriority::Normal, [&]() { SpinMicroseconds(workUs); done++; });
+        }
+        WaitForCount(done, workTasks);
+        reportThroughput("throughput_work", workTasks, start);
+    }
+
+    // Compare the old single-thread command queue with TaskExecutor
+    int RunExecutorBenchmark(int argc, char** argv) {
+        int workers = IntArg(argc, argv, "--workers", 0);
+        int samples = IntArg(argc, argv, "--samples", 2000);
+        int tasks = IntArg(argc, argv, "--tasks", 200000);
+        int workUs = IntArg(argc, argv, "--work-us", 50);
+        int loadTasks = IntArg(argc, argv, "--load-tasks", 1000);
+        if (samples <= 0 || tasks <= 0 || workUs < 0 || loadTasks < 0) {
+            fprintf(stderr, "executor-bench: samples and tasks must be positive\n");
+            return 2;
+        }
+
+        {
+            SingleQueueProcessor processor;
+            RunQueueBenchmark("single_queue", 1, [&](TaskPriority, std::function<void()> task) { processor.Post(std::move(task)); },
+                              samples, tasks, workUs, loadTasks);
+        }
+        {
+            TaskExecutor executor(workers);
+            RunQueueBenchmark("task_executor", executor.WorkerCount(),
+                              [&](TaskPriority priority, std::function<void()> task) { executor.Post(priority, std::move(task)); },
+                              samples, tasks, workUs, loadTasks);
+            printf("{\"benchmark\":\"executor_steals\",\"workers\":%d,\"stolen\":%lld}\n", executor.WorkerCount(), executor.StolenCount());
+        }
+        return 0;
+    }
+
+    // Current resident memory of this process in bytes
+    size_t CurrentMemoryBytes() {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters = {};
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+            return counters.WorkingSetSize;
+        return 0;
+#else
+        long pages = 0, resident = 0;
+        FILE* statm = fopen("/proc/self/statm", "r");
+        if (statm) {
+            if (fscanf(statm, "%ld %ld", &pages, &resident) != 2)
+                resident = 0;
+            fclose(statm);
+        }
+        return (size_t)resident * (size_t)sysconf(_SC_PAGESIZE);
+#endif
+    }
+
+    // Samples resident memory on a background thread while a run is in progress.
+    // The OS peak counters cannot be reset between runs, so we poll instead.
+    class MemorySampler {
+    public:
+        MemorySampler() : _baseline(CurrentMemoryBytes()), _peak(_baseline) {
+            _thread = std::thread([this]() {
+                while (!_stop.load()) {
+                    size_t current = CurrentMemoryBytes();
+                    size_t peak = _peak.load();
+                    while (current > peak && !_peak.compare_exchange_weak(peak, current)) {}
+                    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                }
+            });
+        }
+
+        // Stop sampling and return the peak growth over the baseline
+        size_t Finish() {
+            _stop.store(true);
+            _thread.join();
+            size_t current = CurrentMemoryBytes();
+            return std::max(_peak.load(), current) - _baseline;
+        }
+
+    private:
+        size_t _baseline;
+        std::atomic<size_t> _peak;
+        std::atomic<bool> _stop{ false };
+        std::thread _thread;
+    };
+
+    // Split a comma-separated option value
+    std::vector<std::string> SplitList(const char* value) {
+        std::vector<std::string> items;
+        std::string current;
+        for (const char* p = value; ; p++) {
+            if (*p == ',' || *p == '\0') {
+                if (!current.empty())
+                    items.push_back(current);
+                current.clear();
+                if (*p == '\0')
+                    break;
+            } else {
+                current += *p;
+            }
+        }
+        return items;
+    }
+
+    // Read the synthetic session shape shared by bench and corpus-make
+    bool ParseSessionOptions(int argc, char** argv, const char* command, SyntheticSessionOptions& options) {
+        options.frameWidth = IntArg(argc, argv, "--width", options.frameWidth);
+        options.frameHeight = IntArg(argc, argv, "--height", options.frameHeight);
+        options.scrollStep = IntArg(argc, argv, "--step", options.scrollStep);
+        options.frameCount = IntArg(argc, argv, "--frames", options.frameCount);
+        options.seed = (uint64_t)IntArg(argc, argv, "--seed", (int)options.seed);
+        options.sidePanelWidth = std::max(0, IntArg(argc, argv, "--side-panel", options.sidePanelWidth));
+        if (options.frameWidth <= 0 || options.frameHeight <= 0 || options.scrollStep <= 0 || options.frameCount <= 0) {
+            fprintf(stderr, "%s: width, height, step and frames must be positive\n", command);
+            return false;
+        }
+        return true;
+    }
+
+    // --documents a,b,... or every kind when the option is absent
+    bool ParseDocuments(int argc, char** argv, const char* command, std::vector<DocumentKind>& kinds) {
+        const char* documents = StringArg(argc, argv, "--documents", nullptr);
+        if (!documents) {
+            kinds = SyntheticDocuments::AllKinds();
+            return true;
+        }
+        for (const std::string& name : SplitList(documents)) {
+            DocumentKind kind;
+            if (!SyntheticDocuments::ParseKind(name, kind)) {
+                fprintf(stderr, "%s: unknown document '%s'\n", command, name.c_str());
+                return false;
+            }
+            kinds.push_back(kind);
+        }
+        return true;
+    }
+
+    // Run one stitching method over a session and return where each frame landed.
+    // Only the stitching itself is timed; frame upload to GDI bitmaps is not.
+    bool StitchSession(StitchingMethod method, const SyntheticSession& session, std::vector<int>& frameOffsets, double& seconds,
+                       PruneStats& pruneStats, OverlapSourceStats& sources) {
+        frameOffsets.clear();
+        pruneStats = PruneStats();
+        sources = OverlapSourceStats();
+
+        if (method == StitchingMethod::OpenCV || method == StitchingMethod::Auto) {
+            auto start = std::chrono::steady_clock::now();
+            std::vector<FramePlacement> placements = ImageStitcher::AlignFrames(
+                session.frames, method == StitchingMethod::Auto ? OverlapEstimator::Cascade : OverlapEstimator::Auto);
+            for (const FramePlacement& placement : placements) {
+                frameOffsets.push_back(placement.y);
+            }
+            sources.Add(placements);
+
+            cv::Mat canvas(ImageStitcher::CanvasSize(session.frames, placements), CV_8UC4, cv::Scalar(255, 255, 255, 255));
+            std::vector<cv::Mat> frames = session.frames;
+            ImageStitcher::PruneFrames(frames, placements, &pruneStats);
+            auto composeStart = std::chrono::steady_clock::now();
+            ImageStitcher::ComposeFrames(frames, placements, canvas);
+            auto end = std::chrono::steady_clock::now();
+            pruneStats.RecordComposeTime(std::chrono::duration<double, std::milli>(end - composeStart).count());
+            seconds = std::chrono::duration<double>(end - start).count();
+            return !canvas.empty();
+        }
+
+#ifdef _WIN32
+        // The GDI methods take bitmaps, so stage the frames in DIB-backed buffers
+        std::vector<Frame> buffers;
+        std::vector<HBITMAP> bitmaps;
+        for (const cv::Mat& frame : session.frames) {
+            Frame buffer = Frame::Acquire(frame.cols, frame.rows, 4);
+            if (!buffer)
+                return false;
+            cv::Mat target = buffer.Mat();
+            frame.copyTo(target);
+            bitmaps.push_back(buffer.Bitmap());
+            buffers.push_back(std::move(buffer));
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        HBITMAP result = method == StitchingMethod::OpenCVVertical
+            ? ImageStitcher::StitchImagesVertically(bitmaps)
+            : ImageStitcher::CombineVertically(bitmaps);
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (!result)
+            return false;
+        DeleteObject(result);
+
+        // Both methods stack whole frames without looking for overlap
+        int y = 0;
+        for (const cv::Mat& frame : session.frames) {
+            frameOffsets.push_back(y);
+            y += frame.rows;
+        }
+        return true;
+#else
+        // The GDI methods need Windows
+        return false;
+#endif
+    }
+
+    // Run every stitching method over synthetic sessions of every document kind
+    int RunStitchBenchmark(int argc, char** argv) {
+        SyntheticSessionOptions options;
+        std::vector<DocumentKind> kinds;
+        if (!ParseSessionOptions(argc, argv, "bench", options) || !ParseDocuments(argc, argv, "bench", kinds))
+            return 2;
+
+#ifdef _WIN32
+        const char* defaultMethods = "opencv,auto,opencv_vertical,simple";
+#else
+        const char* defaultMethods = "opencv,auto";
+#endif
+        std::vector<StitchingMethod> methods;
+        for (const std::string& name : SplitList(StringArg(argc, argv, "--methods", defaultMethods))) {
+            StitchingMethod method;
+            if (!BatchStitcher::ParseMethod(name, method)) {
+                fprintf(stderr, "bench: unknown method '%s'\n", name.c_str());
+                return 2;
+            }
+            methods.push_back(method);
+        }
+
+        int failures = 0;
+        for (DocumentKind kind : kinds) {
+            SyntheticSession session = SyntheticDocuments::MakeSession(kind, options);
+            double megapixels = (double)options.frameWidth * options.frameHeight * session.frames.size() / 1e6;
+
+            for (StitchingMethod method : methods) {
+                std::vector<int> offsets;
+                double seconds = 0;
+                PruneStats pruneStats;
+                OverlapSourceStats sources;
+                MemorySampler sampler;
+                bool ok = StitchSession(method, session, offsets, seconds, pruneStats, sources);
+                size_t peakBytes = sampler.Finish();
+                if (!ok || offsets.size() != session.trueOffsets.size()) {
+                    fprintf(stderr, "bench: %s failed on %s\n", BatchStitcher::MethodName(method), SyntheticDocuments::KindName(kind));
+                    failures++;
+                    continue;
+                }
+
+                // Offsets are relative to the first frame, which always lands at 0
+                double errorSum = 0;
+                int maxError = 0;
+                int exact = 0;
+                for (size_t i = 1; i < offsets.size(); i++) {
+                    int error = std::abs(offsets[i] - session.trueOffsets[i]);
+                    errorSum += error;
+                    maxError = std::max(maxError, error);
+                    if (error == 0)
+                        exact++;
+                }
+                int pairs = (int)offsets.size() - 1;
+                seconds = std::max(seconds, 1e-9);
+
+                printf("{\"benchmark\":\"stitch_session\",\"method\":\"%s\",\"document\":\"%s\","
+                       "\"width\":%d,\"height\":%d,\"step\":%d,\"frames\":%d,\"seed\":%llu,"
+                       "\"seconds\":%.4f,\"frames_per_s\":%.2f,\"mp_per_s\":%.2f,\"peak_memory_mb\":%.1f,"
+                       "\"mean_offset_error\":%.2f,\"max_offset_error\":%d,\"exact_pairs\":%d,\"pairs\":%d,"
+                       "\"frames_pruned\":%d,\"compose_ms_saved\":%.2f,%s}\n",
+                       BatchStitcher::MethodName(method), SyntheticDocuments::KindName(kind),
+                       options.frameWidth, options.frameHeight, options.scrollStep, (int)session.frames.size(),
+                       (unsigned long long)options.seed,
+                       seconds, session.frames.size() / seconds, megapixels / seconds, peakBytes / (1024.0 * 1024.0),
+                       pairs ? errorSum / pairs : 0.0, maxError, exact, pairs, pruneStats.framesPruned, pruneStats.msSaved,
+                       StitchCorpus::SourcesJson(sources).c_str());
+                fflush(stdout);
+            }
+        }
+        return failures ? 1 : 0;
+    }
+
+    double DoubleArg(int argc, char** argv, const char* name, double defaultValue) {
+        const char* value = StringArg(argc, argv, name, nullptr);
+        return value ? atof(value) : defaultValue;
+    }
+
+    // Write synthetic sessions as a ground-truth corpus, one directory per document kind
+    int RunCorpusMake(int argc, char** argv) {
+        const char* outDir = StringArg(argc, argv, "--out", nullptr);
+        SyntheticSessionOptions options;
+        std::vector<DocumentKind> kinds;
+        if (!outDir) {
+            fprintf(stderr, "corpus-make: --out is required\n");
+            return 2;
+        }
+        if (!ParseSessionOptions(argc, argv, "corpus-make", options) || !ParseDocuments(argc, argv, "corpus-make", kinds))
+            return 2;
+
+        for (DocumentKind kind : kinds) {
+            SyntheticSession session = SyntheticDocuments::MakeSession(kind, options);
+            char name[128];
+            snprintf(name, sizeof(name), "%s-%dx%d-step%d", SyntheticDocuments::KindName(kind),
+                     options.frameWidth, options.frameHeight, options.scrollStep);
+            std::string directory = std::string(outDir) + "/" + name;
+            if (!StitchCorpus::WriteSession(directory, name, session.frames, session.trueOffsets)) {
+                fprintf(stderr, "corpus-make: failed to write %s\n", directory.c_str());
+                return 1;
+            }
+            printf("%s\n", directory.c_str());
+        }
+        return 0;
+    }
+
+    // Align every corpus session, report accuracy and speed, and check against a baseline
+    int RunCorpus(int argc, char** argv) {
+        const char* dir = StringArg(argc, argv, "--dir", nullptr);
+        const char* baselinePath = StringArg(argc, argv, "--baseline", nullptr);
+        const char* writeBaselinePath = StringArg(argc, argv, "--write-baseline", nullptr);
+        int repeat = IntArg(argc, argv, "--repeat", 3);
+        if (!dir) {
+            fprintf(stderr, "corpus: --dir is required\n");
+            return 2;
+        }
+
+        OverlapEstimator estimator;
+        const char* estimatorName = StringArg(argc, argv, "--estimator", "auto");
+        if (!StitchCorpus::ParseEstimator(estimatorName, estimator)) {
+            fprintf(stderr, "corpus: unknown estimator '%s'\n", estimatorName);
+            return 2;
+        }
+
+        CorpusTolerance tolerance;
+        tolerance.meanError = DoubleArg(argc, argv, "--tolerance-error", tolerance.meanError);
+        tolerance.maxError = IntArg(argc, argv, "--tolerance-max-error", tolerance.maxError);
+        tolerance.fallbackRate = DoubleArg(argc, argv, "--tolerance-fallback", tolerance.fallbackRate);
+        tolerance.timeRatio = DoubleArg(argc, argv, "--tolerance-time", tolerance.timeRatio);
+
+        std::vector<std::string> sessions = StitchCorpus::FindSessions(dir);
+        if (sessions.empty()) {
+            fprintf(stderr, "corpus: no sessions (directories with manifest.txt) under %s\n", dir);
+            return 2;
+        }
+
+        std::vector<CorpusResult> results;
+        int failures = 0;
+        for (const std::string& directory : sessions) {
+            CorpusSession session;
+            std::vector<cv::Mat> frames;
+            std::string error;
+            if (!StitchCorpus::LoadSession(directory, session, error) || !StitchCorpus::LoadFrames(session, frames, error)) {
+                fprintf(stderr, "corpus: %s\n", error.c_str());
+                failures++;
+                continue;
+            }
+
+            CorpusResult result = StitchCorpus::Run(session, frames, estimator, repeat);
+            printf("%s\n", StitchCorpus::ToJson(result).c_str());
+            fflush(stdout);
+            results.push_back(result);
+        }
+
+        // Totals across the corpus, weighted by pair count
+        int totalPairs = 0;
+        int maxError = 0;
+        double errorSum = 0, fallbackSum = 0, msSum = 0, searchedSum = 0, rejectedSum = 0;
+        OverlapSourceStats sources;
+        for (const CorpusResult& result : results) {
+            for (int source = 0; source < OverlapSourceStats::kSources; source++) {
+                sources.pairs[source] += result.sources.pairs[source];
+                sources.ms[source] += result.sources.ms[source];
+            }
+            totalPairs += result.pairs;
+            maxError = std::max(maxError, result.maxError);
+            errorSum += result.meanError * result.pairs;
+            fallbackSum += result.fallbackRate * result.pairs;
+            msSum += result.msPerPair * result.pairs;
+            searchedSum += result.searchedPerPair * result.pairs;
+            rejectedSum += result.rejectedPerPair * result.pairs;
+        }
+        if (totalPairs > 0) {
+            printf("{\"benchmark\":\"corpus_total\",\"estimator\":\"%s\",\"sessions\":%d,\"pairs\":%d,"
+                   "\"mean_error\":%.3f,\"max_error\":%d,\"fallback_rate\":%.4f,\"ms_per_pair\":%.3f,\"searched_per_pair\":%.1f,"
+                   "\"rejected_per_pair\":%.3f,%s}\n",
+                   estimatorName, (int)results.size(), totalPairs,
+                   errorSum / totalPairs, maxError, fallbackSum / totalPairs, msSum / totalPairs, searchedSum / totalPairs,
+                   rejectedSum / totalPairs, StitchCorpus::SourcesJson(sources).c_str());
+        }
+
+        if (writeBaselinePath && !StitchCorpus::WriteBaseline(writeBaselinePath, results)) {
+            fprintf(stderr, "corpus: failed to write baseline %s\n", writeBaselinePath);
+            return 1;
+        }
+
+        if (baselinePath) {
+            std::vector<CorpusResult> baseline;
+            if (!StitchCorpus::ReadBaseline(baselinePath, baseline)) {
+                fprintf(stderr, "corpus: cannot read baseline %s\n", baselinePath);
+                return 2;
+            }
+            std::vector<std::string> regressions = StitchCorpus::FindRegressions(results, baseline, tolerance);
+            for (const std::string& regression : regressions) {
+                fprintf(stderr, "corpus: regression: %s\n", regression.c_str());
+            }
+            if (!regressions.empty())
+                return 1;
+        }
+        return failures ? 1 : 0;
+    }
+
+    // Re-stitch every session under a directory on a pool of workers and report throughput
+    // Ctrl+C during a batch cancels it: running jobs stop at their next check
+    // and free their frames, the rest are skipped, and the summary is still printed
+    CancellationToken g_batchCancel;
+
+    void OnBatchInterrupt(int) {
+        g_batchCancel.Cancel();
+    }
+
+    int RunBatch(int argc, char** argv) {
+        const char* inDir = StringArg(argc, argv, "--in", nullptr);
+        const char* outDir = StringArg(argc, argv, "--out", nullptr);
+        if (!inDir || !outDir) {
+            fprintf(stderr, "batch: --in and --out are required\n");
+            return 2;
+        }
+
+        BatchOptions options;
+        const char* methodName = StringArg(argc, argv, "--method", "opencv");
+        if (!BatchStitcher::ParseMethod(methodName, options.method)) {
+            fprintf(stderr, "batch: unknown method '%s'\n", methodName);
+            return 2;
+        }
+        const char* estimatorName = StringArg(argc, argv, "--estimator", "auto");
+        if (!StitchCorpus::ParseEstimator(estimatorName, options.estimator)) {
+            fprintf(stderr, "batch: unknown estimator '%s'\n", estimatorName);
+            return 2;
+        }
+        options.workers = IntArg(argc, argv, "--workers", 0);
+        options.memoryCapBytes = (size_t)std::max(0, IntArg(argc, argv, "--memory-mb", 0)) * 1024 * 1024;
+        options.encodeThreads = IntArg(argc, argv, "--encode-threads", 1);
+        options.cancel = g_batchCancel;
+
+        std::vector<BatchJob> jobs = BatchStitcher::FindJobs(inDir, outDir);
+        if (jobs.empty()) {
+            fprintf(stderr, "batch: no directories with image files under %s\n", inDir);
+            return 2;
+        }
+
+        std::signal(SIGINT, OnBatchInterrupt);
+        BatchSummary summary = BatchStitcher::Run(jobs, options, [](const BatchJobResult& result) {
+            if (result.cancelled)
+                return;
+            if (!result.succeeded) {
+                fprintf(stderr, "batch: %s: %s\n", result.name.c_str(), result.error.c_str());
+                return;
+            }
+            printf("{\"benchmark\":\"batch_job\",\"session\":\"%s\",\"output\":\"%s\",\"frames\":%d,"
+                   "\"width\":%d,\"height\":%d,\"seconds\":%.3f,\"frames_pruned\":%d,\"compose_ms_saved\":%.2f}\n",
+                   result.name.c_str(), result.outputPath.c_str(), result.frames, result.width, result.height, result.seconds,
+                   result.framesPruned, result.msSaved);
+            fflush(stdout);
+        });
+        std::signal(SIGINT, SIG_DFL);
+
+        double wall = std::max(summary.wallSeconds, 1e-9);
+        printf("{\"benchmark\":\"batch\",\"method\":\"%s\",\"estimator\":\"%s\",\"jobs\":%d,\"succeeded\":%d,"
+               "\"cancelled\":%d,\"workers\":%d,\"memory_cap_mb\":%.0f,\"wall_seconds\":%.3f,\"frames\":%lld,\"megapixels\":%.1f,"
+               "\"sessions_per_s\":%.3f,\"frames_per_s\":%.2f,\"mp_per_s\":%.2f,\"peak_reserved_mb\":%.1f}\n",
+               methodName, estimatorName, summary.jobs, summary.succeeded, summary.cancelled, summary.workers,
+               options.memoryCapBytes / (1024.0 * 1024.0), summary.wallSeconds, summary.frames, summary.megapixels,
+               summary.succeeded / wall, summary.frames / wall, summary.megapixels / wall,
+               summary.peakReservedBytes / (1024.0 * 1024.0));
+        return summary.succeeded == summary.jobs ? 0 : 1;
+    }
+
+    // Capture synthetic sessions into pooled frames and stitch them in place,
+    // as the app does, counting buffer allocations per session. Every session
+    // after the warm-up ones must allocate nothing but its canvas.
+    int RunPoolBenchmark(int argc, char** argv) {
+        SyntheticSessionOptions options;
+        std::vector<DocumentKind> kinds;
+        if (!ParseSessionOptions(argc, argv, "pool-bench", options) || !ParseDocuments(argc, argv, "pool-bench", kinds))
+            return 2;
+        int sessions = IntArg(argc, argv, "--sessions", 6);
+        int warmup = IntArg(argc, argv, "--warmup", 2);
+        if (sessions <= warmup || warmup < 1) {
+            fprintf(stderr, "pool-bench: --sessions must exceed --warmup, which must be at least 1\n");
+            return 2;
+        }
+
+        std::vector<SyntheticSession> documents;
+        for (DocumentKind kind : kinds) {
+            documents.push_back(SyntheticDocuments::MakeSession(kind, options));
+        }
+
+        long long steadyAllocations = 0;
+        long long steadyFrames = 0;
+        long long steadySessions = 0;
+        for (int session = 0; session < sessions; session++) {
+            const SyntheticSession& document = documents[session % documents.size()];
+            long long before = FrameBuffer::AllocationCount();
+            auto start = std::chrono::steady_clock::now();
+            {
+                // The copy stands in for the BitBlt into the frame's DIB section
+                std::vector<Frame> frames;
+                for (const cv::Mat& frame : document.frames) {
+                    Frame buffer = Frame::Acquire(frame.cols, frame.rows, 4);
+                    if (!buffer) {
+                        fprintf(stderr, "pool-bench: frame allocation failed\n");
+                        return 1;
+                    }
+                    cv::Mat target = buffer.Mat();
+                    frame.copyTo(target);
+                    frames.push_back(std::move(buffer));
+                }
+                if (!ImageStitcher::StitchFrames(frames, nullptr, nullptr, OverlapEstimator::Cascade)) {
+                    fprintf(stderr, "pool-bench: stitching failed on %s\n", SyntheticDocuments::KindName(document.kind));
+                    return 1;
+                }
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            long long allocations = FrameBuffer::AllocationCount() - before;
+            if (session >= warmup) {
+                steadyAllocations += allocations;
+                steadyFrames += (long long)document.frames.size();
+                steadySessions++;
+            }
+
+            FramePoolStats stats = FramePool::Shared().Stats();
+            printf("{\"benchmark\":\"pool\",\"session\":%d,\"document\":\"%s\",\"warmup\":%s,\"frames\":%zu,"
+                   "\"allocations\":%lld,\"allocations_per_frame\":%.3f,\"reused\":%lld,\"acquired\":%lld,"
+                   "\"held_mb\":%.1f,\"seconds\":%.3f}\n",
+                   session, SyntheticDocuments::KindName(document.kind), session < warmup ? "true" : "false",
+                   document.frames.size(), allocations, (double)allocations / document.frames.size(), stats.reused, stats.acquired,
+                   stats.heldBytes / (1024.0 * 1024.0), seconds);
+            fflush(stdout);
+        }
+
+        printf("{\"benchmark\":\"pool\",\"steady_frames\":%lld,\"steady_allocations\":%lld,\"allocations_per_frame\":%.3f}\n",
+               steadyFrames, steadyAllocations, steadyFrames > 0 ? (double)steadyAllocations / steadyFrames : 0.0);
+        if (steadyAllocations > steadySessions) {
+            fprintf(stderr, "pool-bench: %lld buffer allocations after warm-up besides the canvases\n",
+                    steadyAllocations - steadySessions);
+            return 1;
+        }
+        return 0;
+    }
+
+    void PrintUsage() {
+        fprintf(stderr,
+            "Usage:\n"
+            "  StitchTool test\n"
+            "  StitchTool bench [--width N] [--height N] [--step N] [--frames N] [--seed N] [--side-panel N]\n"
+            "                   [--methods opencv,auto,opencv_vertical,simple] [--documents text,code,table,blank,gradient,noise]\n"
+            "  StitchTool corpus --dir DIR [--estimator auto|features|template|global|cascade] [--repeat N]\n"
+            "                    [--baseline FILE] [--write-baseline FILE] [--tolerance-error X]\n"
+            "                    [--tolerance-max-error N] [--tolerance-fallback X] [--tolerance-time X]\n"
+            "  StitchTool corpus-make --out DIR [--width N] [--height N] [--step N] [--frames N] [--seed N] [--side-panel N]\n"
+            "                         [--documents text,code,...]\n"
+            "  StitchTool batch --in DIR --out DIR [--method opencv|auto|opencv_vertical|simple]\n"
+            "                   [--estimator auto|features|template|global|cascade] [--workers N] [--memory-mb N] [--encode-threads N]\n"
+            "  StitchTool encode-bench [--height N] [--width N] [--max-threads N] [--out file.png]\n"
+            "  StitchTool tile-bench [--height N] [--width N] [--tile N]\n"
+            "  StitchTool kernel-bench [--width N] [--rows N]\n"
+            "  StitchTool width-bench [--rows N] [--min-width N] [--max-width N]\n"
+            "  StitchTool pool-bench [--width N] [--height N] [--step N] [--frames N] [--side-panel N] [--sessions N] [--warmup N]\n"
+            "                        [--documents text,code,...]\n"
+            "  StitchTool executor-bench [--workers N] [--samples N] [--tasks N] [--work-us N] [--load-tasks N]\n"
+            "Any command also accepts --trace FILE to write a Chrome trace of the run.\n");
+    }
+
+    int RunCommand(const std::string& command, int argc, char** argv) {
+        if (command == "test")
+            return RunScreenshotTests() ? 0 : 1;
+        if (command == "bench")
+            return RunStitchBenchmark(argc, argv);
+        if (command == "corpus")
+            return RunCorpus(argc, argv);
+        if (command == "corpus-make")
+            return RunCorpusMake(argc, argv);
+        if (command == "batch")
+            return RunBatch(argc, argv);
+        if (command == "encode-bench")
+            return RunEncodeBenchmark(argc, argv);
+        if (command == "tile-bench")
+            return RunTileBenchmark(argc, argv);
+        if (command == "kernel-bench")
+            return RunKernelBenchmark(argc, argv);
+        if (command == "width-bench")
+            return RunWidthBenchmark(argc, argv);
+        if (command == "pool-bench")
+            return RunPoolBenchmark(argc, argv);
+        if (command == "executor-bench")
+            return RunExecutorBenchmark(argc, argv);
+
+        PrintUsage();
+        return 2;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        PrintUsage();
+        return 2;
+    }
+
+    // Any command can be traced; spans default to per-frame detail
+    const char* tracePath = StringArg(argc - 2, argv + 2, "--trace", nullptr);
+    if (!tracePath)
+        return RunCommand(argv[1], argc - 2, argv + 2);
+
+    if (Trace::Level() <= 0)
+        Trace::SetLevel(TRACE_DEBUG);
+    Trace::BeginSession();
+    int result = RunCommand(argv[1], argc - 2, argv + 2);
+    if (!Trace::WriteChromeTrace(tracePath)) {
+        fprintf(stderr, "failed to write trace %s\n", tracePath);
+        return result ? result : 1;
+    }
+    return result;
+}
+
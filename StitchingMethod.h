@@ -0,0 +1,9 @@
+#pragma once
+
+// Enum for different stitching methods
+enum class StitchingMethod {
+    Simple,              // Simple vertical stacking
+    OpenCV,              // OpenCV stitching with feature matching
+    OpenCVVertical,      // OpenCV simple vertical stitching
+    Auto                 // OpenCV stitching, cheapest estimator first (OverlapEstimator::Cascade)
+};
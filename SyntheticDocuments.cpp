@@ -0,0 +1,210 @@
+#include "SyntheticDocuments.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// OpenCV 4 headers
+#include <opencv2/imgproc.hpp>
+
+namespace {
+    const cv::Scalar kWhite(255, 255, 255, 255);
+
+    // Scrollbar of sessions with a side panel: a track with a thumb inset 4 columns on each side
+    const int kScrollbarWidth = 16;
+    const cv::Scalar kScrollbarTrack(238, 238, 238, 255);
+    const cv::Scalar kScrollbarThumb(150, 150, 150, 255);
+
+    const char* kCodeLines[] = {
+        "for (int i = 0; i < count; i++) {",
+        "if (!result.empty()) {",
+        "}",
+        "return result;",
+        "cv::Mat roi = image(rect);",
+        "} else {",
+        "std::vector<int> values;",
+        "",
+        "// Process each element",
+        "values.push_back(i);",
+    };
+
+    cv::Mat RenderText(int width, int height, cv::RNG& rng) {
+        // Words are drawn as ink blocks; cheap to render and still full of
+        // short repeated shapes, like real text
+        cv::Mat page(height, width, CV_8UC4, kWhite);
+        const int lineHeight = 22;
+        for (int y = 10; y + lineHeight < height; y += lineHeight) {
+            // Leave a paragraph gap every few lines
+            if (rng.uniform(0, 8) == 0)
+                continue;
+            int indent = 20 + 40 * rng.uniform(0, 4);
+            int x = indent;
+            int lineEnd = width - rng.uniform(20, std::max(21, width / 3));
+            while (x < lineEnd) {
+                int wordWidth = rng.uniform(12, 80);
+                cv::Scalar ink(rng.uniform(0, 90), rng.uniform(0, 90), rng.uniform(0, 90), 255);
+                cv::rectangle(page, cv::Rect(x, y + 4, std::min(wordWidth, lineEnd - x), lineHeight - 10), ink, cv::FILLED);
+                x += wordWidth + rng.uniform(6, 12);
+            }
+        }
+        return page;
+    }
+
+    cv::Mat RenderCode(int width, int height, cv::RNG& rng) {
+        cv::Mat page(height, width, CV_8UC4, cv::Scalar(30, 30, 30, 255));
+        const int lineCount = sizeof(kCodeLines) / sizeof(kCodeLines[0]);
+        const int lineHeight = 20;
+        int indent = 0;
+        for (int y = lineHeight; y < height; y += lineHeight) {
+            const char* text = kCodeLines[rng.uniform(0, lineCount)];
+            if (text[0] == '}' && indent > 0)
+                indent--;
+            cv::Scalar color = text[0] == '/' ? cv::Scalar(90, 160, 90, 255) : cv::Scalar(220, 220, 220, 255);
+            cv::putText(page, text, cv::Point(16 + indent * 32, y), cv::FONT_HERSHEY_PLAIN, 1.1, color, 1, cv::LINE_8);
+            if (text[0] != '\0' && text[strlen(text) - 1] == '{' && indent < 6)
+                indent++;
+        }
+        return page;
+    }
+
+    cv::Mat RenderTable(int width, int height, cv::RNG& rng) {
+        cv::Mat page(height, width, CV_8UC4, kWhite);
+        const int rowHeight = 24;
+        const int colWidth = 112;
+        for (int y = 0; y < height; y += rowHeight) {
+            if ((y / rowHeight) % 2 == 1)
+                cv::rectangle(page, cv::Rect(0, y, width, rowHeight), cv::Scalar(246, 243, 240, 255), cv::FILLED);
+            cv::line(page, cv::Point(0, y), cv::Point(width - 1, y), cv::Scalar(210, 210, 210, 255));
+            for (int x = 0; x < width; x += colWidth) {
+                // Roughly a third of the cells are empty, as in most real sheets
+                if (rng.uniform(0, 3) == 0)
+                    continue;
+                std::string value = std::to_string(rng.uniform(0, 100000));
+                cv::putText(page, value, cv::Point(x + colWidth - 10 - 9 * (int)value.size(), y + rowHeight - 7),
+                            cv::FONT_HERSHEY_PLAIN, 1.0, cv::Scalar(40, 40, 40, 255), 1, cv::LINE_8);
+            }
+        }
+        for (int x = 0; x < width; x += colWidth) {
+            cv::line(page, cv::Point(x, 0), cv::Point(x, height - 1), cv::Scalar(210, 210, 210, 255));
+        }
+        return page;
+    }
+
+    cv::Mat RenderBlank(int width, int height, cv::RNG& rng) {
+        cv::Mat page(height, width, CV_8UC4, kWhite);
+        // A heading every 600-1200 rows; everything else is empty
+        for (int y = rng.uniform(100, 400); y < height; y += rng.uniform(600, 1200)) {
+            cv::putText(page, "Section " + std::to_string(y), cv::Point(40, y), cv::FONT_HERSHEY_SIMPLEX, 1.0,
+                        cv::Scalar(60, 60, 60, 255), 2, cv::LINE_AA);
+        }
+        return page;
+    }
+
+    cv::Mat RenderGradient(int width, int height, cv::RNG& rng) {
+        cv::Mat page(height, width, CV_8UC4);
+        double period = rng.uniform(600.0, 1400.0);
+        for (int y = 0; y < height; y++) {
+            uint8_t* row = page.ptr<uint8_t>(y);
+            double t = 0.5 + 0.5 * std::sin(y * 6.283185307 / period);
+            for (int x = 0; x < width; x++) {
+                double s = (double)x / std::max(1, width - 1);
+                row[x * 4 + 0] = (uint8_t)(255 * t);
+                row[x * 4 + 1] = (uint8_t)(255 * s);
+                row[x * 4 + 2] = (uint8_t)(255 * (1.0 - t) * (1.0 - s));
+                row[x * 4 + 3] = 255;
+            }
+        }
+        return page;
+    }
+
+    cv::Mat RenderNoise(int width, int height, cv::RNG& rng) {
+        // Low-frequency blobs plus per-pixel grain, like a photo
+        cv::Mat small(std::max(1, height / 16), std::max(1, width / 16), CV_8UC4);
+        rng.fill(small, cv::RNG::UNIFORM, 0, 256);
+        cv::Mat page;
+        cv::resize(small, page, cv::Size(width, height), 0, 0, cv::INTER_CUBIC);
+        cv::Mat grain(height, width, CV_8UC4);
+        rng.fill(grain, cv::RNG::NORMAL, 0, 12);
+        cv::add(page, grain, page);
+        page.forEach<cv::Vec4b>([](cv::Vec4b& pixel, const int*) { pixel[3] = 255; });
+        return page;
+    }
+}
+
+std::vector<DocumentKind> SyntheticDocuments::AllKinds() {
+    return { DocumentKind::Text, DocumentKind::Code, DocumentKind::Table,
+             DocumentKind::Blank, DocumentKind::Gradient, DocumentKind::Noise };
+}
+
+const char* SyntheticDocuments::KindName(DocumentKind kind) {
+    switch (kind) {
+        case DocumentKind::Text: return "text";
+        case DocumentKind::Code: return "code";
+        case DocumentKind::Table: return "table";
+        case DocumentKind::Blank: return "blank";
+        case DocumentKind::Gradient: return "gradient";
+        case DocumentKind::Noise: return "noise";
+    }
+    return "unknown";
+}
+
+bool SyntheticDocuments::ParseKind(const std::string& name, DocumentKind& kind) {
+    for (DocumentKind candidate : AllKinds()) {
+        if (name == KindName(candidate)) {
+            kind = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+cv::Mat SyntheticDocuments::RenderPage(DocumentKind kind, int width, int height, uint64_t seed) {
+    cv::RNG rng(seed ? seed : 1);
+    switch (kind) {
+        case DocumentKind::Text: return RenderText(width, height, rng);
+        case DocumentKind::Code: return RenderCode(width, height, rng);
+        case DocumentKind::Table: return RenderTable(width, height, rng);
+        case DocumentKind::Blank: return RenderBlank(width, height, rng);
+        case DocumentKind::Gradient: return RenderGradient(width, height, rng);
+        case DocumentKind::Noise: return RenderNoise(width, height, rng);
+    }
+    return cv::Mat(height, width, CV_8UC4, kWhite);
+}
+
+SyntheticSession SyntheticDocuments::MakeSession(DocumentKind kind, const SyntheticSessionOptions& options) {
+    SyntheticSession session;
+    session.kind = kind;
+
+    int frameCount = std::max(1, options.frameCount);
+    int pageHeight = options.frameHeight + options.scrollStep * (frameCount - 1);
+    int panelWidth = std::max(0, std::min(options.sidePanelWidth, options.frameWidth / 2));
+    int scrollbarWidth = panelWidth > 0 ? kScrollbarWidth : 0;
+    int contentWidth = options.frameWidth - panelWidth - scrollbarWidth;
+    session.page = RenderPage(kind, contentWidth, pageHeight, options.seed);
+
+    // The panel shows the same thing in every frame; the scrollbar's thumb tracks the scroll position
+    cv::Mat panel;
+    if (panelWidth > 0) {
+        panel = RenderPage(DocumentKind::Text, panelWidth, options.frameHeight, options.seed + 1);
+        panel.colRange(panelWidth - 1, panelWidth).setTo(cv::Scalar(200, 200, 200, 255));
+    }
+    int thumbHeight = std::max(20, options.frameHeight * options.frameHeight / pageHeight);
+    int thumbTravel = options.frameHeight - thumbHeight;
+
+    for (int i = 0; i < frameCount; i++) {
+        int top = i * options.scrollStep;
+        cv::Mat frame(options.frameHeight, options.frameWidth, CV_8UC4, kWhite);
+        cv::Mat content = frame(cv::Rect(panelWidth, 0, contentWidth, options.frameHeight));
+        session.page(cv::Rect(0, top, contentWidth, options.frameHeight)).copyTo(content);
+        if (panelWidth > 0) {
+            cv::Mat panelArea = frame(cv::Rect(0, 0, panelWidth, options.frameHeight));
+            panel.copyTo(panelArea);
+            int thumbTop = pageHeight > options.frameHeight ? top * thumbTravel / (pageHeight - options.frameHeight) : 0;
+            cv::Rect track(options.frameWidth - scrollbarWidth, 0, scrollbarWidth, options.frameHeight);
+            cv::rectangle(frame, track, kScrollbarTrack, cv::FILLED);
+            cv::rectangle(frame, cv::Rect(track.x + 4, thumbTop, scrollbarWidth - 8, thumbHeight), kScrollbarThumb, cv::FILLED);
+        }
+        session.frames.push_back(frame);
+        session.trueOffsets.push_back(top);
+    }
+    return session;
+}
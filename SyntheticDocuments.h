@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+// OpenCV 4 headers
+#include <opencv2/core.hpp>
+
+// Kinds of content a synthetic scrolling session can show
+enum class DocumentKind {
+	Text,       // Paragraphs of rendered text
+	Code,       // Code listing with repeated brackets and indentation
+	Table,      // Spreadsheet-like grid with banded rows
+	Blank,      // Mostly empty page with sparse headings
+	Gradient,   // Smooth vertical/horizontal gradients
+	Noise       // Photo-like noisy image
+};
+
+// Parameters for generating a scrolling session
+struct SyntheticSessionOptions {
+	int frameWidth = 1000;
+	int frameHeight = 700;
+	int scrollStep = 200;      // Rows the content moves between frames
+	int frameCount = 12;
+	uint64_t seed = 1;         // Same seed + options always produce the same session
+	int sidePanelWidth = 0;    // Columns of a fixed panel left of the content, with a scrollbar on the right; 0 = neither
+};
+
+// A deterministic capture session with known ground truth
+struct SyntheticSession {
+	DocumentKind kind = DocumentKind::Text;
+	cv::Mat page;                      // The full document (CV_8UC4), without any side panel or scrollbar
+	std::vector<cv::Mat> frames;       // Viewport captures (CV_8UC4)
+	std::vector<int> trueOffsets;      // Top row of each frame on the page
+};
+
+// Generates synthetic documents and the frame sequences a scrolling capture of them would produce
+class SyntheticDocuments {
+public:
+	// All document kinds, in a stable order
+	static std::vector<DocumentKind> AllKinds();
+
+	// Lower-case name used in benchmark output and command-line filters
+	static const char* KindName(DocumentKind kind);
+
+	// Parse a name produced by KindName(); returns false if unknown
+	static bool ParseKind(const std::string& name, DocumentKind& kind);
+
+	// Render a full page of the given kind (CV_8UC4)
+	static cv::Mat RenderPage(DocumentKind kind, int width, int height, uint64_t seed);
+
+	// Render a page tall enough for the session and cut it into frames
+	static SyntheticSession MakeSession(DocumentKind kind, const SyntheticSessionOptions& options);
+};
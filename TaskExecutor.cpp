@@ -0,0 +1,210 @@
+#include "TaskExecutor.h"
+#include <algorithm>
+#include <exception>
+
+namespace {
+    // Which pool and worker the calling thread belongs to, and the priority of its task
+    thread_local TaskExecutor* t_executor = nullptr;
+    thread_local int t_workerIndex = -1;
+    thread_local TaskPriority t_priority = TaskPriority::Normal;
+}
+
+TaskExecutor::TaskExecutor(int workerCount) {
+    if (workerCount <= 0)
+        workerCount = (int)std::max(1u, std::thread::hardware_concurrency());
+
+    for (int level = 0; level < kPriorityCount; level++) {
+        _pending[level].store(0);
+    }
+
+    // Every deque exists before any worker can try to steal from it
+    for (int i = 0; i < workerCount; i++) {
+        _workers.push_back(std::make_unique<Worker>());
+    }
+    for (int i = 0; i < workerCount; i++) {
+        _workers[i]->thread = std::thread(&TaskExecutor::WorkerLoop, this, i);
+    }
+}
+
+TaskExecutor::~TaskExecutor() {
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _stopping = true;
+    }
+    _wake.notify_all();
+    for (auto& worker : _workers) {
+        worker->thread.join();
+    }
+}
+
+TaskExecutor& TaskExecutor::Shared() {
+    static TaskExecutor executor;
+    return executor;
+}
+
+TaskExecutor& TaskExecutor::Current() {
+    return t_executor ? *t_executor : Shared();
+}
+
+TaskPriority TaskExecutor::CurrentPriority() {
+    return t_priority;
+}
+
+void TaskExecutor::Post(TaskPriority priority, std::function<void()> task) {
+    int level = (int)priority;
+
+    // The counters change under the queue's lock, so a taker never sees a task it cannot find
+    if (t_executor == this) {
+        Worker& own = *_workers[t_workerIndex];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        own.queues[level].push_back(std::move(task));
+        _pending[level]++;
+        _queued++;
+    } else {
+        std::lock_guard<std::mutex> lock(_injectionMutex);
+        _injection[level].push_back(std::move(task));
+        _pending[level]++;
+        _queued++;
+    }
+    Wake();
+}
+
+void TaskExecutor::Wake() {
+    if (_sleepers.load() > 0) {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _wake.notify_one();
+    }
+}
+
+bool TaskExecutor::TryTake(int workerIndex, std::function<void()>& task, TaskPriority& priority) {
+    int workerCount = (int)_workers.size();
+    auto take = [&](std::deque<std::function<void()>>& queue, bool newest, int level) {
+        if (queue.empty())
+            return false;
+        if (newest) {
+            task = std::move(queue.back());
+            queue.pop_back();
+        } else {
+            task = std::move(queue.front());
+            queue.pop_front();
+        }
+        _pending[level]--;
+        _queued--;
+        priority = (TaskPriority)level;
+        return true;
+    };
+
+    for (int level = 0; level < kPriorityCount; level++) {
+        if (_pending[level].load() <= 0)
+            continue;
+
+        // The newest task this worker spawned is the one whose data is still in cache
+        {
+            Worker& own = *_workers[workerIndex];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (take(own.queues[level], true, level))
+                return true;
+        }
+        {
+            std::lock_guard<std::mutex> lock(_injectionMutex);
+            if (take(_injection[level], false, level))
+                return true;
+        }
+        for (int offset = 1; offset < workerCount; offset++) {
+            Worker& victim = *_workers[(workerIndex + offset) % workerCount];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (take(victim.queues[level], false, level)) {
+                _stolen.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void TaskExecutor::RunTask(std::function<void()>& task, TaskPriority priority) {
+    TaskPriority previous = t_priority;
+    t_priority = priority;
+    task();
+    task = nullptr;
+    t_priority = previous;
+}
+
+void TaskExecutor::WorkerLoop(int index) {
+    t_executor = this;
+    t_workerIndex = index;
+
+    std::function<void()> task;
+    TaskPriority priority;
+    while (true) {
+        if (TryTake(index, task, priority)) {
+            RunTask(task, priority);
+            continue;
+        }
+
+        // Sleep until something is queued; on shutdown, exit only once the queues are drained
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        _sleepers++;
+        _wake.wait(lock, [this]() { return _queued.load() > 0 || _stopping.load(); });
+        _sleepers--;
+        if (_stopping && _queued.load() == 0)
+            break;
+    }
+}
+
+void TaskExecutor::ParallelFor(int count, const std::function<void(int)>& fn, int maxConcurrency) {
+    int concurrency = maxConcurrency > 0 ? maxConcurrency : WorkerCount() + 1;
+    concurrency = std::min(concurrency, count);
+    if (concurrency <= 1) {
+        for (int i = 0; i < count; i++) {
+            fn(i);
+        }
+        return;
+    }
+
+    // Helpers that start after every index is claimed return without touching fn,
+    // so only the state has to outlive this call
+    struct State {
+        int count = 0;
+        std::atomic<int> next{ 0 };
+        std::atomic<int> done{ 0 };
+        std::atomic<bool> failed{ false };
+        std::mutex mutex;
+        std::condition_variable finished;
+        std::exception_ptr error;
+    };
+    auto state = std::make_shared<State>();
+    state->count = count;
+    const std::function<void(int)>* body = &fn;
+
+    auto work = [state, body]() {
+        for (int i = state->next++; i < state->count; i = state->next++) {
+            // After a failure (such as a cancellation) the remaining indices are only counted
+            if (!state->failed.load()) {
+                try {
+                    (*body)(i);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    if (!state->error)
+                        state->error = std::current_exception();
+                    state->failed = true;
+                }
+            }
+            if (state->done.fetch_add(1) + 1 == state->count) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->finished.notify_all();
+            }
+        }
+    };
+
+    TaskPriority priority = CurrentPriority();
+    for (int i = 0; i < concurrency - 1; i++) {
+        Post(priority, work);
+    }
+    work();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->finished.wait(lock, [&]() { return state->done.load() == count; });
+    if (state->error)
+        std::rethrow_exception(state->error);
+}
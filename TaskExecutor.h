@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Higher priorities are always dispatched first. Work already running is not
+// interrupted, so long jobs should be split into tasks to stay preemptible.
+enum class TaskPriority {
+	Interactive = 0,   // The user is waiting: capture and the stitch that follows it
+	Normal = 1,        // Default for work submitted outside any task
+	Background = 2     // Batch stitching and other bulk work
+};
+
+// Thread pool with one deque per worker and priority level. Tasks a worker
+// spawns go on its own deque, which it pops newest-first; idle workers steal
+// oldest-first from the others. Tasks from outside the pool go through a
+// shared FIFO per priority. Tasks submitted without a priority inherit the
+// priority of the task that submits them.
+class TaskExecutor {
+public:
+	// workerCount 0 = one per hardware thread
+	explicit TaskExecutor(int workerCount = 0);
+
+	// Runs every queued task, then joins the workers
+	~TaskExecutor();
+
+	TaskExecutor(const TaskExecutor&) = delete;
+	TaskExecutor& operator=(const TaskExecutor&) = delete;
+
+	// Process-wide pool used by capture, stitching and encoding
+	static TaskExecutor& Shared();
+
+	// The pool running the calling thread's task, or Shared() outside any pool
+	static TaskExecutor& Current();
+
+	// Priority of the calling thread's task, or Normal outside any pool
+	static TaskPriority CurrentPriority();
+
+	int WorkerCount() const { return (int)_workers.size(); }
+
+	// Tasks taken from another worker's deque since construction
+	long long StolenCount() const { return _stolen.load(std::memory_order_relaxed); }
+
+	// Queue a task with no result; exceptions escaping it terminate the process
+	void Post(TaskPriority priority, std::function<void()> task);
+
+	// Queue a task and get its result (or exception) through a future.
+	// Do not block a worker on the future of a task that may still be queued;
+	// use ParallelFor for fork-join work inside tasks.
+	template <typename F>
+	auto Submit(TaskPriority priority, F&& fn) -> std::future<std::invoke_result_t<std::decay_t<F>>> {
+		using Result = std::invoke_result_t<std::decay_t<F>>;
+		auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(fn));
+		std::future<Result> future = task->get_future();
+		Post(priority, [task]() { (*task)(); });
+		return future;
+	}
+
+	template <typename F>
+	auto Submit(F&& fn) {
+		return Submit(CurrentPriority(), std::forward<F>(fn));
+	}
+
+	// Run fn(index) for every index in [0, count) on up to maxConcurrency
+	// threads (0 = every worker), at the caller's priority. The caller works
+	// through indices too, so this is safe to call from inside a task. Once fn
+	// throws, indices not yet started are skipped and the first exception is
+	// rethrown here after the running ones finish.
+	void ParallelFor(int count, const std::function<void(int)>& fn, int maxConcurrency = 0);
+
+private:
+	static const int kPriorityCount = 3;
+
+	struct Worker {
+		std::mutex mutex;
+		std::deque<std::function<void()>> queues[kPriorityCount];
+		std::thread thread;
+	};
+
+	void WorkerLoop(int index);
+	bool TryTake(int workerIndex, std::function<void()>& task, TaskPriority& priority);
+	void RunTask(std::function<void()>& task, TaskPriority priority);
+	void Wake();
+
+	std::vector<std::unique_ptr<Worker>> _workers;
+
+	// Shared FIFO for tasks submitted from outside the pool
+	std::mutex _injectionMutex;
+	std::deque<std::function<void()>> _injection[kPriorityCount];
+
+	// Queued tasks per priority, so workers can skip empty levels without locking
+	std::atomic<int> _pending[kPriorityCount];
+	std::atomic<int> _queued{ 0 };
+	std::atomic<long long> _stolen{ 0 };
+
+	std::mutex _sleepMutex;
+	std::condition_variable _wake;
+	std::atomic<int> _sleepers{ 0 };
+	std::atomic<bool> _stopping{ false };
+};
@@ -0,0 +1,234 @@
+#include "TiledCanvas.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+
+#include <zlib.h>
+
+namespace {
+    const char kArchiveMagic[4] = { 'S', 'T', 'C', '1' };
+
+    // Deflate cannot expand data by more than this; a larger rawSize is corrupt
+    const uint64_t kMaxDeflateRatio = 1032;
+
+    struct ArchiveHeader {
+        char magic[4];
+        int32_t width;
+        int32_t height;
+        int32_t channels;
+        int32_t tileSize;
+        uint32_t uniqueTiles;
+        uint64_t rawSize;
+        uint64_t compressedSize;
+    };
+}
+
+uint64_t TiledCanvas::HashTile(const uint8_t* data, size_t size) {
+    // 64-bit multiply-xorshift over 8-byte words; fast enough to hash every
+    // tile of a 20k-row canvas in a few milliseconds. Lookups verify the bytes.
+    const uint64_t k = 0x9E3779B97F4A7C15ull;
+    uint64_t h = 0xCBF29CE484222325ull ^ (size * k);
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        word *= k;
+        word ^= word >> 29;
+        h = (h ^ word) * 0xBF58476D1CE4E5B9ull;
+    }
+    for (; i < size; i++) {
+        h = (h ^ data[i]) * 0x94D049BB133111EBull;
+    }
+    h ^= h >> 31;
+    h *= 0x94D049BB133111EBull;
+    h ^= h >> 29;
+    return h;
+}
+
+uint32_t TiledCanvas::Intern(const uint8_t* tile) {
+    size_t tileBytes = (size_t)_tileSize * _tileSize * _channels;
+    uint64_t hash = HashTile(tile, tileBytes);
+
+    auto range = _index.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (memcmp(_tiles.data() + (size_t)it->second * tileBytes, tile, tileBytes) == 0)
+            return it->second;
+    }
+
+    uint32_t id = (uint32_t)(_tiles.size() / tileBytes);
+    _tiles.insert(_tiles.end(), tile, tile + tileBytes);
+    _index.emplace(hash, id);
+    return id;
+}
+
+TiledCanvas TiledCanvas::FromMat(const cv::Mat& image, int tileSize) {
+    TiledCanvas canvas;
+    if (image.empty() || image.depth() != CV_8U || tileSize <= 0 || tileSize > MaxTileSize)
+        return canvas;
+
+    canvas._width = image.cols;
+    canvas._height = image.rows;
+    canvas._channels = image.channels();
+    canvas._tileSize = tileSize;
+    canvas._tilesX = (image.cols + tileSize - 1) / tileSize;
+    canvas._tilesY = (image.rows + tileSize - 1) / tileSize;
+    canvas._tileMap.resize((size_t)canvas._tilesX * canvas._tilesY);
+
+    size_t tileRowBytes = (size_t)tileSize * canvas._channels;
+    std::vector<uint8_t> tile(tileRowBytes * tileSize);
+
+    for (int ty = 0; ty < canvas._tilesY; ty++) {
+        int y0 = ty * tileSize;
+        int rows = std::min(tileSize, image.rows - y0);
+        for (int tx = 0; tx < canvas._tilesX; tx++) {
+            int x0 = tx * tileSize;
+            size_t rowBytes = (size_t)std::min(tileSize, image.cols - x0) * canvas._channels;
+
+            // Edge tiles are zero padded so identical edges still deduplicate
+            if (rows < tileSize || rowBytes < tileRowBytes)
+                std::fill(tile.begin(), tile.end(), 0);
+            for (int r = 0; r < rows; r++) {
+                memcpy(tile.data() + r * tileRowBytes, image.ptr<uint8_t>(y0 + r) + (size_t)x0 * canvas._channels, rowBytes);
+            }
+
+            canvas._tileMap[(size_t)ty * canvas._tilesX + tx] = canvas.Intern(tile.data());
+        }
+    }
+
+    return canvas;
+}
+
+void TiledCanvas::ExpandRow(int y, uint8_t* out) const {
+    int ty = y / _tileSize;
+    int r = y % _tileSize;
+    size_t tileRowBytes = (size_t)_tileSize * _channels;
+    size_t tileBytes = tileRowBytes * _tileSize;
+    size_t rowBytes = (size_t)_width * _channels;
+
+    const uint32_t* ids = _tileMap.data() + (size_t)ty * _tilesX;
+    for (int tx = 0; tx < _tilesX; tx++) {
+        size_t offset = (size_t)tx * tileRowBytes;
+        size_t bytes = std::min(tileRowBytes, rowBytes - offset);
+        memcpy(out + offset, _tiles.data() + ids[tx] * tileBytes + r * tileRowBytes, bytes);
+    }
+}
+
+cv::Mat TiledCanvas::ToMat() const {
+    if (Empty())
+        return cv::Mat();
+
+    cv::Mat image(_height, _width, CV_8UC(_channels));
+    for (int y = 0; y < _height; y++) {
+        ExpandRow(y, image.ptr<uint8_t>(y));
+    }
+    return image;
+}
+
+TileDedupStats TiledCanvas::Stats() const {
+    TileDedupStats stats;
+    stats.gridTiles = (int)_tileMap.size();
+    size_t tileBytes = (size_t)_tileSize * _tileSize * _channels;
+    stats.uniqueTiles = tileBytes ? (int)(_tiles.size() / tileBytes) : 0;
+    stats.denseBytes = (size_t)_width * _height * _channels;
+    stats.storedBytes = _tiles.size() + _tileMap.size() * sizeof(uint32_t);
+    return stats;
+}
+
+bool TiledCanvas::WriteArchive(const std::string& path) const {
+    // Tile map and tile pixels are deflated together
+    size_t mapBytes = _tileMap.size() * sizeof(uint32_t);
+    std::vector<uint8_t> raw(mapBytes + _tiles.size());
+    if (mapBytes) memcpy(raw.data(), _tileMap.data(), mapBytes);
+    if (!_tiles.empty()) memcpy(raw.data() + mapBytes, _tiles.data(), _tiles.size());
+
+    uLongf compressedSize = compressBound((uLong)raw.size());
+    std::vector<uint8_t> compressed(compressedSize);
+    if (compress2(compressed.data(), &compressedSize, raw.data(), (uLong)raw.size(), Z_BEST_SPEED) != Z_OK)
+        return false;
+
+    ArchiveHeader header = {};
+    memcpy(header.magic, kArchiveMagic, sizeof(kArchiveMagic));
+    header.width = _width;
+    header.height = _height;
+    header.channels = _channels;
+    header.tileSize = _tileSize;
+    header.uniqueTiles = (uint32_t)Stats().uniqueTiles;
+    header.rawSize = raw.size();
+    header.compressedSize = compressedSize;
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(compressed.data()), (std::streamsize)compressedSize);
+    return (bool)file;
+}
+
+bool TiledCanvas::ReadArchive(const std::string& path, TiledCanvas& canvas) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+
+    ArchiveHeader header = {};
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        memcmp(header.magic, kArchiveMagic, sizeof(kArchiveMagic)) != 0 ||
+        header.width <= 0 || header.height <= 0 || header.tileSize <= 0 || header.tileSize > MaxTileSize ||
+        (header.channels != 1 && header.channels != 3 && header.channels != 4))
+        return false;
+
+    // The header is untrusted: the sizes it gives must follow from the
+    // dimensions and fit in the file before anything is allocated. Tile ids
+    // are 32-bit, so the grid and the unique tiles fit in 32 bits and none of
+    // these products overflow.
+    int tilesX = (int)(((int64_t)header.width + header.tileSize - 1) / header.tileSize);
+    int tilesY = (int)(((int64_t)header.height + header.tileSize - 1) / header.tileSize);
+    uint64_t gridTiles = (uint64_t)tilesX * tilesY;
+    if (gridTiles > UINT32_MAX || header.uniqueTiles == 0 || header.uniqueTiles > gridTiles)
+        return false;
+    uint64_t mapBytes = gridTiles * sizeof(uint32_t);
+    uint64_t tileBytes = (uint64_t)header.tileSize * header.tileSize * header.channels;
+    if (header.rawSize != mapBytes + header.uniqueTiles * tileBytes)
+        return false;
+
+    std::streamoff start = file.tellg();
+    file.seekg(0, std::ios::end);
+    uint64_t remaining = (uint64_t)(file.tellg() - start);
+    file.seekg(start);
+    if (header.compressedSize == 0 || header.compressedSize != remaining ||
+        header.rawSize > header.compressedSize * kMaxDeflateRatio || header.rawSize > SIZE_MAX)
+        return false;
+
+    std::vector<uint8_t> compressed((size_t)header.compressedSize);
+    if (!file.read(reinterpret_cast<char*>(compressed.data()), (std::streamsize)compressed.size()))
+        return false;
+
+    std::vector<uint8_t> raw((size_t)header.rawSize);
+    uLongf rawSize = (uLongf)raw.size();
+    if (uncompress(raw.data(), &rawSize, compressed.data(), (uLong)compressed.size()) != Z_OK || rawSize != raw.size())
+        return false;
+
+    TiledCanvas result;
+    result._width = header.width;
+    result._height = header.height;
+    result._channels = header.channels;
+    result._tileSize = header.tileSize;
+    result._tilesX = tilesX;
+    result._tilesY = tilesY;
+
+    result._tileMap.resize((size_t)gridTiles);
+    memcpy(result._tileMap.data(), raw.data(), (size_t)mapBytes);
+    result._tiles.assign(raw.begin() + (ptrdiff_t)mapBytes, raw.end());
+    for (uint32_t id : result._tileMap) {
+        if (id >= header.uniqueTiles)
+            return false;
+    }
+
+    // Rebuild the hash index so the canvas can keep interning tiles
+    for (uint32_t id = 0; id < header.uniqueTiles; id++) {
+        result._index.emplace(HashTile(result._tiles.data() + (size_t)(id * tileBytes), (size_t)tileBytes), id);
+    }
+
+    canvas = std::move(result);
+    return true;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+// OpenCV 4 headers
+#include <opencv2/core.hpp>
+
+// Deduplication statistics for a tiled canvas
+struct TileDedupStats {
+	int gridTiles = 0;           // Tiles covering the canvas
+	int uniqueTiles = 0;         // Tiles actually stored
+	size_t denseBytes = 0;       // Size of the equivalent dense canvas
+	size_t storedBytes = 0;      // Unique tile pixels + tile map
+
+	double DedupRatio() const { return uniqueTiles ? (double)gridTiles / uniqueTiles : 0.0; }
+};
+
+// Content-addressed storage for a composed canvas.
+// The canvas is cut into fixed-size tiles; each distinct tile is stored once,
+// keyed by a 64-bit content hash (verified byte-for-byte on lookup, so hash
+// collisions can never merge different tiles). A tile map records which
+// unique tile covers each grid cell. Long pages with blank gutters, repeated
+// backgrounds or identical list rows collapse to a small set of tiles.
+class TiledCanvas {
+public:
+	static const int DefaultTileSize = 32;
+	static const int MaxTileSize = 4096;
+
+	TiledCanvas() = default;
+
+	// Build from a dense 8-bit image (1, 3 or 4 channels). Edge tiles are padded with zeros.
+	// Returns an empty canvas if tileSize is not in 1..MaxTileSize.
+	static TiledCanvas FromMat(const cv::Mat& image, int tileSize = DefaultTileSize);
+
+	int Width() const { return _width; }
+	int Height() const { return _height; }
+	int Channels() const { return _channels; }
+	int TileSize() const { return _tileSize; }
+	bool Empty() const { return _width == 0 || _height == 0; }
+
+	// Expand one canvas row into out (Width() * Channels() bytes).
+	// Used by encoders to materialize pixels lazily, a row at a time.
+	void ExpandRow(int y, uint8_t* out) const;
+
+	// Expand the whole canvas back to a dense image
+	cv::Mat ToMat() const;
+
+	TileDedupStats Stats() const;
+
+	// Compact on-disk form: tile map plus deflated unique tiles.
+	// Returns false on I/O or format errors. ReadArchive checks the sizes in
+	// the header against the canvas dimensions and the file before allocating.
+	bool WriteArchive(const std::string& path) const;
+	static bool ReadArchive(const std::string& path, TiledCanvas& canvas);
+
+private:
+	// Store a tile (tileSize * tileSize * channels bytes) and return its id
+	uint32_t Intern(const uint8_t* tile);
+
+	static uint64_t HashTile(const uint8_t* data, size_t size);
+
+	int _width = 0;
+	int _height = 0;
+	int _channels = 0;
+	int _tileSize = DefaultTileSize;
+	int _tilesX = 0;
+	int _tilesY = 0;
+
+	std::vector<uint32_t> _tileMap;                               // _tilesX * _tilesY tile ids
+	std::vector<uint8_t> _tiles;                                  // Unique tiles, back to back
+	std::unordered_multimap<uint64_t, uint32_t> _index;           // Content hash -> tile id
+};
@@ -0,0 +1,212 @@
+#include "Trace.h"
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+    const uint32_t kEventsPerThread = 8192;
+
+    struct TraceEvent {
+        char phase;              // 'X' complete span, 'C' counter, 'i' instant message
+        const char* name;
+        int64_t timestamp;       // Microseconds
+        int64_t duration;
+        double value;
+        char message[120];
+    };
+
+    // Written only by its owning thread; read by the exporter up to the published
+    // count. The owner publishes a new generation only after resetting the
+    // counts, so a reader that sees the current generation sees them reset.
+    struct ThreadBuffer {
+        uint32_t threadId = 0;
+        std::atomic<uint64_t> generation{ 0 };
+        std::atomic<uint32_t> count{ 0 };
+        std::atomic<long long> dropped{ 0 };
+        std::unique_ptr<TraceEvent[]> events{ new TraceEvent[kEventsPerThread] };
+    };
+
+    // Buffers are registered once per thread and kept for the life of the
+    // process, so events from threads that have exited can still be exported
+    std::mutex s_registryMutex;
+    std::vector<ThreadBuffer*> s_registry;
+    std::atomic<uint64_t> s_generation{ 1 };
+    std::atomic<uint32_t> s_nextThreadId{ 1 };
+
+    int InitialLevel() {
+#ifdef _WIN32
+        char* value = nullptr;
+        size_t length = 0;
+        int level = 0;
+        if (_dupenv_s(&value, &length, "STITCH_TRACE") == 0 && value) {
+            level = atoi(value);
+            free(value);
+        }
+        return level;
+#else
+        const char* value = getenv("STITCH_TRACE");
+        return value ? atoi(value) : 0;
+#endif
+    }
+
+    ThreadBuffer* CurrentBuffer() {
+        thread_local ThreadBuffer* buffer = nullptr;
+        if (!buffer) {
+            buffer = new ThreadBuffer();
+            buffer->threadId = s_nextThreadId.fetch_add(1, std::memory_order_relaxed);
+            std::lock_guard<std::mutex> lock(s_registryMutex);
+            s_registry.push_back(buffer);
+        }
+
+        // The owning thread clears its own buffer when a new session starts
+        uint64_t generation = s_generation.load(std::memory_order_acquire);
+        if (buffer->generation.load(std::memory_order_relaxed) != generation) {
+            buffer->count.store(0, std::memory_order_relaxed);
+            buffer->dropped.store(0, std::memory_order_relaxed);
+            buffer->generation.store(generation, std::memory_order_release);
+        }
+        return buffer;
+    }
+
+    // Claim the next slot, or nullptr if the buffer is full
+    TraceEvent* NextEvent(ThreadBuffer*& buffer) {
+        buffer = CurrentBuffer();
+        uint32_t index = buffer->count.load(std::memory_order_relaxed);
+        if (index >= kEventsPerThread) {
+            buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        return &buffer->events[index];
+    }
+
+    void Publish(ThreadBuffer* buffer) {
+        buffer->count.store(buffer->count.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    void WriteJsonString(std::ostream& out, const char* text) {
+        out << '"';
+        for (const char* p = text; *p; p++) {
+            unsigned char c = (unsigned char)*p;
+            if (c == '"' || c == '\\') {
+                out << '\\' << (char)c;
+            } else if (c < 0x20) {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                out << escaped;
+            } else {
+                out << (char)c;
+            }
+        }
+        out << '"';
+    }
+}
+
+std::atomic<int> Trace::s_level{ InitialLevel() };
+
+int64_t Trace::NowMicroseconds() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Trace::BeginSession() {
+    s_generation.fetch_add(1, std::memory_order_acq_rel);
+}
+
+long long Trace::DroppedEvents() {
+    uint64_t generation = s_generation.load(std::memory_order_acquire);
+    long long dropped = 0;
+    std::lock_guard<std::mutex> lock(s_registryMutex);
+    for (ThreadBuffer* buffer : s_registry) {
+        if (buffer->generation.load(std::memory_order_acquire) == generation)
+            dropped += buffer->dropped.load(std::memory_order_relaxed);
+    }
+    return dropped;
+}
+
+void Trace::RecordSpan(const char* name, int64_t startUs, int64_t endUs) {
+    ThreadBuffer* buffer;
+    TraceEvent* event = NextEvent(buffer);
+    if (!event)
+        return;
+    event->phase = 'X';
+    event->name = name;
+    event->timestamp = startUs;
+    event->duration = endUs - startUs;
+    Publish(buffer);
+}
+
+void Trace::RecordCounter(const char* name, double value) {
+    ThreadBuffer* buffer;
+    TraceEvent* event = NextEvent(buffer);
+    if (!event)
+        return;
+    event->phase = 'C';
+    event->name = name;
+    event->timestamp = NowMicroseconds();
+    event->value = value;
+    Publish(buffer);
+}
+
+void Trace::RecordMessage(const char* format, ...) {
+    ThreadBuffer* buffer;
+    TraceEvent* event = NextEvent(buffer);
+    if (!event)
+        return;
+    event->phase = 'i';
+    event->name = "message";
+    event->timestamp = NowMicroseconds();
+
+    va_list args;
+    va_start(args, format);
+    vsnprintf(event->message, sizeof(event->message), format, args);
+    va_end(args);
+
+    // Messages were written for OutputDebugString; drop the trailing newline
+    size_t length = strlen(event->message);
+    if (length > 0 && event->message[length - 1] == '\n')
+        event->message[length - 1] = '\0';
+    Publish(buffer);
+}
+
+bool Trace::WriteChromeTrace(const std::string& path) {
+    std::ofstream out(path);
+    if (!out)
+        return false;
+
+    uint64_t generation = s_generation.load(std::memory_order_acquire);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+
+    std::lock_guard<std::mutex> lock(s_registryMutex);
+    for (ThreadBuffer* buffer : s_registry) {
+        if (buffer->generation.load(std::memory_order_acquire) != generation)
+            continue;
+        uint32_t count = buffer->count.load(std::memory_order_acquire);
+        for (uint32_t i = 0; i < count; i++) {
+            const TraceEvent& event = buffer->events[i];
+            out << (first ? "" : ",\n") << "{\"name\":";
+            first = false;
+            WriteJsonString(out, event.name);
+            out << ",\"cat\":\"stitch\",\"ph\":\"" << event.phase << "\",\"ts\":" << event.timestamp
+                << ",\"pid\":1,\"tid\":" << buffer->threadId;
+            if (event.phase == 'X') {
+                out << ",\"dur\":" << event.duration;
+            } else if (event.phase == 'C') {
+                out << ",\"args\":{\"value\":" << event.value << "}";
+            } else {
+                out << ",\"s\":\"t\",\"args\":{\"text\":";
+                WriteJsonString(out, event.message);
+                out << "}";
+            }
+            out << "}";
+        }
+    }
+    out << "\n]}\n";
+    return (bool)out;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Trace levels. A statement is kept by the compiler only if its level is at
+// most STITCH_TRACE_LEVEL, and recorded at run time only if it is also at most
+// Trace::Level(). With STITCH_TRACE_LEVEL 0 every macro expands to nothing.
+#define TRACE_INFO 1       // One span per stitch / capture stage
+#define TRACE_DEBUG 2      // Per-frame spans and counters
+#define TRACE_VERBOSE 3    // Per-frame diagnostic messages
+
+#ifndef STITCH_TRACE_LEVEL
+#define STITCH_TRACE_LEVEL TRACE_VERBOSE
+#endif
+
+// Records spans, counters and messages into per-thread buffers and exports
+// them as Chrome trace-event JSON (open in chrome://tracing or Perfetto).
+// Writers never take a lock: each thread appends to its own fixed-size buffer
+// and publishes the new event count with a release store. Events past a
+// buffer's capacity are dropped and counted.
+class Trace {
+public:
+	// Runtime level; 0 (the default) records nothing. Initialized from the
+	// STITCH_TRACE environment variable if it is set to a level number.
+	static int Level() { return s_level.load(std::memory_order_relaxed); }
+	static void SetLevel(int level) { s_level.store(level, std::memory_order_relaxed); }
+	static bool IsEnabled(int level) { return level <= Level(); }
+
+	// Start a new session; events from earlier sessions are discarded
+	static void BeginSession();
+
+	// Write every event recorded since BeginSession() as Chrome trace JSON.
+	// Call after the traced work has finished. Returns false on I/O errors.
+	static bool WriteChromeTrace(const std::string& path);
+
+	// Events dropped this session because a thread's buffer was full
+	static long long DroppedEvents();
+
+	// Microseconds on a monotonic clock
+	static int64_t NowMicroseconds();
+
+	// Names must be string literals or otherwise outlive the session
+	static void RecordSpan(const char* name, int64_t startUs, int64_t endUs);
+	static void RecordCounter(const char* name, double value);
+	static void RecordMessage(const char* format, ...);
+
+private:
+	static std::atomic<int> s_level;
+};
+
+// RAII span: records [construction, destruction) as one complete event
+template <int LevelValue>
+class TraceSpan {
+public:
+	explicit TraceSpan(const char* name) {
+		if (LevelValue <= STITCH_TRACE_LEVEL && Trace::IsEnabled(LevelValue)) {
+			_name = name;
+			_start = Trace::NowMicroseconds();
+		}
+	}
+
+	~TraceSpan() {
+		if (LevelValue <= STITCH_TRACE_LEVEL && _name)
+			Trace::RecordSpan(_name, _start, Trace::NowMicroseconds());
+	}
+
+	TraceSpan(const TraceSpan&) = delete;
+	TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+	const char* _name = nullptr;
+	int64_t _start = 0;
+};
+
+#define STITCH_TRACE_CONCAT_INNER(a, b) a##b
+#define STITCH_TRACE_CONCAT(a, b) STITCH_TRACE_CONCAT_INNER(a, b)
+
+#if STITCH_TRACE_LEVEL > 0
+#define TRACE_SPAN(level, name) TraceSpan<level> STITCH_TRACE_CONCAT(_traceSpan, __LINE__)(name)
+#define TRACE_COUNTER(level, name, value) \
+	do { if ((level) <= STITCH_TRACE_LEVEL && Trace::IsEnabled(level)) Trace::RecordCounter(name, (double)(value)); } while (0)
+#define TRACE_MESSAGE(level, ...) \
+	do { if ((level) <= STITCH_TRACE_LEVEL && Trace::IsEnabled(level)) Trace::RecordMessage(__VA_ARGS__); } while (0)
+#else
+#define TRACE_SPAN(level, name) ((void)0)
+#define TRACE_COUNTER(level, name, value) ((void)0)
+#define TRACE_MESSAGE(level, ...) ((void)0)
+#endif